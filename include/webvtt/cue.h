@@ -87,7 +87,8 @@ webvtt_cue_t {
   webvtt_string body;
 
   /**
-    * Parsed cue-text (NULL if has not been parsed)
+    * Parsed cue-text (NULL if has not been parsed, see
+    * webvtt_cue_get_nodes())
     */
   webvtt_node *node_head;
 } webvtt_cue;
@@ -104,6 +105,21 @@ webvtt_release_cue( webvtt_cue **pcue );
 WEBVTT_EXPORT int
 webvtt_validate_cue( webvtt_cue *cue );
 
+/**
+ * webvtt_cue_get_nodes
+ *
+ * return the parsed cue text of 'cue', parsing its body first if that has not
+ * been done yet (as with WEBVTT_PARSER_LAZY_CUETEXT). The nodes are allocated
+ * the same way as the cue itself, and belong to it. Returns NULL if the cue
+ * text could not be parsed.
+ *
+ * This modifies the cue, so it must not be called for the same cue on several
+ * threads at once, nor on a cue from a parser using WEBVTT_PARSER_USE_ARENA
+ * while that parser is running on another thread.
+ */
+WEBVTT_EXPORT webvtt_node *
+webvtt_cue_get_nodes( webvtt_cue *cue );
+
 WEBVTT_EXPORT webvtt_status
 webvtt_cue_set_align( webvtt_cue *cue, const char *value );
 
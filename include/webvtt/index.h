@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2013 Mozilla Foundation and Contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __WEBVTT_INDEX_H__
+# define __WEBVTT_INDEX_H__
+# include "util.h"
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * Where one cue lives in a document: the 'length' bytes at 'offset' run from
+ * the start of its identifier (or of its timing line if it has none) to the
+ * end of its last line of cue text, excluding the line terminator. 'line' is
+ * the number of the line at 'offset', counting from 1.
+ */
+typedef struct
+webvtt_index_entry_t {
+  webvtt_uint offset;
+  webvtt_uint length;
+  webvtt_uint line;
+  webvtt_timestamp from;
+  webvtt_timestamp until;
+} webvtt_index_entry;
+
+/**
+ * The cues of a document, in the order they appear in it. 'sorted' is set if
+ * that is also the order of their start times, as it should be, and 'longest'
+ * is the longest time any cue is shown for; together they allow the cues
+ * around a point in time to be found without looking at all of them.
+ */
+typedef struct
+webvtt_index_t {
+  webvtt_index_entry *entries;
+  webvtt_uint count;
+  webvtt_uint alloc;
+  webvtt_bool sorted;
+  webvtt_timestamp longest;
+} webvtt_index;
+
+/**
+ * webvtt_build_index
+ *
+ * find the cues of the document in 'buffer' without parsing them. Only the
+ * timing lines are looked at, following the same rules as the parser, so that
+ * the index lists the cues the parser would produce; nothing but the array of
+ * entries is allocated. Cue settings and text are not checked.
+ *
+ * Returns WEBVTT_PARSE_ERROR if the document does not start with a WEBVTT
+ * header, in which case the parser would not produce any cues either. Release
+ * the index with webvtt_release_index(), whatever the outcome.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_build_index( const void *buffer, webvtt_uint len, webvtt_index *index );
+
+WEBVTT_EXPORT void
+webvtt_release_index( webvtt_index *index );
+
+/**
+ * webvtt_index_find_range
+ *
+ * find the entries of cues which are shown at some point between 'from' and
+ * 'until' inclusive, that is which start no later than 'until' and end after
+ * 'from'. With 'from' equal to 'until', these are the cues shown at that
+ * moment. '*first' is set to the first entry to consider and the return value
+ * is one past the last; entries in between which do not overlap the range
+ * still have to be skipped with webvtt_index_entry_overlaps(). A sorted index
+ * is searched by bisection; any other is looked at in full.
+ */
+WEBVTT_EXPORT webvtt_uint
+webvtt_index_find_range( const webvtt_index *index, webvtt_timestamp from,
+                         webvtt_timestamp until, webvtt_uint *first );
+
+WEBVTT_EXPORT webvtt_bool
+webvtt_index_entry_overlaps( const webvtt_index_entry *entry,
+                             webvtt_timestamp from, webvtt_timestamp until );
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
@@ -89,6 +89,12 @@ webvtt_node_kind_t {
 
 struct webvtt_internal_node_data_t;
 
+/**
+ * Number of children an internal node can hold before it needs to allocate
+ * an array for them.
+ */
+#define WEBVTT_NODE_INLINE_CHILDREN 3
+
 typedef struct
 webvtt_node_t {
 
@@ -116,7 +122,12 @@ webvtt_internal_node_data_t {
 
   webvtt_uint alloc;
   webvtt_uint length;
+  /**
+   * Points at 'inline_children' until more than WEBVTT_NODE_INLINE_CHILDREN
+   * children are attached.
+   */
   webvtt_node **children;
+  webvtt_node *inline_children[ WEBVTT_NODE_INLINE_CHILDREN ];
 } webvtt_internal_node_data;
 
 WEBVTT_EXPORT void
@@ -30,6 +30,7 @@
 # include "string.h"
 # include "cue.h"
 # include "error.h"
+# include "index.h"
 
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
@@ -48,20 +49,285 @@ typedef int ( WEBVTT_CALLBACK *webvtt_error_fn )( void *userdata,
 typedef void ( WEBVTT_CALLBACK *webvtt_cue_fn )( void *userdata,
                                                  webvtt_cue *cue );
 
+/**
+ * Receives 'count' cues at once, in the order they were parsed. Each of them
+ * is handed over as the cue given to a webvtt_cue_fn is. The array itself
+ * belongs to the parser and is only valid during the call.
+ */
+typedef void ( WEBVTT_CALLBACK *webvtt_cue_batch_fn )( void *userdata,
+                                                       webvtt_cue **cues,
+                                                       webvtt_uint count );
+
+typedef enum
+webvtt_parser_flags_t {
+  /**
+   * Allocate every object produced for this parser (cues, strings, nodes,
+   * cuetext tokens, ...) from a bump allocator owned by the parser.
+   *
+   * Releasing those objects does not give any memory back; all of it is freed
+   * in one go by webvtt_delete_parser(). Cues and anything obtained from them
+   * must therefore not be used after the parser has been deleted. Objects
+   * created by the application from within the parser callbacks come from the
+   * arena too.
+   */
+  WEBVTT_PARSER_USE_ARENA = 1 << 0,
+
+  /**
+   * The application promises that every buffer passed to webvtt_parse_chunk()
+   * stays alive and unchanged for as long as any cue produced by the parser,
+   * or anything obtained from one, is in use.
+   *
+   * Cue ids, cue bodies and the text of text nodes then borrow their text from
+   * those buffers where they can (see webvtt_create_borrowed_string()), instead
+   * of copying it. Text is still copied when it differs from the input, such
+   * as for escapes, replaced NUL characters, lines split across chunks and
+   * cue bodies with CRLF line endings. Borrowed strings are not NUL-terminated.
+   */
+  WEBVTT_PARSER_BORROW_INPUT = 1 << 1,
+
+  /**
+   * Do not parse cue text while parsing the document. Cues are handed over
+   * with 'node_head' left NULL, and the node tree is only built by
+   * webvtt_cue_get_nodes(), for the cues which need it. The tree is the same
+   * as the one the parser would have built.
+   */
+  WEBVTT_PARSER_LAZY_CUETEXT = 1 << 2,
+
+  /**
+   * The following flags leave out parts of the work done for every cue, for
+   * applications which only need some of what a cue holds. Lines are still
+   * recognized and checked for what they are, so the same cues are produced,
+   * with the same timings and bodies.
+   *
+   * WEBVTT_PARSER_SKIP_IDS: cue identifiers are not stored; 'id' stays empty.
+   */
+  WEBVTT_PARSER_SKIP_IDS = 1 << 3,
+
+  /**
+   * Cue settings are neither parsed nor validated. Cues keep their default
+   * settings, and no errors are reported for bad settings.
+   */
+  WEBVTT_PARSER_SKIP_SETTINGS = 1 << 4,
+
+  /**
+   * Cue text is never tokenized, such as for metadata tracks whose bodies are
+   * not markup. 'node_head' stays NULL, and webvtt_cue_get_nodes() returns
+   * NULL for these cues too.
+   */
+  WEBVTT_PARSER_SKIP_CUETEXT = 1 << 5,
+
+  /**
+   * Errors are reported with a column of 0, and the parser does not count
+   * characters only to work out the columns of errors.
+   */
+  WEBVTT_PARSER_SKIP_ERROR_COLUMNS = 1 << 6,
+
+  WEBVTT_PARSER_SKIP_MASK = WEBVTT_PARSER_SKIP_IDS
+    | WEBVTT_PARSER_SKIP_SETTINGS | WEBVTT_PARSER_SKIP_CUETEXT
+    | WEBVTT_PARSER_SKIP_ERROR_COLUMNS,
+
+  /**
+   * Keep the statistics returned by webvtt_get_parser_alloc_stats(). They
+   * cost a few atomic operations for every allocation and release, so they
+   * are not kept otherwise.
+   */
+  WEBVTT_PARSER_ALLOC_STATS = 1 << 7
+} webvtt_parser_flags;
+
+/**
+ * Optional settings for webvtt_create_parser_with_options().
+ * A zero-filled structure gives the same parser as webvtt_create_parser().
+ */
+typedef struct
+webvtt_parser_options_t {
+  /**
+   * Bitwise combination of webvtt_parser_flags
+   */
+  webvtt_uint flags;
+
+  /**
+   * Allocation functions used for everything this parser creates. If either
+   * is NULL, the functions given to webvtt_set_allocator() at the time the
+   * parser is created are used.
+   *
+   * Each parser keeps its own allocation bookkeeping, so parsers may be used
+   * concurrently on different threads. Objects may outlive their parser; the
+   * functions must remain usable until the last of them has been released.
+   */
+  webvtt_alloc_fn_ptr alloc;
+  webvtt_free_fn_ptr free;
+  void *alloc_data;
+} webvtt_parser_options;
 
 WEBVTT_EXPORT webvtt_status
 webvtt_create_parser( webvtt_cue_fn on_read, webvtt_error_fn on_error,
                       void * userdata, webvtt_parser *ppout );
 
+WEBVTT_EXPORT webvtt_status
+webvtt_create_parser_with_options( webvtt_cue_fn on_read,
+                                   webvtt_error_fn on_error, void *userdata,
+                                   const webvtt_parser_options *options,
+                                   webvtt_parser *ppout );
+
 WEBVTT_EXPORT void
 webvtt_delete_parser( webvtt_parser parser );
 
+/**
+ * Bring 'parser' back to the state webvtt_create_parser() left it in, so that
+ * it can parse another document, keeping its options and its allocation
+ * context along with the memory it has already grown. Any document it was in
+ * the middle of is dropped without reporting further cues or errors.
+ *
+ * With WEBVTT_PARSER_USE_ARENA, the arena is emptied as it is by
+ * webvtt_delete_parser(), so cues from the previous document must not be used
+ * afterwards.
+ */
+WEBVTT_EXPORT void
+webvtt_reset_parser( webvtt_parser parser );
+
+/**
+ * Replace the callbacks and userdata given when 'parser' was created, for
+ * instance when a reset parser is handed to a different owner.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_set_parser_callbacks( webvtt_parser parser, webvtt_cue_fn on_read,
+                             webvtt_error_fn on_error, void *userdata );
+
+/**
+ * Have 'parser' hand its cues to 'on_batch', up to 'max' at a time (64 if
+ * 'max' is 0), instead of one by one to the webvtt_cue_fn it was created
+ * with. Cues are held back until 'max' have been collected, or until the
+ * input given to webvtt_parse_chunk() has been parsed, parsing is finished,
+ * or an error is about to be reported, so they still arrive in order with
+ * respect to errors and never outlast the call that parsed them.
+ *
+ * A NULL 'on_batch' goes back to delivering cues one by one.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_set_cue_batch_callback( webvtt_parser parser,
+                               webvtt_cue_batch_fn on_batch, webvtt_uint max );
+
 WEBVTT_EXPORT webvtt_status
 webvtt_parse_chunk( webvtt_parser self, const void *buffer, webvtt_uint len );
 
 WEBVTT_EXPORT webvtt_status
 webvtt_finish_parsing( webvtt_parser self );
 
+/**
+ * Give 'parser' text to parse on demand for webvtt_parser_next_cue(). Cues
+ * then wait to be pulled instead of being handed to the webvtt_cue_fn, while
+ * errors are still reported as they are found. 'buffer' must stay alive and
+ * unchanged until webvtt_parser_next_cue() has used it up and asks for more;
+ * 'last' says that it ends the document.
+ *
+ * Returns WEBVTT_INVALID_PARAM if the previous input has not been used up or
+ * was the last.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parser_set_input( webvtt_parser parser, const void *buffer,
+                         webvtt_uint len, webvtt_bool last );
+
+/**
+ * Parse just enough of the input given to webvtt_parser_set_input() to find
+ * the next cue, and store it in 'pcue', which the caller then owns as if it
+ * had been passed to a webvtt_cue_fn.
+ *
+ * Returns WEBVTT_UNFINISHED, with 'pcue' set to NULL, when all of the input
+ * has been parsed and more is needed, and WEBVTT_SUCCESS with 'pcue' set to
+ * NULL once the last input has been parsed to the end. Once parsing stops
+ * with an error, that error is returned from then on.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parser_next_cue( webvtt_parser parser, webvtt_cue **pcue );
+
+/**
+ * Parse a whole document at once, as webvtt_parse_chunk() followed by
+ * webvtt_finish_parsing() would, with the same cues and errors. Blocks made of
+ * an optional cue id, the timings and cue text up to an empty line are read a
+ * line at a time straight out of 'buffer', without being tokenized or copied;
+ * anything else goes through the usual state machine. Cues still get their
+ * own copies of their text unless WEBVTT_PARSER_BORROW_INPUT was given, in
+ * which case webvtt_parse_chunk() reads whole blocks the same way.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_buffer( webvtt_parser self, const void *buffer, webvtt_uint len );
+
+/**
+ * Parse the whole file at 'path' and finish parsing. Regular files are mapped
+ * into memory and handed to webvtt_parse_buffer(); anything else, such as a
+ * pipe, is read and parsed in large pieces. Returns WEBVTT_UNSUCCESSFUL if
+ * the file can't be opened or read.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_file( webvtt_parser self, const char *path );
+
+/**
+ * Parse a whole document at once like webvtt_parse_buffer(), spread over
+ * 'threads' threads. If 'threads' is 0, one is used for every 64 KiB of text,
+ * up to the number of processors.
+ *
+ * The body is cut into segments at empty lines, each of which is parsed by a
+ * parser of its own. Where a segment turns out not to end between two blocks
+ * (after a cue id with nothing else in its block, say), the segments after it
+ * are parsed again on the calling thread until the text reaches a clean break.
+ * Once they are all done, cues and errors are handed to the callbacks on the
+ * calling thread, in the order they appear in the text and with the line
+ * numbers they have in it. Returning a negative value from the error callback
+ * drops everything after that error.
+ *
+ * The allocation functions of 'self' are called from several threads at
+ * once. Parsers which use WEBVTT_PARSER_USE_ARENA parse on one thread only.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_parallel( webvtt_parser self, const void *buffer,
+                       webvtt_uint len, webvtt_uint threads );
+
+/**
+ * webvtt_parse_file() for webvtt_parse_parallel(); input which can't be
+ * mapped into memory is parsed on one thread.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_file_parallel( webvtt_parser self, const char *path,
+                            webvtt_uint threads );
+
+/**
+ * Parse only the cues of the document in 'buffer' which are shown at some
+ * point between 'from' and 'until' inclusive (see webvtt_index_find_range()),
+ * and finish parsing. Each of them is parsed on its own, straight from its
+ * place in the buffer, and handed to the callbacks like any other cue, in
+ * the order they appear in the document. Errors within those cues are
+ * reported with their lines in the document; nothing outside of them is
+ * looked at.
+ *
+ * 'index' is the result of webvtt_build_index() for this same buffer, which
+ * may be kept and reused for any number of ranges. If it is NULL, an index is
+ * built for the call.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_range( webvtt_parser self, const void *buffer, webvtt_uint len,
+                    const webvtt_index *index, webvtt_timestamp from,
+                    webvtt_timestamp until );
+
+/**
+ * webvtt_parse_file() for webvtt_parse_range(). Given an index, which must
+ * have been built from the file as it is now, only the pages of a mapped file
+ * which hold the cues in range are read in. Input which can't be mapped is
+ * read in full first.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_file_range( webvtt_parser self, const char *path,
+                         const webvtt_index *index, webvtt_timestamp from,
+                         webvtt_timestamp until );
+
+/**
+ * Retrieve the allocation statistics of everything allocated by, or from
+ * within the callbacks of, 'self'. Blocks released after the parser has been
+ * deleted are not reflected anywhere. Every counter is 0 unless the parser
+ * was created with WEBVTT_PARSER_ALLOC_STATS.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_get_parser_alloc_stats( webvtt_parser self, webvtt_alloc_stats *stats );
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
@@ -41,11 +41,63 @@ typedef struct webvtt_string_data_t webvtt_string_data;
 typedef struct webvtt_stringlist_t webvtt_stringlist;
 struct webvtt_string_data_t;
 
+/**
+ * Strings of fewer than WEBVTT_STRING_INLINE_SIZE bytes are stored in the
+ * webvtt_string itself, rather than in separately allocated, reference counted
+ * string data. Copying such a string copies its text, so the pointer returned
+ * by webvtt_string_text() is only valid as long as the webvtt_string it was
+ * obtained from.
+ */
+# define WEBVTT_STRING_INLINE_SIZE 16
+
 struct
 webvtt_string_t {
   webvtt_string_data *d;
+  char inline_text[ WEBVTT_STRING_INLINE_SIZE ];
 };
 
+/**
+ * A (pointer, length) slice of text owned by someone else. The text is not
+ * necessarily NUL-terminated.
+ */
+typedef struct
+webvtt_string_view_t {
+  const char *text;
+  webvtt_uint32 length;
+} webvtt_string_view;
+
+/**
+ * Counters for the calling thread's string buffer pool.
+ *
+ * 'hits' and 'misses' count requests for a pooled size which were, or were
+ * not, satisfied from the pool. Requests of other sizes count as neither.
+ */
+typedef struct
+webvtt_string_pool_stats_t {
+  webvtt_uint64 hits;
+  webvtt_uint64 misses;
+  webvtt_uint cached_blocks;
+  webvtt_uint cached_bytes;
+} webvtt_string_pool_stats;
+
+/**
+ * webvtt_get_string_pool_stats
+ *
+ * fill 'stats' with the counters of the calling thread's string pool. They
+ * are all zero if the library was built without WEBVTT_STRING_POOL.
+ */
+WEBVTT_EXPORT void
+webvtt_get_string_pool_stats( webvtt_string_pool_stats *stats );
+
+/**
+ * webvtt_trim_string_pool
+ *
+ * free the buffers cached in the calling thread's string pool. This happens
+ * by itself when the thread exits; calling it gives the memory back sooner.
+ */
+WEBVTT_EXPORT void
+webvtt_trim_string_pool( void );
+
 /**
  * webvtt_init_string
  *
@@ -85,6 +137,39 @@ WEBVTT_EXPORT webvtt_status
 webvtt_create_string_with_text( webvtt_string *out, const char *init_text,
                                 int len );
 
+/**
+ * webvtt_create_borrowed_string
+ *
+ * initialize 'out' to refer to the 'len' bytes at 'text' without copying them.
+ * if 'len' < 0, assume text to be null-terminated.
+ *
+ * the caller must keep 'text' alive and unchanged for as long as 'out', or any
+ * copy of it, is in use. a borrowed string is not NUL-terminated, so its
+ * contents must be read with webvtt_string_get_view() or with
+ * webvtt_string_text() together with webvtt_string_length(). modifying the
+ * string first gives it a copy of its own.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_create_borrowed_string( webvtt_string *out, const char *text,
+                               int len );
+
+/**
+ * webvtt_string_is_borrowed
+ *
+ * return whether 'str' refers to text it does not own
+ */
+WEBVTT_EXPORT webvtt_bool
+webvtt_string_is_borrowed( const webvtt_string *str );
+
+/**
+ * webvtt_string_get_view
+ *
+ * store the text and length of 'str' in 'view'. this works for every kind of
+ * string; the view is valid until 'str' is modified or released.
+ */
+WEBVTT_EXPORT void
+webvtt_string_get_view( const webvtt_string *str, webvtt_string_view *view );
+
 /**
  * webvtt_ref_string
  *
@@ -127,7 +212,8 @@ webvtt_copy_string( webvtt_string *left, const webvtt_string *right );
 /**
  * webvtt_string_text
  *
- * return the text contents of a string
+ * return the text contents of a string. the text is NUL-terminated unless the
+ * string is borrowed.
  */
 WEBVTT_EXPORT const char *
 webvtt_string_text( const webvtt_string *str );
@@ -148,11 +234,30 @@ webvtt_string_length( const webvtt_string *str );
 WEBVTT_EXPORT webvtt_uint32
 webvtt_string_capacity( const webvtt_string *str );
 
+/**
+ * webvtt_string_reserve
+ *
+ * make sure that 'str' can hold 'capacity' bytes of text without being
+ * reallocated. the string is detached, and exactly 'capacity' bytes are
+ * allocated if it needs more room.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_string_reserve( webvtt_string *str, webvtt_uint32 capacity );
+
+/**
+ * webvtt_string_shrink_to_fit
+ *
+ * give back any unused capacity of 'str'. shared strings are left alone.
+ */
+WEBVTT_EXPORT webvtt_status
+webvtt_string_shrink_to_fit( webvtt_string *str );
+
 /**
  * webvtt_string_getline
  *
  * collect a line of text (terminated by CR/LF/CRLF) from a buffer, without
- * including the terminating character(s)
+ * including the terminating character(s). NUL bytes in the line are replaced
+ * with U+FFFD REPLACEMENT CHARACTER as they are copied.
  */
 WEBVTT_EXPORT int
 webvtt_string_getline( webvtt_string *str, const char *buffer,
@@ -319,6 +424,31 @@ webvtt_skip_utf8( const char **begin, const char *end, int n_chars );
 WEBVTT_EXPORT webvtt_uint16
 webvtt_utf8_to_utf16( const char *utf8, const char *end, webvtt_uint16 *high );
 
+/**
+ * webvtt_utf8_decode
+ *
+ * return the code point at '*utf8' and move '*utf8' past it. an ill-formed
+ * sequence decodes as U+FFFD, and is skipped along with any continuation
+ * bytes which follow it. returns 0, leaving '*utf8' alone, at 'end'.
+ */
+WEBVTT_EXPORT webvtt_uint32
+webvtt_utf8_decode( const char **utf8, const char *end );
+
+/**
+ * webvtt_utf8_to_utf16_buffer
+ *
+ * convert the text between 'utf8' and 'end' (or the terminating NUL, if 'end'
+ * is null) to utf16, writing at most 'out_len' units to 'out'. ill-formed
+ * sequences become U+FFFD, as with webvtt_utf8_decode.
+ *
+ * returns the number of units the whole text needs. the conversion is only
+ * complete if that is no more than 'out_len'; 'out' may be null to find out
+ * how large a buffer is needed.
+ */
+WEBVTT_EXPORT webvtt_uint32
+webvtt_utf8_to_utf16_buffer( const char *utf8, const char *end,
+                             webvtt_uint16 *out, webvtt_uint32 out_len );
+
 /**
  * webvtt_utf8_chcount
  *
@@ -328,6 +458,18 @@ webvtt_utf8_to_utf16( const char *utf8, const char *end, webvtt_uint16 *high );
 WEBVTT_EXPORT int
 webvtt_utf8_chcount( const char *utf8, const char *end );
 
+/**
+ * webvtt_utf8_validate
+ *
+ * return true if the text between 'utf8' and 'end' (or the terminating NUL,
+ * if 'end' is null) is well-formed utf8. if 'invalid' is not null, it is set
+ * to the offset of the first byte of the first ill-formed sequence, or to the
+ * length of the text if there is none.
+ */
+WEBVTT_EXPORT webvtt_bool
+webvtt_utf8_validate( const char *utf8, const char *end,
+                      webvtt_uint32 *invalid );
+
 /**
  * webvtt_utf8_length
  *
@@ -167,7 +167,10 @@ extern "C" {
    *
    * Currently, set_allocator (and the other allocation functions) do not use
    * any locking mechanism, so the library cannot be considered to be
-   * thread-safe at this time if changing the allocator is used.
+   * thread-safe at this time if changing the allocator is used. Parsers do
+   * not share this allocator's bookkeeping: each one allocates from a context
+   * of its own (see webvtt_parser_options), and only objects created by the
+   * application outside of a parser callback come from here.
    *
    * I don't believe there is much of a reason to worry about the overhead of
    * using function pointers for allocation, as it is negligible compared to the
@@ -181,6 +184,59 @@ extern "C" {
                                            webvtt_free_fn_ptr free,
                                            void *userdata );
 
+  /**
+   * What a block of memory was allocated for, for the purpose of the
+   * allocation statistics.
+   */
+  typedef enum
+  webvtt_alloc_kind_t {
+    WEBVTT_ALLOC_OTHER = 0, /* webvtt_alloc() called by the application */
+    WEBVTT_ALLOC_STRING,
+    WEBVTT_ALLOC_STRINGLIST,
+    WEBVTT_ALLOC_CUE,
+    WEBVTT_ALLOC_NODE,
+    WEBVTT_ALLOC_TOKEN,
+    WEBVTT_ALLOC_PARSER_STACK, /* the parser and its state stack */
+    WEBVTT_ALLOC_KIND_COUNT
+  } webvtt_alloc_kind;
+
+  typedef struct
+  webvtt_alloc_counters_t {
+    webvtt_uint64 allocs;
+    webvtt_uint64 frees;
+    webvtt_uint64 live_bytes;
+    webvtt_uint64 peak_bytes;
+  } webvtt_alloc_counters;
+
+  /**
+   * Allocation statistics. Byte counts are the sizes that were requested,
+   * excluding the allocator's own overhead. 'total.peak_bytes' is the high
+   * water mark of all kinds together, which may be lower than the sum of the
+   * individual peaks. Each counter is updated atomically, so objects may be
+   * released on other threads while in use, but a snapshot taken meanwhile
+   * need not be consistent across counters.
+   */
+  typedef struct
+  webvtt_alloc_stats_t {
+    webvtt_alloc_counters total;
+    webvtt_alloc_counters kinds[ WEBVTT_ALLOC_KIND_COUNT ];
+  } webvtt_alloc_stats;
+
+  /**
+   * Start or stop keeping the statistics of the global allocator, which are
+   * off to begin with. Blocks allocated while they are off stay out of them
+   * when released. Like webvtt_set_allocator(), this must not be called while
+   * other threads use the library.
+   */
+  WEBVTT_EXPORT void webvtt_collect_alloc_stats( webvtt_bool collect );
+
+  /**
+   * Retrieve the statistics of the global allocator, which serves every
+   * allocation not made on behalf of a parser. See
+   * webvtt_get_parser_alloc_stats() for those.
+   */
+  WEBVTT_EXPORT void webvtt_get_alloc_stats( webvtt_alloc_stats *stats );
+
   enum
   webvtt_status_t {
     WEBVTT_SUCCESS = 0,
@@ -272,14 +328,53 @@ extern "C" {
 # define WEBVTT_REF_INIT(Value) { (Value) }
 
   /**
-   * TODO: Replace these with atomic instructions for systems that provide it
+   * Reference counts are updated atomically, so that objects may be released
+   * on a thread other than the one which created them. Defining
+   * WEBVTT_NO_ATOMIC_REFCOUNT (the WEBVTT_ATOMIC_REFCOUNT build option)
+   * falls back to plain increments for single-threaded applications.
+   *
+   * Both macros evaluate to the new value of the count. Increments need no
+   * ordering; a decrement must publish prior writes to whoever frees the
+   * object.
+   *
+   * WEBVTT_ATOMIC_LOAD reads a count which other threads may be changing.
+   * It acquires, so that an object found to be referenced only once may be
+   * changed in place after the other references were dropped.
    */
+# if !defined(WEBVTT_ATOMIC_INC) && !defined(WEBVTT_NO_ATOMIC_REFCOUNT)
+#   if WEBVTT_CC_MSVC
+  long __cdecl _InterlockedIncrement( long volatile *addend );
+  long __cdecl _InterlockedDecrement( long volatile *addend );
+  long __cdecl _InterlockedCompareExchange( long volatile *dest, long value,
+                                            long comparand );
+#     pragma intrinsic(_InterlockedIncrement)
+#     pragma intrinsic(_InterlockedDecrement)
+#     pragma intrinsic(_InterlockedCompareExchange)
+#     define WEBVTT_ATOMIC_INC(x) ( _InterlockedIncrement( &(x) ) )
+#     define WEBVTT_ATOMIC_DEC(x) ( _InterlockedDecrement( &(x) ) )
+#     define WEBVTT_ATOMIC_LOAD(x) ( _InterlockedCompareExchange( &(x), 0, 0 ) )
+#   elif WEBVTT_CC_GCC && defined(__ATOMIC_RELAXED)
+#     define WEBVTT_ATOMIC_INC(x) ( __atomic_add_fetch( &(x), 1, \
+                                                       __ATOMIC_RELAXED ) )
+#     define WEBVTT_ATOMIC_DEC(x) ( __atomic_sub_fetch( &(x), 1, \
+                                                       __ATOMIC_ACQ_REL ) )
+#     define WEBVTT_ATOMIC_LOAD(x) ( __atomic_load_n( &(x), \
+                                                      __ATOMIC_ACQUIRE ) )
+#   elif WEBVTT_CC_GCC
+#     define WEBVTT_ATOMIC_INC(x) ( __sync_add_and_fetch( &(x), 1 ) )
+#     define WEBVTT_ATOMIC_DEC(x) ( __sync_sub_and_fetch( &(x), 1 ) )
+#     define WEBVTT_ATOMIC_LOAD(x) ( __sync_add_and_fetch( &(x), 0 ) )
+#   endif
+# endif
 # ifndef WEBVTT_ATOMIC_INC
 #   define WEBVTT_ATOMIC_INC(x) ( ++(x) )
 # endif
 # ifndef WEBVTT_ATOMIC_DEC
 #   define WEBVTT_ATOMIC_DEC(x) ( --(x) )
 # endif
+# ifndef WEBVTT_ATOMIC_LOAD
+#   define WEBVTT_ATOMIC_LOAD(x) (x)
+# endif
 
 # if defined(WEBVTT_INLINE)
   static WEBVTT_INLINE int webvtt_ref( struct webvtt_refcount_t *ref )
@@ -290,9 +385,15 @@ extern "C" {
   {
     return WEBVTT_ATOMIC_DEC(ref->value);
   }
+  static WEBVTT_INLINE int
+  webvtt_ref_count( struct webvtt_refcount_t *ref )
+  {
+    return WEBVTT_ATOMIC_LOAD(ref->value);
+  }
 # else
 #   define webvtt_inc_ref(ref) ( WEBVTT_ATOMIC_INC((ref)->value) )
 #   define webvtt_dec_ref(ref) ( WEBVTT_ATOMIC_DEC((ref)->value) )
+#   define webvtt_ref_count(ref) ( WEBVTT_ATOMIC_LOAD((ref)->value) )
 # endif
 
 #if defined(__cplusplus) || defined(c_plusplus)
@@ -25,23 +25,94 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <webvtt/util.h>
+#include "alloc_internal.h"
+#include <webvtt/string.h>
 #include <stdlib.h>
 #include <string.h>
+#if WEBVTT_STRING_POOL && defined(WEBVTT_HAVE_THREAD_LOCAL)
+# if WEBVTT_OS_WIN32
+#   include <windows.h>
+# else
+#   include <pthread.h>
+# endif
+#endif
 
 static void *default_alloc( void *unused, webvtt_uint nb );
 static void default_free( void *unused, void *ptr );
 
-struct {
-  /**
-   * Number of allocated objects. Forbid changing the allocator if this is not
-   * equal to 0 
-   */
-  webvtt_uint n_alloc;
-  webvtt_alloc_fn_ptr alloc;
-  webvtt_free_fn_ptr free;
-  void *alloc_data;
-} allocator = { 0, default_alloc, default_free, 0 };
+/**
+ * Header placed in front of every block handed out by webvtt_alloc(). The
+ * padding keeps the returned pointer aligned as strictly as malloc() would.
+ * 'size' is the number of bytes requested, excluding the header, and 'kind'
+ * the webvtt_alloc_kind it is accounted under. Blocks carved from a slab
+ * record their distance to it, in units of 16 bytes, in 'slab'.
+ */
+typedef union
+webvtt_alloc_header_t {
+  struct {
+    webvtt_alloc_context *context;
+    webvtt_uint32 size;
+    webvtt_uint16 kind;
+    webvtt_uint16 slab;
+  } info;
+  webvtt_uint64 align[2];
+} webvtt_alloc_header;
+
+struct
+webvtt_arena_chunk_t {
+  webvtt_arena_chunk *next;
+  webvtt_uint size;
+  webvtt_uint used;
+  webvtt_uint64 align; /* keep 'data' 16-byte aligned */
+};
+
+/**
+ * A slab of small, fixed-size records. 'live' counts the records still in use,
+ * plus one while the slab is its context's current one; the slab is returned
+ * to the context's allocator when it drops to zero.
+ */
+struct
+webvtt_slab_t {
+  struct webvtt_refcount_t live;
+  webvtt_uint used;
+  webvtt_uint64 align; /* keep records 16-byte aligned */
+};
+
+#define ARENA_ALIGN(n) ( ( (n) + 15 ) & ~15u )
+#define HEADER(ptr) ( ( webvtt_alloc_header * )(ptr) - 1 )
+
+/**
+ * The kind recorded in the header of a block of kind 'kind' allocated from
+ * 'ctx'. Blocks of contexts which keep no statistics are untracked, so that
+ * freeing them costs nothing either.
+ */
+#define TRACKED_KIND(ctx,kind) \
+  ( (ctx)->count_stats ? (kind) : WEBVTT_ALLOC_UNTRACKED )
+
+/**
+ * The allocator used for anything that is not allocated on behalf of a
+ * parser. Parsers each have a context of their own, so this is only touched
+ * by applications allocating objects themselves.
+ *
+ * 'refs' is the number of allocated objects. Forbid changing the allocator
+ * if this is not equal to 0
+ */
+static webvtt_alloc_context allocator = {
+  default_alloc, default_free, 0, WEBVTT_REF_INIT(0), 0, 0, 0, 0, 0,
+  { { 0, 0, 0, 0 }, { { 0, 0, 0, 0 } } }
+};
+
+/**
+ * The context webvtt_alloc() draws from on this thread. NULL means the global
+ * 'allocator'.
+ */
+static WEBVTT_THREAD_LOCAL webvtt_alloc_context *current = 0;
+
+/**
+ * Whether webvtt_slab_alloc0() may carve records out of the current context's
+ * slab on this thread. See webvtt_allow_slabs().
+ */
+static WEBVTT_THREAD_LOCAL webvtt_bool slabs_allowed = 1;
 
 static void *WEBVTT_CALLBACK
 default_alloc( void *unused, webvtt_uint nb )
@@ -67,7 +138,7 @@ webvtt_set_allocator( webvtt_alloc_fn_ptr alloc, webvtt_free_fn_ptr free,
    * functions...
    * that could be a problem.
    */
-  if( allocator.n_alloc == 0 ) {
+  if( webvtt_ref_count( &allocator.refs ) == 0 ) {
     if( alloc && free ) {
       allocator.alloc = alloc;
       allocator.free = free;
@@ -80,34 +151,665 @@ webvtt_set_allocator( webvtt_alloc_fn_ptr alloc, webvtt_free_fn_ptr free,
   }
 }
 
+/**
+ * Statistics are kept with relaxed atomic operations, since a cue may be
+ * released on another thread while its parser is still allocating. As with
+ * reference counts, WEBVTT_NO_ATOMIC_REFCOUNT selects plain arithmetic.
+ */
+#if !defined(WEBVTT_NO_ATOMIC_REFCOUNT) && WEBVTT_CC_GCC \
+    && defined(__ATOMIC_RELAXED)
+# define STAT_ADD(x,n) ( __atomic_add_fetch( &(x), (n), __ATOMIC_RELAXED ) )
+# define STAT_SUB(x,n) ( __atomic_sub_fetch( &(x), (n), __ATOMIC_RELAXED ) )
+# define STAT_LOAD(x) ( __atomic_load_n( &(x), __ATOMIC_RELAXED ) )
+# define STAT_CAS(x,old,nv) ( __atomic_compare_exchange_n( &(x), &(old), \
+                              (nv), 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+#elif !defined(WEBVTT_NO_ATOMIC_REFCOUNT) && WEBVTT_CC_MSVC
+# include <intrin.h>
+# define STAT_ADD(x,n) ( ( webvtt_uint64 )_InterlockedExchangeAdd64( \
+                         ( __int64 volatile * )&(x), ( __int64 )(n) ) + (n) )
+# define STAT_SUB(x,n) ( ( webvtt_uint64 )_InterlockedExchangeAdd64( \
+                         ( __int64 volatile * )&(x), -( __int64 )(n) ) - (n) )
+# define STAT_LOAD(x) ( ( webvtt_uint64 )_InterlockedCompareExchange64( \
+                        ( __int64 volatile * )&(x), 0, 0 ) )
+# define STAT_CAS(x,old,nv) ( stat_cas( &(x), &(old), (nv) ) )
+static int
+stat_cas( webvtt_uint64 *x, webvtt_uint64 *old, webvtt_uint64 nv )
+{
+  webvtt_uint64 seen = ( webvtt_uint64 )_InterlockedCompareExchange64(
+    ( __int64 volatile * )x, ( __int64 )nv, ( __int64 )*old );
+  if( seen == *old ) {
+    return 1;
+  }
+  *old = seen;
+  return 0;
+}
+#else
+# define STAT_ADD(x,n) ( (x) += (n) )
+# define STAT_SUB(x,n) ( (x) -= (n) )
+# define STAT_LOAD(x) (x)
+# define STAT_CAS(x,old,nv) ( (x) = (nv), 1 )
+#endif
+
+static void
+count( webvtt_alloc_counters *c, webvtt_uint nb, webvtt_bool alloc )
+{
+  if( alloc ) {
+    webvtt_uint64 live, peak;
+    STAT_ADD( c->allocs, 1 );
+    live = STAT_ADD( c->live_bytes, nb );
+    peak = STAT_LOAD( c->peak_bytes );
+    while( live > peak && !STAT_CAS( c->peak_bytes, peak, live ) ) {
+    }
+  } else {
+    STAT_ADD( c->frees, 1 );
+    STAT_SUB( c->live_bytes, nb );
+  }
+}
+
+/**
+ * Count every block still live in 'c', the counters of an arena, as freed in
+ * 'parent', those of the context the arena takes its chunks from.
+ */
+static void
+release_counters( const webvtt_alloc_counters *c,
+                  webvtt_alloc_counters *parent )
+{
+  STAT_ADD( parent->frees, STAT_LOAD( c->allocs ) - STAT_LOAD( c->frees ) );
+  STAT_SUB( parent->live_bytes, STAT_LOAD( c->live_bytes ) );
+}
+
+static void
+load_counters( const webvtt_alloc_counters *c, webvtt_alloc_counters *out )
+{
+  out->allocs = STAT_LOAD( c->allocs );
+  out->frees = STAT_LOAD( c->frees );
+  out->live_bytes = STAT_LOAD( c->live_bytes );
+  out->peak_bytes = STAT_LOAD( c->peak_bytes );
+}
+
+static void
+load_stats( const webvtt_alloc_stats *s, webvtt_alloc_stats *out )
+{
+  int kind;
+  load_counters( &s->total, &out->total );
+  for( kind = 0; kind < WEBVTT_ALLOC_KIND_COUNT; ++kind ) {
+    load_counters( &s->kinds[ kind ], &out->kinds[ kind ] );
+  }
+}
+
+/**
+ * Account for a block of 'nb' bytes of kind 'kind' being allocated from, or
+ * returned to, 'ctx'. Blocks of the arena are accounted for in the context it
+ * takes its chunks from, so that a parser's figures are all in one place.
+ * 'kind' is the one recorded in the block's header, see TRACKED_KIND().
+ */
+static void
+count_block( webvtt_alloc_context *ctx, webvtt_uint kind, webvtt_uint nb,
+             webvtt_bool alloc )
+{
+  if( kind >= WEBVTT_ALLOC_KIND_COUNT ) {
+    return;
+  }
+  if( ctx->arena ) {
+    count( &ctx->stats.kinds[ kind ], nb, alloc );
+    count( &ctx->stats.total, nb, alloc );
+    ctx = ctx->parent;
+  }
+  count( &ctx->stats.kinds[ kind ], nb, alloc );
+  count( &ctx->stats.total, nb, alloc );
+}
+
+static void *
+arena_alloc( webvtt_alloc_context *ctx, webvtt_uint nb, webvtt_uint kind )
+{
+  webvtt_arena_chunk *chunk = ctx->chunks;
+  webvtt_alloc_header *h;
+  webvtt_uint need = ARENA_ALIGN( sizeof( webvtt_alloc_header ) + nb );
+
+  if( need < nb ) {
+    return 0;
+  }
+
+  if( !chunk || chunk->size - chunk->used < need ) {
+    /**
+     * Large requests get a chunk of their own, which is linked in behind the
+     * current one so that we keep bumping from a chunk that very likely still
+     * has room for plenty of small objects.
+     */
+    webvtt_bool dedicated = need > WEBVTT_ARENA_CHUNK / 4;
+    webvtt_uint size = dedicated ? need + sizeof( *chunk )
+                                 : WEBVTT_ARENA_CHUNK;
+    if( size < need ) {
+      return 0;
+    }
+    if( !( chunk = ( webvtt_arena_chunk * )webvtt_alloc_from(
+             ctx->parent, size, WEBVTT_ALLOC_UNTRACKED ) ) ) {
+      return 0;
+    }
+    chunk->size = size - sizeof( *chunk );
+    chunk->used = 0;
+    if( dedicated && ctx->chunks ) {
+      chunk->next = ctx->chunks->next;
+      ctx->chunks->next = chunk;
+    } else {
+      chunk->next = ctx->chunks;
+      ctx->chunks = chunk;
+    }
+  }
+
+  h = ( webvtt_alloc_header * )( ( char * )( chunk + 1 ) + chunk->used );
+  chunk->used += need;
+  kind = TRACKED_KIND( ctx, kind );
+  h->info.context = ctx;
+  h->info.size = nb;
+  h->info.kind = ( webvtt_uint16 )kind;
+  h->info.slab = 0;
+  count_block( ctx, kind, nb, 1 );
+  return h + 1;
+}
+
+WEBVTT_INTERN webvtt_alloc_context *
+webvtt_create_alloc_context( webvtt_alloc_fn_ptr alloc,
+                             webvtt_free_fn_ptr free, void *alloc_data,
+                             webvtt_bool count_stats )
+{
+  webvtt_alloc_context *ctx;
+  if( !alloc || !free ) {
+    alloc = allocator.alloc;
+    free = allocator.free;
+    alloc_data = allocator.alloc_data;
+  }
+
+  /**
+   * The context can not come from itself, and must not come from the global
+   * allocator either, or it would keep that from being replaced.
+   */
+  if( !( ctx = ( webvtt_alloc_context * )alloc( alloc_data,
+                                                sizeof( *ctx ) ) ) ) {
+    return 0;
+  }
+  memset( ctx, 0, sizeof( *ctx ) );
+  ctx->alloc = alloc;
+  ctx->free = free;
+  ctx->alloc_data = alloc_data;
+  ctx->refs.value = 1;
+  ctx->count_stats = count_stats;
+  return ctx;
+}
+
+static void
+deref_context( webvtt_alloc_context *ctx )
+{
+  if( webvtt_deref( &ctx->refs ) == 0 && ctx != &allocator ) {
+    ctx->free( ctx->alloc_data, ctx );
+  }
+}
+
+static void
+release_slab( webvtt_alloc_context *ctx, webvtt_slab *slab )
+{
+  if( webvtt_deref( &slab->live ) == 0 ) {
+    ctx->free( ctx->alloc_data, slab );
+  }
+}
+
+WEBVTT_INTERN void
+webvtt_release_alloc_context( webvtt_alloc_context *ctx )
+{
+  if( ctx ) {
+    if( ctx->slab ) {
+      webvtt_slab *slab = ctx->slab;
+      ctx->slab = 0;
+      release_slab( ctx, slab );
+    }
+    deref_context( ctx );
+  }
+}
+
+WEBVTT_INTERN void *
+webvtt_alloc_from( webvtt_alloc_context *ctx, webvtt_uint nb,
+                   webvtt_uint kind )
+{
+  webvtt_alloc_header *h;
+
+  if( ctx->arena ) {
+    return arena_alloc( ctx, nb, kind );
+  }
+
+  if( nb + sizeof( *h ) < nb ) {
+    return 0;
+  }
+
+  h = ( webvtt_alloc_header * )ctx->alloc( ctx->alloc_data,
+                                           nb + sizeof( *h ) );
+  if( !h ) {
+    return 0;
+  }
+  kind = TRACKED_KIND( ctx, kind );
+  h->info.context = ctx;
+  h->info.size = nb;
+  h->info.kind = ( webvtt_uint16 )kind;
+  h->info.slab = 0;
+  webvtt_ref( &ctx->refs );
+  count_block( ctx, kind, nb, 1 );
+  return h + 1;
+}
+
+WEBVTT_INTERN void
+webvtt_init_arena( webvtt_alloc_context *ctx, webvtt_alloc_context *parent )
+{
+  memset( ctx, 0, sizeof( *ctx ) );
+  ctx->arena = 1;
+  ctx->parent = parent;
+  ctx->count_stats = parent->count_stats;
+}
+
+WEBVTT_INTERN void
+webvtt_release_arena( webvtt_alloc_context *ctx )
+{
+  webvtt_arena_chunk *chunk = ctx->chunks;
+  webvtt_alloc_stats *parent = &ctx->parent->stats;
+  int kind;
+
+  /* Everything still in the arena is freed now */
+  if( ctx->count_stats ) {
+    for( kind = 0; kind < WEBVTT_ALLOC_KIND_COUNT; ++kind ) {
+      release_counters( &ctx->stats.kinds[ kind ], &parent->kinds[ kind ] );
+    }
+    release_counters( &ctx->stats.total, &parent->total );
+    memset( &ctx->stats, 0, sizeof( ctx->stats ) );
+  }
+
+  while( chunk ) {
+    webvtt_arena_chunk *next = chunk->next;
+    webvtt_free( chunk );
+    chunk = next;
+  }
+  ctx->chunks = 0;
+}
+
+WEBVTT_INTERN webvtt_alloc_context *
+webvtt_swap_alloc_context( webvtt_alloc_context *ctx )
+{
+  webvtt_alloc_context *prev = current;
+  if( ctx ) {
+    current = ctx == &allocator ? 0 : ctx;
+  }
+  return prev ? prev : &allocator;
+}
+
+WEBVTT_INTERN webvtt_bool
+webvtt_is_arena_allocated( const void *ptr )
+{
+  return ptr && HEADER( ptr )->info.context->arena;
+}
+
+WEBVTT_INTERN webvtt_alloc_context *
+webvtt_alloc_context_of( const void *ptr )
+{
+  return HEADER( ptr )->info.context;
+}
+
+WEBVTT_INTERN webvtt_bool
+webvtt_allow_slabs( webvtt_bool allow )
+{
+  webvtt_bool prev = slabs_allowed;
+  slabs_allowed = allow;
+  return prev;
+}
+
 /**
  * public alloc/dealloc functions
  */
 WEBVTT_EXPORT void *
 webvtt_alloc( webvtt_uint nb )
 {
-  void *ret = allocator.alloc( allocator.alloc_data, nb );
-  if( ret )
-  { ++allocator.n_alloc; }
-  return ret;
+  return webvtt_alloc_from( current ? current : &allocator, nb,
+                            WEBVTT_ALLOC_OTHER );
 }
 
 WEBVTT_EXPORT void *
 webvtt_alloc0( webvtt_uint nb )
 {
-  void *ret = allocator.alloc( allocator.alloc_data, nb );
+  return webvtt_alloc0_kind( nb, WEBVTT_ALLOC_OTHER );
+}
+
+WEBVTT_INTERN void *
+webvtt_alloc0_kind( webvtt_uint nb, webvtt_uint kind )
+{
+  void *ret = webvtt_alloc_from( current ? current : &allocator, nb, kind );
   if( ret ) {
-    ++allocator.n_alloc;
     memset( ret, 0, nb );
   }
   return ret;
 }
 
+WEBVTT_INTERN void *
+webvtt_slab_alloc0( webvtt_uint nb, webvtt_uint kind )
+{
+  webvtt_alloc_context *ctx = current ? current : &allocator;
+  webvtt_slab *slab = ctx->slab;
+  webvtt_alloc_header *h;
+  webvtt_uint need = ARENA_ALIGN( sizeof( *h ) + nb );
+
+  if( ctx->arena || !slabs_allowed || need > WEBVTT_SLAB_RECORD_MAX ) {
+    return webvtt_alloc0_kind( nb, kind );
+  }
+
+  if( !slab || WEBVTT_SLAB_SIZE - slab->used < need ) {
+    webvtt_slab *next = ( webvtt_slab * )ctx->alloc( ctx->alloc_data,
+                                                     sizeof( *next ) +
+                                                     WEBVTT_SLAB_SIZE );
+    if( !next ) {
+      return 0;
+    }
+    next->live.value = 1;
+    next->used = 0;
+    ctx->slab = next;
+    if( slab ) {
+      release_slab( ctx, slab );
+    }
+    slab = next;
+  }
+
+  h = ( webvtt_alloc_header * )( ( char * )( slab + 1 ) + slab->used );
+  slab->used += need;
+  kind = TRACKED_KIND( ctx, kind );
+  h->info.context = ctx;
+  h->info.size = nb;
+  h->info.kind = ( webvtt_uint16 )kind;
+  h->info.slab = ( webvtt_uint16 )( ( ( char * )h - ( char * )slab ) / 16 );
+  webvtt_ref( &slab->live );
+  webvtt_ref( &ctx->refs );
+  count_block( ctx, kind, nb, 1 );
+  memset( h + 1, 0, nb );
+  return h + 1;
+}
+
+WEBVTT_EXPORT void
+webvtt_collect_alloc_stats( webvtt_bool collect )
+{
+  allocator.count_stats = collect;
+}
+
+WEBVTT_EXPORT void
+webvtt_get_alloc_stats( webvtt_alloc_stats *stats )
+{
+  if( stats ) {
+    load_stats( &allocator.stats, stats );
+  }
+}
+
+WEBVTT_INTERN void
+webvtt_get_context_stats( const webvtt_alloc_context *ctx,
+                          webvtt_alloc_stats *stats )
+{
+  load_stats( &ctx->stats, stats );
+}
+
 WEBVTT_EXPORT void
 webvtt_free( void *data )
 {
-  if( data && allocator.n_alloc ) {
-    allocator.free( allocator.alloc_data, data );
-    --allocator.n_alloc;
+  webvtt_alloc_context *ctx;
+  webvtt_alloc_header *h;
+  if( !data ) {
+    return;
+  }
+  h = HEADER( data );
+  ctx = h->info.context;
+  if( ctx->arena ) {
+    /* Reclaimed by webvtt_release_arena() */
+    return;
   }
+  /* A live block holds a reference, so 'ctx' can not have gone away */
+  count_block( ctx, h->info.kind, h->info.size, 0 );
+  if( h->info.slab ) {
+    release_slab( ctx, ( webvtt_slab * )( ( char * )h -
+                                          h->info.slab * 16 ) );
+  } else {
+    ctx->free( ctx->alloc_data, h );
+  }
+  deref_context( ctx );
 }
+
+/**
+ * String buffer pool
+ *
+ * Blocks of one of the power-of-two sizes that grow() hands out are kept on
+ * per-thread free lists when released, rather than going back to malloc().
+ * Only blocks which come from the built-in allocator are pooled, since the
+ * application may expect memory from its own functions to be handed back
+ * promptly.
+ */
+#if WEBVTT_STRING_POOL && defined(WEBVTT_HAVE_THREAD_LOCAL)
+# define POOL_MIN_SHIFT 6
+# define POOL_CLASSES 7 /* 64 .. 4096 bytes */
+
+typedef struct webvtt_pool_block_t webvtt_pool_block;
+struct
+webvtt_pool_block_t {
+  webvtt_pool_block *next;
+};
+
+typedef struct
+webvtt_string_pool_t {
+  webvtt_pool_block *blocks[ POOL_CLASSES ];
+  webvtt_uint depth[ POOL_CLASSES ];
+  webvtt_string_pool_stats stats;
+  /* Whether the thread-exit destructor is set up for this thread's pool */
+  webvtt_bool watched;
+} webvtt_string_pool;
+
+static WEBVTT_THREAD_LOCAL webvtt_string_pool pool;
+
+/**
+ * A thread's pool is emptied when it exits, by a destructor which is set up
+ * the first time a block is cached there. Fiber-local storage on Windows and
+ * thread-specific data elsewhere are only used for that; the blocks are still
+ * reached through 'pool'.
+ */
+#if WEBVTT_OS_WIN32
+static DWORD pool_key = FLS_OUT_OF_INDEXES;
+static INIT_ONCE pool_once = INIT_ONCE_STATIC_INIT;
+
+static VOID NTAPI
+pool_exit( PVOID unused )
+{
+  (void)unused;
+  webvtt_trim_string_pool();
+  pool.watched = 0;
+}
+
+static BOOL CALLBACK
+create_pool_key( PINIT_ONCE once, PVOID param, PVOID *context )
+{
+  (void)once;
+  (void)param;
+  (void)context;
+  pool_key = FlsAlloc( &pool_exit );
+  return TRUE;
+}
+
+static void
+watch_pool( void )
+{
+  InitOnceExecuteOnce( &pool_once, &create_pool_key, 0, 0 );
+  if( pool_key != FLS_OUT_OF_INDEXES && FlsSetValue( pool_key, &pool ) ) {
+    pool.watched = 1;
+  }
+}
+#else
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static webvtt_bool have_pool_key;
+
+static void
+pool_exit( void *unused )
+{
+  (void)unused;
+  webvtt_trim_string_pool();
+  /**
+   * Other destructors may still release strings, in which case the key is
+   * set again and this runs once more.
+   */
+  pool.watched = 0;
+}
+
+static void
+create_pool_key( void )
+{
+  have_pool_key = pthread_key_create( &pool_key, &pool_exit ) == 0;
+}
+
+static void
+watch_pool( void )
+{
+  pthread_once( &pool_once, &create_pool_key );
+  if( have_pool_key && pthread_setspecific( pool_key, &pool ) == 0 ) {
+    pool.watched = 1;
+  }
+}
+#endif
+
+/**
+ * Return the size class of an allocation of 'nb' bytes, or -1 if it is not
+ * one of the pooled sizes.
+ */
+static int
+pool_class( webvtt_uint nb )
+{
+  int cls;
+  for( cls = 0; cls < POOL_CLASSES; ++cls ) {
+    if( nb == ( 1u << ( cls + POOL_MIN_SHIFT ) ) ) {
+      return cls;
+    }
+  }
+  return -1;
+}
+
+WEBVTT_INTERN void *
+webvtt_pool_alloc( webvtt_uint nb )
+{
+  webvtt_alloc_context *ctx = current ? current : &allocator;
+  webvtt_pool_block *b;
+  webvtt_alloc_header *h;
+  int cls;
+
+  if( ctx->arena || ctx->free != &default_free
+      || ( cls = pool_class( nb ) ) < 0 ) {
+    return webvtt_alloc_from( ctx, nb, WEBVTT_ALLOC_STRING );
+  }
+
+  if( !( b = pool.blocks[ cls ] ) ) {
+    ++pool.stats.misses;
+    return webvtt_alloc_from( ctx, nb, WEBVTT_ALLOC_STRING );
+  }
+
+  pool.blocks[ cls ] = b->next;
+  --pool.depth[ cls ];
+  --pool.stats.cached_blocks;
+  pool.stats.cached_bytes -= nb;
+  ++pool.stats.hits;
+
+  h = HEADER( b );
+  h->info.context = ctx;
+  h->info.kind = TRACKED_KIND( ctx, WEBVTT_ALLOC_STRING );
+  h->info.slab = 0;
+  webvtt_ref( &ctx->refs );
+  count_block( ctx, h->info.kind, nb, 1 );
+  return b;
+}
+
+WEBVTT_INTERN void
+webvtt_pool_free( void *ptr )
+{
+  webvtt_alloc_header *h;
+  webvtt_alloc_context *ctx;
+  webvtt_pool_block *b;
+  int cls;
+
+  if( !ptr ) {
+    return;
+  }
+
+  h = HEADER( ptr );
+  ctx = h->info.context;
+  if( ctx->arena || ctx->free != &default_free
+      || ( cls = pool_class( h->info.size ) ) < 0
+      || pool.depth[ cls ] >= WEBVTT_STRING_POOL_DEPTH ) {
+    webvtt_free( ptr );
+    return;
+  }
+
+  if( !pool.watched ) {
+    watch_pool();
+  }
+
+  b = ( webvtt_pool_block * )ptr;
+  b->next = pool.blocks[ cls ];
+  pool.blocks[ cls ] = b;
+  ++pool.depth[ cls ];
+  ++pool.stats.cached_blocks;
+  pool.stats.cached_bytes += h->info.size;
+
+  /* The block no longer belongs to 'ctx' while it sits in the pool */
+  count_block( ctx, h->info.kind, h->info.size, 0 );
+  h->info.context = 0;
+  deref_context( ctx );
+}
+
+WEBVTT_EXPORT void
+webvtt_get_string_pool_stats( webvtt_string_pool_stats *stats )
+{
+  if( stats ) {
+    *stats = pool.stats;
+  }
+}
+
+WEBVTT_EXPORT void
+webvtt_trim_string_pool( void )
+{
+  int cls;
+  for( cls = 0; cls < POOL_CLASSES; ++cls ) {
+    webvtt_pool_block *b = pool.blocks[ cls ];
+    while( b ) {
+      webvtt_pool_block *next = b->next;
+      default_free( 0, HEADER( b ) );
+      b = next;
+    }
+    pool.blocks[ cls ] = 0;
+    pool.depth[ cls ] = 0;
+  }
+  pool.stats.cached_blocks = 0;
+  pool.stats.cached_bytes = 0;
+}
+
+#else
+
+WEBVTT_INTERN void *
+webvtt_pool_alloc( webvtt_uint nb )
+{
+  return webvtt_alloc_from( current ? current : &allocator, nb,
+                            WEBVTT_ALLOC_STRING );
+}
+
+WEBVTT_INTERN void
+webvtt_pool_free( void *ptr )
+{
+  webvtt_free( ptr );
+}
+
+WEBVTT_EXPORT void
+webvtt_get_string_pool_stats( webvtt_string_pool_stats *stats )
+{
+  if( stats ) {
+    memset( stats, 0, sizeof( *stats ) );
+  }
+}
+
+WEBVTT_EXPORT void
+webvtt_trim_string_pool( void )
+{
+}
+
+#endif
@@ -0,0 +1,263 @@
+/**
+ * Copyright (c) 2013 Mozilla Foundation and Contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __INTERN_ALLOC_H__
+# define __INTERN_ALLOC_H__
+# include <webvtt/util.h>
+
+# if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L \
+     && !defined(__STDC_NO_THREADS__)
+#   define WEBVTT_THREAD_LOCAL _Thread_local
+#   define WEBVTT_HAVE_THREAD_LOCAL 1
+# elif WEBVTT_CC_MSVC
+#   define WEBVTT_THREAD_LOCAL __declspec(thread)
+#   define WEBVTT_HAVE_THREAD_LOCAL 1
+# elif WEBVTT_CC_GCC
+#   define WEBVTT_THREAD_LOCAL __thread
+#   define WEBVTT_HAVE_THREAD_LOCAL 1
+# else
+#   define WEBVTT_THREAD_LOCAL
+# endif
+
+/**
+ * Recycle string buffers through per-thread free lists. The pool is only
+ * available where thread-local storage is, since it takes no locks.
+ */
+# ifndef WEBVTT_STRING_POOL
+#   define WEBVTT_STRING_POOL 1
+# endif
+
+/**
+ * Number of free blocks kept per size class and thread.
+ */
+# ifndef WEBVTT_STRING_POOL_DEPTH
+#   define WEBVTT_STRING_POOL_DEPTH 32
+# endif
+
+/**
+ * Size of the blocks which the arena requests from the underlying allocator.
+ * Requests which do not fit are given a block of their own.
+ */
+# ifndef WEBVTT_ARENA_CHUNK
+#   define WEBVTT_ARENA_CHUNK 0x10000
+# endif
+
+/**
+ * Size of the slabs which small fixed-size records are carved from, and the
+ * largest record (including its header) which is taken from a slab.
+ */
+# ifndef WEBVTT_SLAB_SIZE
+#   define WEBVTT_SLAB_SIZE 0x2000
+# endif
+# define WEBVTT_SLAB_RECORD_MAX 0x100
+
+typedef struct webvtt_arena_chunk_t webvtt_arena_chunk;
+typedef struct webvtt_slab_t webvtt_slab;
+typedef struct webvtt_alloc_context_t webvtt_alloc_context;
+
+/**
+ * An allocation context.
+ *
+ * Every block returned from webvtt_alloc() is preceded by a small header which
+ * records the context it came from, so that webvtt_free() returns it to the
+ * right place no matter which context is current when it is released.
+ *
+ * 'refs' counts the blocks currently allocated from the context, plus one for
+ * its owner. A context created with webvtt_create_alloc_context() is freed
+ * once both the owner and all of its blocks are gone, so objects may safely
+ * outlive the parser they came from.
+ *
+ * If 'arena' is set, blocks are carved out of 'chunks' (which are obtained
+ * from 'parent') and webvtt_free() does nothing; the memory is reclaimed all
+ * at once by webvtt_release_arena().
+ *
+ * 'slab' is the slab webvtt_slab_alloc0() currently carves records from.
+ *
+ * 'stats' is only kept up to date while 'count_stats' is set. Blocks
+ * allocated while it is not are left out of the statistics for good, so it
+ * may change while blocks are live.
+ */
+struct
+webvtt_alloc_context_t {
+  webvtt_alloc_fn_ptr alloc;
+  webvtt_free_fn_ptr free;
+  void *alloc_data;
+  struct webvtt_refcount_t refs;
+
+  webvtt_bool arena;
+  webvtt_arena_chunk *chunks;
+  webvtt_alloc_context *parent;
+  webvtt_slab *slab;
+
+  webvtt_bool count_stats;
+  webvtt_alloc_stats stats;
+};
+
+/**
+ * Kind for blocks which are not accounted for in any statistics, such as the
+ * arena's own chunks.
+ */
+# define WEBVTT_ALLOC_UNTRACKED WEBVTT_ALLOC_KIND_COUNT
+
+/**
+ * webvtt_create_alloc_context
+ *
+ * create a context of its own for a parser, which allocates with 'alloc' and
+ * 'free', or with the functions of the global allocator if those are NULL,
+ * and keeps allocation statistics if 'count_stats' is set. Returns NULL if
+ * the context itself can not be allocated.
+ */
+WEBVTT_INTERN webvtt_alloc_context *
+webvtt_create_alloc_context( webvtt_alloc_fn_ptr alloc,
+                             webvtt_free_fn_ptr free, void *alloc_data,
+                             webvtt_bool count_stats );
+
+/**
+ * webvtt_release_alloc_context
+ *
+ * drop the owner's reference to a context created with
+ * webvtt_create_alloc_context()
+ */
+WEBVTT_INTERN void
+webvtt_release_alloc_context( webvtt_alloc_context *ctx );
+
+/**
+ * webvtt_alloc_from
+ *
+ * allocate 'nb' bytes from a specific context, rather than the current one,
+ * accounting for them under the webvtt_alloc_kind 'kind'
+ */
+WEBVTT_INTERN void *
+webvtt_alloc_from( webvtt_alloc_context *ctx, webvtt_uint nb,
+                   webvtt_uint kind );
+
+/**
+ * webvtt_alloc0_kind
+ *
+ * webvtt_alloc0(), accounting for the block under the webvtt_alloc_kind 'kind'
+ */
+WEBVTT_INTERN void *
+webvtt_alloc0_kind( webvtt_uint nb, webvtt_uint kind );
+
+/**
+ * webvtt_slab_alloc0
+ *
+ * allocate a zeroed record of 'nb' bytes, accounted for as 'kind'. Small
+ * records are carved out of slabs owned by the current context, so that
+ * objects created together share a few large blocks. Release with
+ * webvtt_free(); a slab is handed back once all of its records are.
+ */
+WEBVTT_INTERN void *
+webvtt_slab_alloc0( webvtt_uint nb, webvtt_uint kind );
+
+/**
+ * webvtt_get_context_stats
+ *
+ * copy the allocation statistics of 'ctx', including those of any arena which
+ * takes its chunks from it
+ */
+WEBVTT_INTERN void
+webvtt_get_context_stats( const webvtt_alloc_context *ctx,
+                          webvtt_alloc_stats *stats );
+
+/**
+ * webvtt_init_arena
+ *
+ * initialize 'ctx' as an empty bump allocator which takes its chunks from
+ * 'parent', and keeps statistics if 'parent' does
+ */
+WEBVTT_INTERN void
+webvtt_init_arena( webvtt_alloc_context *ctx, webvtt_alloc_context *parent );
+
+/**
+ * webvtt_release_arena
+ *
+ * free every chunk owned by the arena 'ctx'. Anything allocated from it is
+ * invalid afterwards.
+ */
+WEBVTT_INTERN void
+webvtt_release_arena( webvtt_alloc_context *ctx );
+
+/**
+ * webvtt_swap_alloc_context
+ *
+ * make 'ctx' the context used by webvtt_alloc() on the calling thread, and
+ * return the previous one so that it can be restored. Passing NULL leaves the
+ * current context alone.
+ */
+WEBVTT_INTERN webvtt_alloc_context *
+webvtt_swap_alloc_context( webvtt_alloc_context *ctx );
+
+/**
+ * webvtt_pool_alloc
+ *
+ * like webvtt_alloc(), but blocks of one of the string pool's size classes are
+ * taken from the calling thread's pool when possible. The block is accounted
+ * for as WEBVTT_ALLOC_STRING.
+ */
+WEBVTT_INTERN void *
+webvtt_pool_alloc( webvtt_uint nb );
+
+/**
+ * webvtt_pool_free
+ *
+ * release a block from webvtt_alloc() or webvtt_pool_alloc(), keeping it in
+ * the calling thread's pool if it is of a pooled size and there is room
+ */
+WEBVTT_INTERN void
+webvtt_pool_free( void *ptr );
+
+/**
+ * webvtt_is_arena_allocated
+ *
+ * return non-zero if 'ptr' (as returned by webvtt_alloc()) lives in an arena,
+ * in which case there is no point in tearing down the object it holds.
+ */
+WEBVTT_INTERN webvtt_bool
+webvtt_is_arena_allocated( const void *ptr );
+
+/**
+ * webvtt_alloc_context_of
+ *
+ * return the context 'ptr' (as returned by webvtt_alloc()) was allocated from,
+ * so that objects belonging to it can be allocated alongside it.
+ */
+WEBVTT_INTERN webvtt_alloc_context *
+webvtt_alloc_context_of( const void *ptr );
+
+/**
+ * webvtt_allow_slabs
+ *
+ * allow or forbid webvtt_slab_alloc0() to use slabs on the calling thread,
+ * returning the previous setting. Allocating on behalf of a context which may
+ * be in use on another thread, or whose owner has released it, must not touch
+ * its current slab; whole blocks are taken from it instead.
+ */
+WEBVTT_INTERN webvtt_bool
+webvtt_allow_slabs( webvtt_bool allow );
+
+#endif
@@ -28,6 +28,8 @@
 #include <string.h>
 #include "parser_internal.h"
 #include "cue_internal.h"
+#include "alloc_internal.h"
+#include "cuetext_internal.h"
 
 WEBVTT_EXPORT webvtt_status
 webvtt_create_cue( webvtt_cue **pcue )
@@ -36,7 +38,7 @@ webvtt_create_cue( webvtt_cue **pcue )
   if( !pcue ) {
     return WEBVTT_INVALID_PARAM;
   }
-  cue = (webvtt_cue *)webvtt_alloc0( sizeof(*cue) );
+  cue = (webvtt_cue *)webvtt_alloc0_kind( sizeof(*cue), WEBVTT_ALLOC_CUE );
   if( !cue ) {
     return WEBVTT_OUT_OF_MEMORY;
   }
@@ -84,6 +86,13 @@ webvtt_release_cue( webvtt_cue **pcue )
     webvtt_cue *cue = *pcue;
     *pcue = 0;
     if( webvtt_deref( &cue->refs ) == 0 ) {
+      if( webvtt_is_arena_allocated( cue ) ) {
+        /**
+         * Everything the cue refers to was allocated from the same arena,
+         * which frees it all in one go.
+         */
+        return;
+      }
       webvtt_release_string( &cue->id );
       webvtt_release_string( &cue->body );
       webvtt_release_node( &cue->node_head );
@@ -119,6 +128,30 @@ error:
   return 0;
 }
 
+WEBVTT_EXPORT webvtt_node *
+webvtt_cue_get_nodes( webvtt_cue *cue )
+{
+  webvtt_alloc_context *saved;
+  webvtt_bool slabs;
+  if( !cue || ( cue->flags & CUE_SKIP_CUETEXT ) ) {
+    return 0;
+  }
+  if( !cue->node_head ) {
+    /**
+     * The parser which made the cue may be gone, or busy on another thread,
+     * so leave its slab alone.
+     */
+    saved = webvtt_swap_alloc_context( webvtt_alloc_context_of( cue ) );
+    slabs = webvtt_allow_slabs( 0 );
+    if( WEBVTT_FAILED( webvtt_parse_cuetext( 0, cue, &cue->body, 1 ) ) ) {
+      webvtt_release_node( &cue->node_head );
+    }
+    webvtt_allow_slabs( slabs );
+    webvtt_swap_alloc_context( saved );
+  }
+  return cue->node_head;
+}
+
 WEBVTT_INTERN webvtt_bool
 cue_is_incomplete( const webvtt_cue *cue ) {
   return !cue || ( cue->flags & CUE_HEADER_MASK ) == CUE_HAVE_ID;
@@ -528,7 +561,10 @@ webvtt_cue_validate_set_settings( webvtt_parser self, webvtt_cue *cue,
     /* Get pointer to end of the word. (for chcount()) */
     end = keyword + webvtt_string_length( &word );
     /* Get the column count that needs to be skipped. */
-    ncol = webvtt_utf8_chcount( keyword, end );
+    ncol = 0;
+    if( self && !( self->skip & WEBVTT_PARSER_SKIP_ERROR_COLUMNS ) ) {
+      ncol = webvtt_utf8_chcount( keyword, end );
+    }
     if( WEBVTT_FAILED( s = webvtt_cue_set_setting_from_string( cue,
                        keyword ) ) ) {
       if( self ) {
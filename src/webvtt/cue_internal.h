@@ -42,6 +42,9 @@ enum {
   CUE_HAVE_SETTINGS = (CUE_HAVE_VERTICAL | CUE_HAVE_SIZE
     | CUE_HAVE_POSITION | CUE_HAVE_LINE | CUE_HAVE_ALIGN),
 
+  /* The parser was told not to tokenize the cue text */
+  CUE_SKIP_CUETEXT = 0x20000000,
+
   CUE_HAVE_CUEPARAMS = 0x40000000,
   CUE_HAVE_ID = 0x80000000,
   CUE_HEADER_MASK = CUE_HAVE_CUEPARAMS|CUE_HAVE_ID,
@@ -32,6 +32,7 @@
 #include "node_internal.h"
 #include "cue_internal.h"
 #include "string_internal.h"
+#include "scan_internal.h"
 
 
 /**
@@ -66,7 +67,8 @@ WEBVTT_INTERN webvtt_status
 webvtt_create_token( webvtt_cuetext_token **token, webvtt_token_type token_type )
 {
   webvtt_cuetext_token *temp_token =
-    (webvtt_cuetext_token *)webvtt_alloc0( sizeof(*temp_token) );
+    (webvtt_cuetext_token *)webvtt_alloc0_kind( sizeof(*temp_token),
+                                               WEBVTT_ALLOC_TOKEN );
 
   if( !temp_token ) {
     return WEBVTT_OUT_OF_MEMORY;
@@ -286,9 +288,14 @@ webvtt_data_state( const char **position, webvtt_token_state *token_state,
       case '\0':
         return WEBVTT_SUCCESS;
         break;
-      default:
-        CHECK_MEMORY_OP( webvtt_string_putc( result, *position[0] ) );
+      default: {
+        /* Take the whole run of ordinary text up to the next '&', '<' or NUL */
+        const char *run = webvtt_scan_cstr2( *position, '&', '<' );
+        CHECK_MEMORY_OP( webvtt_string_append( result, *position,
+                                               ( int )( run - *position ) ) );
+        *position = run - 1;
         break;
+      }
     }
   }
 
@@ -671,6 +678,8 @@ webvtt_parse_cuetext( webvtt_parser self, webvtt_cue *cue,
   webvtt_node_kind kind;
   webvtt_stringlist *lang_stack;
   webvtt_string temp;
+  webvtt_string scratch;
+  const char *origin = 0;
 
   /**
    *  TODO: Use these parameters! 'finished' isn't really important
@@ -692,7 +701,23 @@ webvtt_parse_cuetext( webvtt_parser self, webvtt_cue *cue,
     return WEBVTT_INVALID_PARAM;
   }
 
+  /**
+   * The tokenizer needs a NUL terminator, which borrowed text lacks, so it
+   * works on a temporary copy. Text tokens which turn out to be verbatim
+   * copies of the input borrow it again below.
+   */
+  webvtt_init_string( &scratch );
+  if( webvtt_string_is_borrowed( payload ) ) {
+    origin = cue_text;
+    if( WEBVTT_FAILED( status = webvtt_create_string_with_text( &scratch,
+                                  origin, webvtt_string_length( payload ) ) ) ) {
+      return status;
+    }
+    cue_text = webvtt_string_text( &scratch );
+  }
+
   if ( WEBVTT_FAILED(status = webvtt_create_head_node( &cue->node_head ) ) ) {
+    webvtt_release_string( &scratch );
     return status;
   }
 
@@ -709,6 +734,7 @@ webvtt_parse_cuetext( webvtt_parser self, webvtt_cue *cue,
    */
   while( *position != '\0' ) {
     webvtt_status status = WEBVTT_SUCCESS;
+    const char *start = position;
     webvtt_delete_token( &token );
 
     /* Step 7. */
@@ -716,6 +742,17 @@ webvtt_parse_cuetext( webvtt_parser self, webvtt_cue *cue,
                                                           &token ) ) ) {
       /* Error here. */
     } else {
+      if( origin && token->token_type == TEXT_TOKEN ) {
+        webvtt_uint32 length = ( webvtt_uint32 )( position - start );
+        if( webvtt_string_length( &token->text ) == length &&
+            memcmp( webvtt_string_text( &token->text ), start, length ) == 0 ) {
+          webvtt_release_string( &token->text );
+          webvtt_create_borrowed_string( &token->text,
+                                         origin + ( start - cue_text ),
+                                         ( int )length );
+        }
+      }
+
       /* Succeeded... Process token */
       if( token->token_type == END_TOKEN ) {
         /**
@@ -805,6 +842,7 @@ webvtt_parse_cuetext( webvtt_parser self, webvtt_cue *cue,
 
   webvtt_delete_token( &token );
   webvtt_release_stringlist( &lang_stack );
+  webvtt_release_string( &scratch );
 
   return WEBVTT_SUCCESS;
 }
@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2013 Mozilla Foundation and Contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <webvtt/parser.h>
+#include <stdio.h>
+#include <string.h>
+#if !WEBVTT_OS_WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# define HAVE_MMAP 1
+#endif
+
+/**
+ * Input which can't be mapped, such as a pipe, is read in pieces this big.
+ */
+#define READ_SIZE 0x10000
+
+/**
+ * What to do with a file: parse all of it on 'threads' threads, or, if
+ * 'range' is set, only the cues between 'from' and 'until'.
+ */
+typedef struct
+file_job_t {
+  webvtt_uint threads;
+  webvtt_bool range;
+  const webvtt_index *index;
+  webvtt_timestamp from;
+  webvtt_timestamp until;
+} file_job;
+
+static webvtt_status
+parse_text( webvtt_parser self, const char *text, webvtt_uint len,
+            const file_job *job )
+{
+  if( job->range ) {
+    return webvtt_parse_range( self, text, len, job->index, job->from,
+                               job->until );
+  }
+  return webvtt_parse_parallel( self, text, len, job->threads );
+}
+
+/**
+ * Read all of 'fh' into memory and parse it with parse_text(), for jobs which
+ * need to see the whole document at once.
+ */
+static webvtt_status
+parse_whole_stream( webvtt_parser self, FILE *fh, const file_job *job )
+{
+  webvtt_status status;
+  char *buffer = 0;
+  webvtt_uint len = 0, alloc = 0;
+  size_t n;
+
+  do {
+    if( len == alloc ) {
+      char *grown;
+      if( alloc > 0x7FFFFFFF ) {
+        webvtt_free( buffer );
+        return WEBVTT_NOT_SUPPORTED;
+      }
+      alloc = alloc ? alloc * 2 : READ_SIZE;
+      if( !( grown = ( char * )webvtt_alloc( alloc ) ) ) {
+        webvtt_free( buffer );
+        return WEBVTT_OUT_OF_MEMORY;
+      }
+      if( len ) {
+        memcpy( grown, buffer, len );
+      }
+      webvtt_free( buffer );
+      buffer = grown;
+    }
+    n = fread( buffer + len, 1, alloc - len, fh );
+    len += ( webvtt_uint )n;
+  } while( n && !ferror( fh ) );
+
+  if( ferror( fh ) ) {
+    status = WEBVTT_UNSUCCESSFUL;
+  } else {
+    status = parse_text( self, buffer, len, job );
+  }
+  webvtt_free( buffer );
+  return status;
+}
+
+static webvtt_status
+parse_stream( webvtt_parser self, FILE *fh, const file_job *job )
+{
+  webvtt_status status = WEBVTT_SUCCESS, finished;
+  char *buffer;
+  size_t n;
+
+  if( job->range ) {
+    return parse_whole_stream( self, fh, job );
+  }
+  if( !( buffer = ( char * )webvtt_alloc( READ_SIZE ) ) ) {
+    return WEBVTT_OUT_OF_MEMORY;
+  }
+
+  do {
+    n = fread( buffer, 1, READ_SIZE, fh );
+    if( n ) {
+      status = webvtt_parse_chunk( self, buffer, ( webvtt_uint )n );
+      if( status == WEBVTT_UNFINISHED ) {
+        /* The rest of the cue is in the next piece */
+        status = WEBVTT_SUCCESS;
+      }
+    }
+  } while( n == READ_SIZE && !WEBVTT_FAILED( status ) );
+
+  if( !WEBVTT_FAILED( status ) && ferror( fh ) ) {
+    status = WEBVTT_UNSUCCESSFUL;
+  }
+  webvtt_free( buffer );
+
+  finished = webvtt_finish_parsing( self );
+  return WEBVTT_FAILED( status ) ? status : finished;
+}
+
+#ifdef HAVE_MMAP
+/**
+ * Parse a regular file straight out of a read-only mapping of it, with
+ * parse_text(). returns WEBVTT_NOT_SUPPORTED, having parsed nothing, if it
+ * can't be mapped.
+ */
+static webvtt_status
+parse_mapped( webvtt_parser self, int fd, const file_job *job )
+{
+  webvtt_status status;
+  struct stat st;
+  void *map;
+
+  if( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode )
+      || ( unsigned long long )st.st_size > 0xFFFFFFFFULL ) {
+    return WEBVTT_NOT_SUPPORTED;
+  }
+  if( st.st_size == 0 ) {
+    return parse_text( self, "", 0, job );
+  }
+
+  map = mmap( 0, ( size_t )st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  if( map == MAP_FAILED ) {
+    return WEBVTT_NOT_SUPPORTED;
+  }
+# if defined(MADV_SEQUENTIAL) && defined(MADV_RANDOM)
+  /* A range only touches the pages of the cues in it */
+  madvise( map, ( size_t )st.st_size,
+           job->range ? MADV_RANDOM : MADV_SEQUENTIAL );
+# endif
+
+  status = parse_text( self, ( const char * )map, ( webvtt_uint )st.st_size,
+                       job );
+  munmap( map, ( size_t )st.st_size );
+  return status;
+}
+#endif
+
+static webvtt_status
+parse_file( webvtt_parser self, const char *path, const file_job *job )
+{
+  webvtt_status status;
+  FILE *fh;
+
+  if( !self || !path ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+
+#ifdef HAVE_MMAP
+  {
+    int fd = open( path, O_RDONLY );
+    if( fd < 0 ) {
+      return WEBVTT_UNSUCCESSFUL;
+    }
+    status = parse_mapped( self, fd, job );
+    if( status != WEBVTT_NOT_SUPPORTED ) {
+      close( fd );
+      return status;
+    }
+    fh = fdopen( fd, "rb" );
+    if( !fh ) {
+      close( fd );
+      return WEBVTT_UNSUCCESSFUL;
+    }
+  }
+#else
+  fh = fopen( path, "rb" );
+  if( !fh ) {
+    return WEBVTT_UNSUCCESSFUL;
+  }
+#endif
+
+  status = parse_stream( self, fh, job );
+  fclose( fh );
+  return status;
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_file( webvtt_parser self, const char *path )
+{
+  file_job job = { 1, 0, 0, 0, 0 };
+  return parse_file( self, path, &job );
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_file_parallel( webvtt_parser self, const char *path,
+                            webvtt_uint threads )
+{
+  file_job job = { 0, 0, 0, 0, 0 };
+  job.threads = threads;
+  return parse_file( self, path, &job );
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_file_range( webvtt_parser self, const char *path,
+                         const webvtt_index *index, webvtt_timestamp from,
+                         webvtt_timestamp until )
+{
+  file_job job = { 1, 1, 0, 0, 0 };
+  job.index = index;
+  job.from = from;
+  job.until = until;
+  return parse_file( self, path, &job );
+}
@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2013 Mozilla Foundation and Contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <webvtt/parser.h>
+#include "parser_internal.h"
+#include "scan_internal.h"
+#include <string.h>
+
+/**
+ * Timing lines are copied here to be NUL-terminated for
+ * webvtt_parse_timestamp(). Anything past this is settings, which are not
+ * looked at.
+ */
+#define TIMING_MAX 128
+
+static const char separator[] = { '-', '-', '>' };
+
+static webvtt_bool
+is_blank( char c )
+{
+  return c == ' ' || c == '\t' || c == '\f';
+}
+
+/**
+ * Read the timings of the timing line [p, end) as
+ * webvtt_collect_timings_and_settings() would. Returns 0 if the parser would
+ * skip the cue, or drop it for not ending after it starts.
+ */
+static webvtt_bool
+read_timings( const char *p, const char *end, webvtt_index_entry *entry )
+{
+  char line[ TIMING_MAX + 1 ];
+  webvtt_uint n = ( webvtt_uint )( end - p );
+  const char *q = line;
+  int len;
+
+  if( n > TIMING_MAX ) {
+    n = TIMING_MAX;
+  }
+  memcpy( line, p, n );
+  line[ n ] = '\0';
+
+  while( is_blank( *q ) ) {
+    ++q;
+  }
+  if( !webvtt_parse_timestamp( q, &len, &entry->from )
+      && BAD_TIMESTAMP( entry->from ) ) {
+    return 0;
+  }
+  for( q += len; is_blank( *q ); ++q );
+  if( strncmp( q, separator, sizeof( separator ) ) != 0 ) {
+    return 0;
+  }
+  for( q += sizeof( separator ); is_blank( *q ); ++q );
+  if( !webvtt_parse_timestamp( q, &len, &entry->until )
+      && BAD_TIMESTAMP( entry->until ) ) {
+    return 0;
+  }
+  return entry->until > entry->from;
+}
+
+/**
+ * Step over the line terminator at 'p', if there is one.
+ */
+static const char *
+next_line( const char *p, const char *end )
+{
+  if( p < end ) {
+    p += ( *p == '\r' && p + 1 < end && p[ 1 ] == '\n' ) ? 2 : 1;
+  }
+  return p;
+}
+
+static webvtt_index_entry *
+add_entry( webvtt_index *index )
+{
+  if( index->count == index->alloc ) {
+    webvtt_uint alloc = index->alloc ? index->alloc * 2 : 64;
+    webvtt_index_entry *entries =
+      ( webvtt_index_entry * )webvtt_alloc( alloc * sizeof( *entries ) );
+    if( !entries ) {
+      return 0;
+    }
+    if( index->count ) {
+      memcpy( entries, index->entries, index->count * sizeof( *entries ) );
+    }
+    webvtt_free( index->entries );
+    index->entries = entries;
+    index->alloc = alloc;
+  }
+  return &index->entries[ index->count ];
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_build_index( const void *buffer, webvtt_uint len, webvtt_index *index )
+{
+  const char *text = ( const char * )buffer;
+  const char *p = text;
+  const char *end = text + len;
+  /* Start of the first line of the current block, if it is not a cue yet */
+  const char *block = 0;
+  webvtt_index_entry *cue = 0;
+  webvtt_uint lines = 0; /* lines in the current block */
+  webvtt_uint line = 2; /* number of the line at 'p' */
+
+  if( !index ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  memset( index, 0, sizeof( *index ) );
+  index->sorted = 1;
+  if( !buffer && len ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+
+  if( len >= 3 && memcmp( p, "\xEF\xBB\xBF", 3 ) == 0 ) {
+    p += 3;
+  }
+  if( end - p < 6 || memcmp( p, "WEBVTT", 6 ) != 0
+      || ( end - p > 6 && !is_blank( p[ 6 ] ) && p[ 6 ] != '\r'
+           && p[ 6 ] != '\n' ) ) {
+    return WEBVTT_PARSE_ERROR;
+  }
+
+  /**
+   * The parser reads on after the signature line as it would after a blank
+   * line, so lines right below it may already be a cue.
+   */
+  p = next_line( webvtt_scan_eol( p, end ), end );
+
+  while( p < end ) {
+    const char *eol = webvtt_scan_eol( p, end );
+    webvtt_uint length = ( webvtt_uint )( eol - p );
+
+    if( length == 0 ) {
+      /* A blank line ends the block, and whatever cue is in it */
+      cue = 0;
+      block = 0;
+      lines = 0;
+    } else if( webvtt_find_bytes( p, length, separator,
+                                  sizeof( separator ) ) == WEBVTT_SUCCESS ) {
+      webvtt_index_entry *entry = add_entry( index );
+      if( !entry ) {
+        return WEBVTT_OUT_OF_MEMORY;
+      }
+      /* An identifier is only taken from the line just before */
+      entry->offset = ( webvtt_uint )(
+        ( lines == 1 && block ? block : p ) - text );
+      entry->length = ( webvtt_uint )( eol - text ) - entry->offset;
+      entry->line = lines == 1 && block ? line - 1 : line;
+      if( read_timings( p, eol, entry ) ) {
+        if( index->count && entry->from < entry[ -1 ].from ) {
+          index->sorted = 0;
+        }
+        if( entry->until - entry->from > index->longest ) {
+          index->longest = entry->until - entry->from;
+        }
+        cue = entry;
+        ++index->count;
+      } else {
+        /* The parser skips the rest of the block, as far as cue text goes */
+        cue = 0;
+      }
+      block = 0;
+      ++lines;
+    } else {
+      if( cue ) {
+        cue->length = ( webvtt_uint )( eol - text ) - cue->offset;
+      } else if( lines == 0 ) {
+        block = p;
+      }
+      ++lines;
+    }
+
+    p = next_line( eol, end );
+    ++line;
+  }
+
+  return WEBVTT_SUCCESS;
+}
+
+WEBVTT_EXPORT webvtt_bool
+webvtt_index_entry_overlaps( const webvtt_index_entry *entry,
+                             webvtt_timestamp from, webvtt_timestamp until )
+{
+  return entry && entry->from <= until && entry->until > from;
+}
+
+/**
+ * Return the first of the entries in [lo, hi) whose start time plus 'slack'
+ * is greater than 't', or 'hi' if there is none. The entries are sorted.
+ */
+static webvtt_uint
+bisect( const webvtt_index_entry *entries, webvtt_uint lo, webvtt_uint hi,
+        webvtt_timestamp t, webvtt_timestamp slack )
+{
+  while( lo < hi ) {
+    webvtt_uint mid = lo + ( hi - lo ) / 2;
+    if( entries[ mid ].from + slack > t ) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+WEBVTT_EXPORT webvtt_uint
+webvtt_index_find_range( const webvtt_index *index, webvtt_timestamp from,
+                         webvtt_timestamp until, webvtt_uint *first )
+{
+  webvtt_uint lo;
+  if( !index || !first ) {
+    return 0;
+  }
+  if( !index->sorted ) {
+    *first = 0;
+    return index->count;
+  }
+  /**
+   * No cue lasts longer than 'longest', so those which end after 'from' all
+   * start after 'from' - 'longest'
+   */
+  lo = bisect( index->entries, 0, index->count, from, index->longest );
+  *first = lo;
+  return bisect( index->entries, lo, index->count, until, 0 );
+}
+
+WEBVTT_EXPORT void
+webvtt_release_index( webvtt_index *index )
+{
+  if( index ) {
+    webvtt_free( index->entries );
+    memset( index, 0, sizeof( *index ) );
+  }
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_range( webvtt_parser self, const void *buffer, webvtt_uint len,
+                    const webvtt_index *index, webvtt_timestamp from,
+                    webvtt_timestamp until )
+{
+  static const char blank[] = "\n\n";
+  const char *text = ( const char * )buffer;
+  webvtt_index own;
+  webvtt_status status;
+  webvtt_uint i, end;
+
+  if( !self || ( !buffer && len ) ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  if( !index ) {
+    if( WEBVTT_FAILED( status = webvtt_build_index( buffer, len, &own ) ) ) {
+      webvtt_release_index( &own );
+      if( status == WEBVTT_PARSE_ERROR ) {
+        /* Have the parser report the bad header; it reads no further */
+        return webvtt_parse_buffer( self, buffer, len );
+      }
+      return status;
+    }
+    index = &own;
+  }
+
+  /**
+   * Each cue is a block of its own, so it is parsed as the body of a
+   * document, and followed by an empty line to end it.
+   */
+  webvtt_begin_segment( self, 1 );
+  status = WEBVTT_SUCCESS;
+  end = webvtt_index_find_range( index, from, until, &i );
+  for( ; i < end; ++i ) {
+    const webvtt_index_entry *entry = &index->entries[ i ];
+    if( !webvtt_index_entry_overlaps( entry, from, until ) ) {
+      continue;
+    }
+    if( entry->offset > len || entry->length > len - entry->offset ) {
+      status = WEBVTT_INVALID_PARAM;
+      break;
+    }
+    self->line = entry->line;
+    status = webvtt_parse_chunk( self, text + entry->offset, entry->length );
+    if( !WEBVTT_FAILED( status ) || status == WEBVTT_UNFINISHED ) {
+      status = webvtt_parse_chunk( self, blank, sizeof( blank ) - 1 );
+    }
+    if( WEBVTT_FAILED( status ) && status != WEBVTT_UNFINISHED ) {
+      break;
+    }
+  }
+  status = webvtt_end_segment( self, status );
+
+  if( index == &own ) {
+    webvtt_release_index( &own );
+  }
+  return status;
+}
@@ -26,143 +26,141 @@
  */
 
 #include "parser_internal.h"
+#include <string.h>
 
 /**
- * There are probably enough jumps and stack pops here to fill up quite a few
- * caches but it may still
- * be much smaller than a gigantic table-based solution.
- *
- * TODO: Replace all char literals with hex values, just in case compiling on a
- * machine which uses an
- * incompatible character set
+ * The lexer is a DFA driven by two tables: every byte is mapped to one of a
+ * few classes, and each state gives, for each class, either the next state or
+ * an action which ends the token. Bytes are only looked at, not copied; the
+ * token text is copied into 'self->token' once, when the token ends or the
+ * buffer runs out.
  */
 
-#define U_DIGIT case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: \
-                case 0x35: case 0x36: case 0x37: case 0x38: case 0x39:
-#define U_WHITESPACE case 0x0D: case 0x0A: case 0x20: case 0x09:
-#define U_SPACE case 0x20:
-#define U_TAB case 0x09:
-#define U_CR case 0x0D:
-#define U_LF case 0x0A:
-
-#define U_DASH case 0x2D:
-#define U_PERIOD case 0x2E:
-#define U_GT case 0x3E:
-#define U_COLON case 0x3A:
-#define U_PERCENT case 0x25:
-
-#define U_0 case 0x30:
-#define U_1 case 0x31:
-#define U_2 case 0x32:
-#define U_3 case 0x33:
-#define U_4 case 0x34:
-#define U_5 case 0x35:
-#define U_6 case 0x36:
-#define U_7 case 0x37:
-#define U_8 case 0x38:
-#define U_9 case 0x39:
-
-#define U_a case 0x61:
-#define U_b case 0x62:
-#define U_c case 0x63:
-#define U_d case 0x64:
-#define U_e case 0x65:
-#define U_f case 0x66:
-#define U_g case 0x67:
-#define U_h case 0x68:
-#define U_i case 0x69:
-#define U_j case 0x6A:
-#define U_k case 0x6B:
-#define U_l case 0x6C:
-#define U_m case 0x6D:
-#define U_n case 0x6E:
-#define U_o case 0x6F:
-#define U_p case 0x70:
-#define U_q case 0x71:
-#define U_r case 0x72:
-#define U_s case 0x73:
-#define U_t case 0x74:
-#define U_u case 0x75:
-#define U_v case 0x76:
-#define U_w case 0x77:
-#define U_x case 0x78:
-#define U_y case 0x79:
-#define U_z case 0x7A:
-
-#define U_A case 0x41:
-#define U_B case 0x42:
-#define U_C case 0x43:
-#define U_D case 0x44:
-#define U_E case 0x45:
-#define U_F case 0x46:
-#define U_G case 0x47:
-#define U_H case 0x48:
-#define U_I case 0x49:
-#define U_J case 0x4A:
-#define U_K case 0x4B:
-#define U_L case 0x4C:
-#define U_M case 0x4D:
-#define U_N case 0x4E:
-#define U_O case 0x4F:
-#define U_P case 0x50:
-#define U_Q case 0x51:
-#define U_R case 0x52:
-#define U_S case 0x53:
-#define U_T case 0x54:
-#define U_U case 0x55:
-#define U_V case 0x56:
-#define U_W case 0x57:
-#define U_X case 0x58:
-#define U_Y case 0x59:
-#define U_Z case 0x5A:
-
-#define U_BOM0 case 0xEF:
-#define U_BOM1 case 0xBB:
-#define U_BOM2 case 0xBF:
-
-#define DEFAULT default:
-
 /**
- * Just for semantic clarity
+ * Byte classes
  */
-#define OR
-#define AND
-
-#define IF_OVERFLOW(X) \
-  if( self->token_pos >= (sizeof(self->token) - 1 ) ) \
-  { \
-    RETURN(X) \
-  }
+enum {
+  C_OTHER = 0, C_W, C_E, C_B, C_V, C_T, C_BOM0, C_BOM1, C_BOM2, C_LF, C_CR,
+  C_BLANK, C_COUNT
+};
+
+#define __ C_OTHER
+#define W_ C_W
+#define E_ C_E
+#define B_ C_B
+#define V_ C_V
+#define T_ C_T
+#define B0 C_BOM0
+#define B1 C_BOM1
+#define B2 C_BOM2
+#define LF C_LF
+#define CR C_CR
+#define SP C_BLANK
+
+static const unsigned char byte_class[ 0x100 ] = {
+  __, __, __, __, __, __, __, __, __, SP, LF, __, __, CR, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  SP, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, B_, __, __, E_, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, T_, __, V_, W_, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, B1, __, __, __, B2,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, B0,
+  __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __
+};
+
+#undef __
+#undef W_
+#undef E_
+#undef B_
+#undef V_
+#undef T_
+#undef B0
+#undef B1
+#undef B2
+#undef LF
+#undef CR
+#undef SP
 
-#define BEGIN_STATE(state) case state: { switch(c) {
-#define END_STATE DEFAULT BACKUP return BADTOKEN; } } break;
-#define END_STATE_EX } } break;
-#define SET_STATE(X) self->tstate = X; break;
-#define RETURN(X) self->tstate = L_START; return X;
-#define SET_NEWLINE self->line++; self->column = 1; RETURN(NEWLINE)
-#define CONTINUE continue;
-#define BREAK break;
-
-#define BACKUP (*pos)--; \
-               --self->column; \
-               self->token[--self->token_pos] = 0; \
-               self->tstate = L_START;
-#define RESET self->column = 1; \
-              self->bytes = self->token_pos = 0; \
-              self->tstate = L_START;
-
-#define CHECK_BROKEN_TIMESTAMP \
-if(self->token_pos == sizeof(self->token) - 1 ) \
-{ \
-  ERROR(WEBVTT_MALFORMED_TIMESTAMP); \
-  return BADTOKEN; \
-}
+/**
+ * Actions. Entries below A_FIRST are the state to move to after taking the
+ * byte. "Take" actions include the byte in the token, "leave" actions end the
+ * token before it.
+ */
+enum {
+  A_FIRST = 0x10,
+  A_BAD = A_FIRST,  /* leave; BADTOKEN */
+  A_WEBVTT,         /* take; WEBVTT */
+  A_BOM,            /* take; BOM, or skip it at the start of the file */
+  A_NEWLINE,        /* take; NEWLINE */
+  A_CR,             /* leave; NEWLINE for the CR before it */
+  A_WHITESPACE      /* leave; WHITESPACE */
+};
+
+#define L_COUNT ( L_WHITESPACE + 1 )
+
+#define xx A_BAD
+#define TV A_WEBVTT
+#define TB A_BOM
+#define TN A_NEWLINE
+#define CR A_CR
+#define WS A_WHITESPACE
+#define W0 L_WEBVTT0
+#define W1 L_WEBVTT1
+#define W2 L_WEBVTT2
+#define W3 L_WEBVTT3
+#define W4 L_WEBVTT4
+#define N0 L_NEWLINE0
+#define S_ L_WHITESPACE
+
+static const unsigned char transitions[ L_COUNT ][ C_COUNT ] = {
+  /*                other W   E   B   V   T   EF  BB  BF  LF  CR  SP/TAB */
+  /* L_START */      { xx, W0, xx, xx, xx, xx, L_BOM0, xx, xx, TN, N0, S_ },
+  /* L_BOM0 */       { xx, xx, xx, xx, xx, xx, xx, L_BOM1, xx, xx, xx, xx },
+  /* L_BOM1 */       { xx, xx, xx, xx, xx, xx, xx, xx, TB, xx, xx, xx },
+  /* L_WEBVTT0 */    { xx, xx, W1, xx, xx, xx, xx, xx, xx, xx, xx, xx },
+  /* L_WEBVTT1 */    { xx, xx, xx, W2, xx, xx, xx, xx, xx, xx, xx, xx },
+  /* L_WEBVTT2 */    { xx, xx, xx, xx, W3, xx, xx, xx, xx, xx, xx, xx },
+  /* L_WEBVTT3 */    { xx, xx, xx, xx, xx, W4, xx, xx, xx, xx, xx, xx },
+  /* L_WEBVTT4 */    { xx, xx, xx, xx, xx, TV, xx, xx, xx, xx, xx, xx },
+  /* L_NEWLINE0 */   { CR, CR, CR, CR, CR, CR, CR, CR, CR, TN, CR, CR },
+  /* L_WHITESPACE */ { WS, WS, WS, WS, WS, WS, WS, WS, WS, WS, WS, S_ }
+};
+
+#undef xx
+#undef TV
+#undef TB
+#undef TN
+#undef CR
+#undef WS
+#undef W0
+#undef W1
+#undef W2
+#undef W3
+#undef W4
+#undef N0
+#undef S_
 
+/**
+ * webvtt_lex_word
+ *
+ * Collect the bytes up to the next blank or line ending, which are left for
+ * the lexer, and append them to 'str' in one go. Other tokens, such as "-->",
+ * are part of the word.
+ */
 WEBVTT_INTERN webvtt_status
 webvtt_lex_word( webvtt_parser self, webvtt_string *str, const char *buffer,
-                 webvtt_uint *ppos, webvtt_uint length, webvtt_bool finish )
+                 webvtt_uint *ppos, webvtt_uint length )
 {
-  webvtt_status status = WEBVTT_SUCCESS;
+  const unsigned char *b = ( const unsigned char * )buffer;
+  webvtt_status status;
   webvtt_uint pos = *ppos;
   if( !str ) {
     return WEBVTT_INVALID_PARAM;
@@ -170,34 +168,21 @@ webvtt_lex_word( webvtt_parser self, webvtt_string *str, const char *buffer,
 
   webvtt_init_string( str );
 
-# define ASCII_DASH (0x2D)
-# define ASCII_GT (0x3E)
-  while( pos < length ) {
-    webvtt_uint last_bytes = self->bytes;
-    webvtt_uint last_line = self->line;
-    webvtt_uint last_column = self->column;
-    webvtt_uint last_pos = pos;
-
-    webvtt_token token = webvtt_lex(self, buffer, &pos, length, finish );
+  while( pos < length && byte_class[ b[ pos ] ] != C_BLANK
+         && byte_class[ b[ pos ] ] != C_LF && byte_class[ b[ pos ] ] != C_CR ) {
+    ++pos;
+  }
 
-    if( token == BADTOKEN ) {
-      if( WEBVTT_FAILED( status = webvtt_string_putc( str, buffer[pos] ) ) ) {
-        webvtt_release_string( str );
-        goto _finished;
-      }
-      ++pos;
-    } else {
-      pos = last_pos;
-      self->bytes = last_bytes;
-      self->line = last_line;
-      self->column = last_column;
-      goto _finished;
-    }
+  if( WEBVTT_FAILED( status = webvtt_string_append( str, buffer + *ppos,
+                                                    ( int )( pos - *ppos ) ) ) ) {
+    webvtt_release_string( str );
+    return status;
   }
 
-_finished:
+  self->column += pos - *ppos;
+  self->bytes += pos - *ppos;
   *ppos = pos;
-  return status;
+  return WEBVTT_SUCCESS;
 }
 
 /**
@@ -277,99 +262,115 @@ backup:
   return BADTOKEN;
 }
 
+/**
+ * Copy the bytes of the token in [start, end) to 'self->token', and account
+ * for them in the position counters. 'seen' is how many more bytes were
+ * looked at, which 'bytes' has always counted.
+ */
+static void
+end_run( webvtt_parser self, const char *buffer, webvtt_uint start,
+         webvtt_uint end, webvtt_uint seen )
+{
+  webvtt_uint n = end - start;
+  if( n ) {
+    memcpy( self->token + self->token_pos, buffer + start, n );
+    self->token_pos += n;
+  }
+  self->token[ self->token_pos ] = 0;
+  self->column += n;
+  self->bytes += n + seen;
+}
+
 WEBVTT_INTERN webvtt_token
 webvtt_lex( webvtt_parser self, const char *buffer, webvtt_uint *pos,
             webvtt_uint length, webvtt_bool finish )
 {
-  while( *pos < length ) {
-    unsigned char c = (unsigned char)buffer[(*pos)++];
-    self->token[ self->token_pos++ ] = c;
-    self->token[ self->token_pos ] = 0;
-    self->column++;
-    self->bytes++;
-    switch( self->tstate ) {
-        BEGIN_STATE(L_START)
-          U_W  { SET_STATE(L_WEBVTT0) }
-          U_BOM0 { SET_STATE(L_BOM0) }
-          U_LF { SET_NEWLINE }
-          U_CR { SET_STATE(L_NEWLINE0) }
-          U_SPACE OR U_TAB { SET_STATE(L_WHITESPACE) }
-        END_STATE
-
-        BEGIN_STATE(L_BOM0)
-          U_BOM1 { SET_STATE(L_BOM1) }
-        END_STATE
-
-        BEGIN_STATE(L_BOM1)
-          U_BOM2 {
-          if( self->bytes == 3 ) {
-            RESET
-            BREAK
-          }
-          RETURN(BOM)
-        }
-        END_STATE
-
-        BEGIN_STATE(L_WEBVTT0)
-          U_E { SET_STATE(L_WEBVTT1) }
-        END_STATE
-
-        BEGIN_STATE(L_WEBVTT1)
-          U_B { SET_STATE(L_WEBVTT2) }
-        END_STATE
+  const unsigned char *b = ( const unsigned char * )buffer;
+  webvtt_uint start = *pos, p = *pos;
+  webvtt_uint state = self->tstate;
 
-        BEGIN_STATE(L_WEBVTT2)
-          U_V { SET_STATE(L_WEBVTT3) }
-        END_STATE
-
-        BEGIN_STATE(L_WEBVTT3)
-          U_T { SET_STATE(L_WEBVTT4) }
-        END_STATE
-
-        BEGIN_STATE(L_WEBVTT4)
-          U_T { RETURN(WEBVTT) }
-        END_STATE
+  while( p < length ) {
+    webvtt_uint action = transitions[ state ][ byte_class[ b[ p ] ] ];
+    if( action < A_FIRST ) {
+      ++p;
+      if( ( state = action ) == L_WHITESPACE ) {
+        /* Take the whole run, up to the longest token there is room for */
+        webvtt_uint limit = start + ( sizeof( self->token ) - 1 )
+                            - self->token_pos;
+        while( p < length && p < limit && byte_class[ b[ p ] ] == C_BLANK ) {
+          ++p;
+        }
+        if( p == limit ) {
+          end_run( self, buffer, start, p, 0 );
+          *pos = p;
+          self->tstate = L_START;
+          return WHITESPACE;
+        }
+      }
+      continue;
+    }
 
-        BEGIN_STATE(L_NEWLINE0)
-          U_LF { SET_NEWLINE }
-        DEFAULT { BACKUP AND SET_NEWLINE }
-        END_STATE_EX
+    self->tstate = L_START;
+    switch( action ) {
+      case A_WEBVTT:
+        end_run( self, buffer, start, p + 1, 0 );
+        *pos = p + 1;
+        return WEBVTT;
+
+      case A_BOM:
+        if( self->bytes + ( p + 1 - start ) == 3 ) {
+          /* A byte order mark at the start of the file is skipped */
+          self->column = 1;
+          self->bytes = self->token_pos = 0;
+          state = L_START;
+          start = ++p;
+          continue;
+        }
+        end_run( self, buffer, start, p + 1, 0 );
+        *pos = p + 1;
+        return BOM;
+
+      case A_NEWLINE:
+        end_run( self, buffer, start, p + 1, 0 );
+        *pos = p + 1;
+        self->line++;
+        self->column = 1;
+        return NEWLINE;
+
+      case A_CR:
+        end_run( self, buffer, start, p, 1 );
+        *pos = p;
+        self->line++;
+        self->column = 1;
+        return NEWLINE;
+
+      case A_WHITESPACE:
+        end_run( self, buffer, start, p, 1 );
+        *pos = p;
+        return WHITESPACE;
 
-        BEGIN_STATE(L_WHITESPACE)
-          U_SPACE OR U_TAB { IF_OVERFLOW(WHITESPACE) SET_STATE(L_WHITESPACE) }
-        DEFAULT { BACKUP RETURN(WHITESPACE) }
-        END_STATE_EX
+      default:
+        end_run( self, buffer, start, p, 1 );
+        *pos = p;
+        return BADTOKEN;
     }
   }
 
   /**
-   * If we got here, we've reached the end of the buffer.
-   * We therefore can attempt to finish up
+   * If we got here, we've reached the end of the buffer. Keep what there is of
+   * the token for the next one, or finish up.
    */
+  end_run( self, buffer, start, p, 0 );
+  *pos = p;
+  self->tstate = ( webvtt_lexer_state )state;
   if( finish && self->token_pos ) {
-    switch( self->tstate ) {
-      case L_WHITESPACE:
-        RETURN(WHITESPACE)
-      default:
-        RESET
-        return BADTOKEN;
+    self->tstate = L_START;
+    if( state == L_WHITESPACE ) {
+      return WHITESPACE;
     }
+    self->column = 1;
+    self->bytes = self->token_pos = 0;
+    return BADTOKEN;
   }
-  return *pos == length || self->token_pos ? UNFINISHED : BADTOKEN;
+  return UNFINISHED;
 }
-/**
- * token states
-L_START    + 'W' = L_WEBVTT0
-L_START    + CR  = L_NEWLINE0
-L_START    + LF  = *NEWLINE
-L_START    + SP  = L_WHITESPACE
-L_START    + TB  = L_WHITESPACE
-L_WEBVTT0    + 'E' = L_WEBVTT1
-L_WEBVTT1    + 'B' = L_WEBVTT2
-L_WEBVTT2    + 'V' = L_WEBVTT3
-L_WEBVTT3    + 'T' = L_WEBVTT4
-L_WEBVTT4    + 'T' = *WEBVTT
-L_NEWLINE0   + LF  = *NEWLINE
-L_WHITESPACE + TB  = L_WHITESPACE
-L_WHITESPACE + SP  = L_WHITESPACE
- */
@@ -28,6 +28,7 @@
  #include <string.h>
  #include <stdlib.h>
  #include "node_internal.h"
+ #include "alloc_internal.h"
 
  static webvtt_node empty_node = {
   { 1 }, /* init ref count */
@@ -39,7 +40,8 @@
 WEBVTT_EXPORT void
 webvtt_ref_node( webvtt_node *node )
 {
-  if( node ) {
+  /* 'empty_node' is never freed, so it does not need counting. */
+  if( node && node != &empty_node ) {
     webvtt_ref( &node->refs );
   }
 }
@@ -56,21 +58,37 @@ webvtt_init_node( webvtt_node **node )
   }
 }
 
+/**
+ * Internal nodes are allocated in one record together with their
+ * webvtt_internal_node_data, which directly follows the node.
+ */
 WEBVTT_INTERN webvtt_status
 webvtt_create_node( webvtt_node **node, webvtt_node_kind kind,
                     webvtt_node *parent )
 {
   webvtt_node *temp_node;
+  webvtt_bool internal = WEBVTT_IS_VALID_INTERNAL_NODE( kind );
+  webvtt_uint size = sizeof( *temp_node );
 
   if( !node ) {
     return WEBVTT_INVALID_PARAM;
   }
 
-  if( !( temp_node = (webvtt_node *)webvtt_alloc0(sizeof(*temp_node)) ) )
+  if( internal ) {
+    size += sizeof( webvtt_internal_node_data );
+  }
+
+  if( !( temp_node = (webvtt_node *)webvtt_slab_alloc0( size,
+                                                        WEBVTT_ALLOC_NODE ) ) )
   {
     return WEBVTT_OUT_OF_MEMORY;
   }
 
+  if( internal ) {
+    temp_node->data.internal_data =
+      ( webvtt_internal_node_data * )( temp_node + 1 );
+  }
+
   webvtt_ref_node( temp_node );
   temp_node->kind = kind;
   temp_node->parent = parent;
@@ -88,24 +106,21 @@ webvtt_create_internal_node( webvtt_node **node, webvtt_node *parent,
   webvtt_status status;
   webvtt_internal_node_data *node_data;
 
-  if( WEBVTT_FAILED( status = webvtt_create_node( node, kind, parent ) ) ) {
-    return status;
+  if( !WEBVTT_IS_VALID_INTERNAL_NODE( kind ) ) {
+    return WEBVTT_INVALID_PARAM;
   }
 
-  if ( !( node_data =
-         (webvtt_internal_node_data *)webvtt_alloc0( sizeof(*node_data) ) ) )
-  {
-    return WEBVTT_OUT_OF_MEMORY;
+  if( WEBVTT_FAILED( status = webvtt_create_node( node, kind, parent ) ) ) {
+    return status;
   }
 
+  node_data = (*node)->data.internal_data;
   webvtt_copy_stringlist( &node_data->css_classes, css_classes );
   webvtt_copy_string( &node_data->annotation, annotation );
   webvtt_init_string( &node_data->lang );
-  node_data->children = NULL;
+  node_data->children = node_data->inline_children;
   node_data->length = 0;
-  node_data->alloc = 0;
-
-  (*node)->data.internal_data = node_data;
+  node_data->alloc = WEBVTT_NODE_INLINE_CHILDREN;
 
   return WEBVTT_SUCCESS;
 }
@@ -191,24 +206,35 @@ webvtt_release_node( webvtt_node **node )
     return;
   }
   n = *node;
+  *node = 0;
 
-  if( webvtt_deref( &n->refs )  == 0 ) {
+  if( n == &empty_node ) {
+    return;
+  }
+
+  if( webvtt_deref( &n->refs ) == 0 ) {
+    if( webvtt_is_arena_allocated( n ) ) {
+      /* The whole tree goes away with the arena. */
+      return;
+    }
     if( n->kind == WEBVTT_TEXT ) {
         webvtt_release_string( &n->data.text );
     } else if( WEBVTT_IS_VALID_INTERNAL_NODE( n->kind ) &&
                n->data.internal_data ) {
-      webvtt_release_stringlist( &n->data.internal_data->css_classes );
-      webvtt_release_string( &n->data.internal_data->lang );
-      webvtt_release_string( &n->data.internal_data->annotation );
-      for( i = 0; i < n->data.internal_data->length; i++ ) {
-        webvtt_release_node( n->data.internal_data->children + i );
+      webvtt_internal_node_data *nd = n->data.internal_data;
+      webvtt_release_stringlist( &nd->css_classes );
+      webvtt_release_string( &nd->lang );
+      webvtt_release_string( &nd->annotation );
+      for( i = 0; i < nd->length; i++ ) {
+        webvtt_release_node( nd->children + i );
+      }
+      if( nd->children != nd->inline_children ) {
+        webvtt_free( nd->children );
       }
-      webvtt_free( n->data.internal_data->children );
-      webvtt_free( n->data.internal_data );
     }
+    /* Frees the internal node data along with the node */
     webvtt_free( n );
   }
-  *node = 0;
 }
 
 WEBVTT_INTERN webvtt_status
@@ -222,28 +248,22 @@ webvtt_attach_node( webvtt_node *parent, webvtt_node *to_attach )
   }
   nd = parent->data.internal_data;
 
-  if( nd->alloc == 0 ) {
-    next = (webvtt_node **)webvtt_alloc0( sizeof( webvtt_node * ) * 8 );
+  if( nd->length == nd->alloc ) {
+    webvtt_uint alloc = nd->alloc < 8 ? 8 : nd->alloc * 2;
+    next = (webvtt_node **)webvtt_alloc0_kind( sizeof( *next ) * alloc,
+                                              WEBVTT_ALLOC_NODE );
 
     if( !next ) {
       return WEBVTT_OUT_OF_MEMORY;
     }
 
-    nd->children = next;
-    nd->alloc = 8;
-  }
-
-  if( nd->length + 1 >= ( nd->alloc / 3 ) * 2 ) {
-
-    next = (webvtt_node **)webvtt_alloc0( sizeof( *next ) * nd->alloc * 2 );
-
-    if( !next ) {
-      return WEBVTT_OUT_OF_MEMORY;
+    if( nd->length ) {
+      memcpy( next, nd->children, nd->length * sizeof( webvtt_node * ) );
     }
-
-    nd->alloc *= 2;
-    memcpy( next, nd->children, nd->length * sizeof( webvtt_node * ) );
-    webvtt_free( nd->children );
+    if( nd->children != nd->inline_children ) {
+      webvtt_free( nd->children );
+    }
+    nd->alloc = alloc;
     nd->children = next;
   }
 
@@ -0,0 +1,453 @@
+/**
+ * Copyright (c) 2013 Mozilla Foundation and Contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "parser_internal.h"
+#include "scan_internal.h"
+#include <string.h>
+#if WEBVTT_OS_WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+/**
+ * When the caller leaves the number of threads up to us, don't bother with
+ * segments smaller than this. Parsing 64 KiB, around a thousand cues, takes
+ * on the order of a millisecond, against tens of microseconds to start a
+ * thread, so a file of a few hundred kilobytes already goes several ways.
+ */
+#ifndef WEBVTT_PARALLEL_SEGMENT
+# define WEBVTT_PARALLEL_SEGMENT 0x10000
+#endif
+#define MAX_SEGMENTS 64
+
+/**
+ * Something a worker's parser reported: a cue, or an error if 'cue' is NULL.
+ * Lines are counted from the start of the segment.
+ */
+typedef struct
+segment_event_t {
+  webvtt_cue *cue;
+  webvtt_uint line;
+  webvtt_uint column;
+  webvtt_error error;
+} segment_event;
+
+typedef struct
+segment_t {
+  const char *text;
+  webvtt_uint length;
+  webvtt_bool body;
+  const webvtt_parser_options *options;
+
+  webvtt_uint lines; /* line terminators in 'text' */
+  webvtt_bool clean; /* see webvtt_segment_is_clean() */
+  webvtt_status status;
+  webvtt_bool out_of_memory;
+  segment_event *events;
+  webvtt_uint count;
+  webvtt_uint alloc;
+} segment;
+
+static segment_event *
+add_event( segment *seg )
+{
+  if( seg->count == seg->alloc ) {
+    webvtt_uint alloc = seg->alloc ? seg->alloc * 2 : 64;
+    segment_event *events =
+      ( segment_event * )webvtt_alloc( alloc * sizeof( segment_event ) );
+    if( !events ) {
+      seg->out_of_memory = 1;
+      return 0;
+    }
+    if( seg->count ) {
+      memcpy( events, seg->events, seg->count * sizeof( segment_event ) );
+    }
+    webvtt_free( seg->events );
+    seg->events = events;
+    seg->alloc = alloc;
+  }
+  return seg->events + seg->count++;
+}
+
+static void WEBVTT_CALLBACK
+on_cue( void *userdata, webvtt_cue *cue )
+{
+  segment_event *ev = add_event( ( segment * )userdata );
+  if( !ev ) {
+    webvtt_release_cue( &cue );
+    return;
+  }
+  ev->cue = cue;
+  ev->line = ev->column = 0;
+  ev->error = 0;
+}
+
+static int WEBVTT_CALLBACK
+on_error( void *userdata, webvtt_uint line, webvtt_uint column,
+          webvtt_error error )
+{
+  segment_event *ev = add_event( ( segment * )userdata );
+  if( ev ) {
+    ev->cue = 0;
+    ev->line = line;
+    ev->column = column;
+    ev->error = error;
+  }
+  /* Whether to go on is the application's call, once it sees the error */
+  return 0;
+}
+
+static webvtt_uint
+count_lines( const char *p, const char *end )
+{
+  webvtt_uint n = 0;
+  while( ( p = webvtt_scan_eol( p, end ) ) < end ) {
+    if( *p == '\r' && p + 1 < end && p[ 1 ] == '\n' ) {
+      ++p;
+    }
+    ++p;
+    ++n;
+  }
+  return n;
+}
+
+static void
+run_segment( segment *seg )
+{
+  webvtt_parser parser;
+  webvtt_status status;
+  seg->lines = count_lines( seg->text, seg->text + seg->length );
+  seg->status = webvtt_create_parser_with_options( &on_cue, &on_error, seg,
+                                                   seg->options, &parser );
+  if( WEBVTT_FAILED( seg->status ) ) {
+    return;
+  }
+  webvtt_begin_segment( parser, seg->body );
+  status = webvtt_parse_chunk( parser, seg->text, seg->length );
+  seg->clean = ( !WEBVTT_FAILED( status ) || status == WEBVTT_UNFINISHED )
+               && webvtt_segment_is_clean( parser, seg->lines );
+  seg->status = webvtt_end_segment( parser, status );
+  webvtt_delete_parser( parser );
+  if( seg->out_of_memory && !WEBVTT_FAILED( seg->status ) ) {
+    seg->status = WEBVTT_OUT_OF_MEMORY;
+  }
+}
+
+static void
+discard_events( segment *seg )
+{
+  webvtt_uint k;
+  for( k = 0; k < seg->count; ++k ) {
+    webvtt_release_cue( &seg->events[ k ].cue );
+  }
+  webvtt_free( seg->events );
+  seg->events = 0;
+  seg->count = seg->alloc = 0;
+}
+
+/**
+ * Parse segments from 'first' on, as one, until the parser comes to a clean
+ * break between two of them or runs out. This is for when 'first' ends in
+ * the middle of something, such as a cue id with nothing after it, so that
+ * the segment after it could not be parsed on its own. Returns the number of
+ * segments it took; the result is left in 'out'.
+ */
+static webvtt_uint
+repair_segments( segment *segments, webvtt_uint first, webvtt_uint n,
+                 segment *out )
+{
+  webvtt_parser parser;
+  webvtt_status status = WEBVTT_SUCCESS;
+  webvtt_uint i = first;
+
+  memset( out, 0, sizeof( *out ) );
+  out->options = segments[ first ].options;
+  out->status = webvtt_create_parser_with_options( &on_cue, &on_error, out,
+                                                   out->options, &parser );
+  if( WEBVTT_FAILED( out->status ) ) {
+    return n - first;
+  }
+  webvtt_begin_segment( parser, segments[ first ].body );
+  for( ;; ) {
+    status = webvtt_parse_chunk( parser, segments[ i ].text,
+                                 segments[ i ].length );
+    out->lines += segments[ i ].lines;
+    if( ( WEBVTT_FAILED( status ) && status != WEBVTT_UNFINISHED )
+        || ++i == n || webvtt_segment_is_clean( parser, out->lines ) ) {
+      break;
+    }
+  }
+  out->status = webvtt_end_segment( parser, status );
+  webvtt_delete_parser( parser );
+  if( out->out_of_memory && !WEBVTT_FAILED( out->status ) ) {
+    out->status = WEBVTT_OUT_OF_MEMORY;
+  }
+  return i - first;
+}
+
+#if WEBVTT_OS_WIN32
+typedef HANDLE segment_thread;
+
+static DWORD WINAPI
+thread_main( LPVOID arg )
+{
+  run_segment( ( segment * )arg );
+  return 0;
+}
+
+static webvtt_bool
+start_thread( segment_thread *thread, segment *seg )
+{
+  *thread = CreateThread( 0, 0, &thread_main, seg, 0, 0 );
+  return *thread != 0;
+}
+
+static void
+join_thread( segment_thread thread )
+{
+  WaitForSingleObject( thread, INFINITE );
+  CloseHandle( thread );
+}
+
+static webvtt_uint
+processor_count( void )
+{
+  SYSTEM_INFO info;
+  GetSystemInfo( &info );
+  return ( webvtt_uint )info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t segment_thread;
+
+static void *
+thread_main( void *arg )
+{
+  run_segment( ( segment * )arg );
+  return 0;
+}
+
+static webvtt_bool
+start_thread( segment_thread *thread, segment *seg )
+{
+  return pthread_create( thread, 0, &thread_main, seg ) == 0;
+}
+
+static void
+join_thread( segment_thread thread )
+{
+  pthread_join( thread, 0 );
+}
+
+static webvtt_uint
+processor_count( void )
+{
+  long n = sysconf( _SC_NPROCESSORS_ONLN );
+  return n > 0 ? ( webvtt_uint )n : 1;
+}
+#endif
+
+/**
+ * Return the start of the first line after 'p' which follows an empty line,
+ * or 'end'. Only LF and CRLF line endings are looked for, so that a cut never
+ * falls between the CR and LF of a line ending.
+ */
+static const char *
+find_cut( const char *p, const char *end )
+{
+  while( p < end && ( p = ( const char * )memchr( p, '\n', end - p ) ) ) {
+    ++p;
+    if( p < end && *p == '\n' ) {
+      return p + 1;
+    }
+    if( end - p >= 2 && p[ 0 ] == '\r' && p[ 1 ] == '\n' ) {
+      return p + 2;
+    }
+  }
+  return end;
+}
+
+WEBVTT_INTERN webvtt_uint
+webvtt_parallel_threads( webvtt_uint len, webvtt_uint processors )
+{
+  webvtt_uint segments = len / WEBVTT_PARALLEL_SEGMENT;
+  if( segments < 1 ) {
+    segments = 1;
+  }
+  return processors < segments ? processors : segments;
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_parallel( webvtt_parser self, const void *buffer,
+                       webvtt_uint len, webvtt_uint threads )
+{
+  segment segments[ MAX_SEGMENTS ];
+  segment_thread handles[ MAX_SEGMENTS ];
+  webvtt_bool started[ MAX_SEGMENTS ];
+  webvtt_parser_options options;
+  const char *text = ( const char * )buffer;
+  const char *end = text + len;
+  const char *p;
+  webvtt_status status = WEBVTT_SUCCESS;
+  webvtt_bool deliver = 1;
+  webvtt_uint n, i, k, line = 1;
+
+  if( !self || ( !buffer && len ) ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+
+  if( !threads ) {
+    threads = webvtt_parallel_threads( len, processor_count() );
+  }
+  if( threads > MAX_SEGMENTS ) {
+    threads = MAX_SEGMENTS;
+  }
+
+  /**
+   * Objects from an arena are only freed with the parser which made them, and
+   * the workers' parsers don't outlive this call.
+   */
+  if( threads < 2 || self->allocator == &self->arena ) {
+    return webvtt_parse_buffer( self, buffer, len );
+  }
+
+  /**
+   * Cut the text at empty lines, which always end a block, so that each
+   * segment holds whole cues. The header stays at the start of the first
+   * segment, so the first cut comes after the first line.
+   */
+  p = webvtt_scan_eol( text, end );
+  n = 0;
+  segments[ 0 ].text = text;
+  for( i = 1; i < threads; ++i ) {
+    const char *target = text + ( webvtt_uint64 )len * i / threads;
+    if( target < p ) {
+      target = p;
+    }
+    p = find_cut( target, end );
+    if( p == end ) {
+      break;
+    }
+    segments[ n ].length = ( webvtt_uint )( p - segments[ n ].text );
+    segments[ ++n ].text = p;
+  }
+  segments[ n ].length = ( webvtt_uint )( end - segments[ n ].text );
+  ++n;
+  if( n < 2 ) {
+    return webvtt_parse_buffer( self, buffer, len );
+  }
+
+  /**
+   * The workers allocate the way this parser does, and borrow, skip work and
+   * leave cue text unparsed if it does
+   */
+  memset( &options, 0, sizeof( options ) );
+  options.flags = self->skip;
+  if( self->borrow ) {
+    options.flags |= WEBVTT_PARSER_BORROW_INPUT;
+  }
+  if( self->lazy_cuetext ) {
+    options.flags |= WEBVTT_PARSER_LAZY_CUETEXT;
+  }
+  options.alloc = self->heap->alloc;
+  options.free = self->heap->free;
+  options.alloc_data = self->heap->alloc_data;
+
+  for( i = 0; i < n; ++i ) {
+    segments[ i ].body = i > 0;
+    segments[ i ].options = &options;
+    segments[ i ].lines = 0;
+    segments[ i ].clean = 0;
+    segments[ i ].status = WEBVTT_SUCCESS;
+    segments[ i ].out_of_memory = 0;
+    segments[ i ].events = 0;
+    segments[ i ].count = segments[ i ].alloc = 0;
+  }
+
+  /* The first segment is parsed on this thread, the rest on their own */
+  for( i = 1; i < n; ++i ) {
+    started[ i ] = start_thread( &handles[ i ], &segments[ i ] );
+  }
+  run_segment( &segments[ 0 ] );
+  for( i = 1; i < n; ++i ) {
+    if( started[ i ] ) {
+      join_thread( handles[ i ] );
+    } else {
+      run_segment( &segments[ i ] );
+    }
+  }
+
+  /**
+   * Hand everything over in the order it appears in the text. Once a segment
+   * stops with an error, or the application turns down an error, nothing
+   * after it would have been parsed, so the rest is thrown away.
+   */
+  for( i = 0; i < n; i += k ) {
+    segment repaired;
+    segment *seg = &segments[ i ];
+    webvtt_uint e;
+
+    k = 1;
+    if( deliver && !seg->clean && !WEBVTT_FAILED( seg->status )
+        && i + 1 < n ) {
+      k = repair_segments( segments, i, n, &repaired );
+      for( e = i; e < i + k; ++e ) {
+        discard_events( &segments[ e ] );
+      }
+      seg = &repaired;
+    }
+
+    for( e = 0; e < seg->count; ++e ) {
+      segment_event *ev = &seg->events[ e ];
+      if( ev->cue ) {
+        if( deliver ) {
+          webvtt_deliver_cue( self, ev->cue );
+        } else {
+          webvtt_release_cue( &ev->cue );
+        }
+      } else if( deliver ) {
+        webvtt_flush_cues( self );
+        if( self->error( self->userdata, ev->line + line - 1, ev->column,
+                         ev->error ) < 0 ) {
+          deliver = 0;
+          status = WEBVTT_PARSE_ERROR;
+        }
+      }
+    }
+    if( deliver && WEBVTT_FAILED( seg->status ) ) {
+      deliver = 0;
+      status = seg->status;
+    }
+    line += seg->lines;
+    webvtt_free( seg->events );
+  }
+  webvtt_flush_cues( self );
+
+  self->finished = 1;
+  return status;
+}
@@ -28,6 +28,7 @@
 #include "parser_internal.h"
 #include "cuetext_internal.h"
 #include "cue_internal.h"
+#include "scan_internal.h"
 #include <string.h>
 
 #define _ERROR(X) do { if( skip_error == 0 ) { ERROR(X); } } while(0)
@@ -35,8 +36,6 @@
 static const char separator[] = {
   '-', '-', '>'
 };
-/* UTF8 encoding of U+FFFD REPLACEMENT CHAR */
-static const char replacement[] = { 0xEF, 0xBF, 0xBD };
 
 #define MSECS_PER_HOUR (3600000)
 #define MSECS_PER_MINUTE (60000)
@@ -44,23 +43,52 @@ static const char replacement[] = { 0xEF, 0xBF, 0xBD };
 #define BUFFER (self->buffer + self->position)
 #define MALFORMED_TIME ((webvtt_timestamp_t)-1.0)
 
-static webvtt_status find_bytes( const char *buffer, webvtt_uint len,
-                                 const char *sbytes, webvtt_uint slen );
-
 WEBVTT_EXPORT webvtt_status
 webvtt_create_parser( webvtt_cue_fn on_read,
                       webvtt_error_fn on_error, void *
                       userdata,
                       webvtt_parser *ppout )
+{
+  return webvtt_create_parser_with_options( on_read, on_error, userdata, 0,
+                                            ppout );
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_create_parser_with_options( webvtt_cue_fn on_read,
+                                   webvtt_error_fn on_error, void *userdata,
+                                   const webvtt_parser_options *options,
+                                   webvtt_parser *ppout )
 {
   webvtt_parser p;
+  webvtt_alloc_context *heap;
   if( !on_read || !on_error || !ppout ) {
     return WEBVTT_INVALID_PARAM;
   }
 
-  if( !( p = ( webvtt_parser )webvtt_alloc0( sizeof * p ) ) ) {
+  /**
+   * Every parser gets an allocation context of its own, so that parsers
+   * running on different threads never touch shared allocator state.
+   */
+  if( options ) {
+    heap = webvtt_create_alloc_context( options->alloc, options->free,
+                                        options->alloc_data,
+                                        ( options->flags
+                                          & WEBVTT_PARSER_ALLOC_STATS ) != 0 );
+  } else {
+    heap = webvtt_create_alloc_context( 0, 0, 0, 0 );
+  }
+  if( !heap ) {
+    return WEBVTT_OUT_OF_MEMORY;
+  }
+
+  if( !( p = ( webvtt_parser )webvtt_alloc_from( heap, sizeof * p,
+                                                WEBVTT_ALLOC_PARSER_STACK ) ) ) {
+    webvtt_release_alloc_context( heap );
     return WEBVTT_OUT_OF_MEMORY;
   }
+  memset( p, 0, sizeof * p );
+  p->heap = heap;
+  p->allocator = heap;
 
   memset( p->astack, 0, sizeof( p->astack ) );
   p->stack = p->astack;
@@ -73,6 +101,20 @@ webvtt_create_parser( webvtt_cue_fn on_read,
   p->column = p->line = 1;
   p->userdata = userdata;
   p->finished = 0;
+
+  if( options && ( options->flags & WEBVTT_PARSER_USE_ARENA ) ) {
+    webvtt_init_arena( &p->arena, heap );
+    p->allocator = &p->arena;
+  }
+  if( options && ( options->flags & WEBVTT_PARSER_BORROW_INPUT ) ) {
+    p->borrow = 1;
+  }
+  if( options && ( options->flags & WEBVTT_PARSER_LAZY_CUETEXT ) ) {
+    p->lazy_cuetext = 1;
+  }
+  if( options ) {
+    p->skip = options->flags & WEBVTT_PARSER_SKIP_MASK;
+  }
   *ppout = p;
 
   return WEBVTT_SUCCESS;
@@ -81,36 +123,52 @@ webvtt_create_parser( webvtt_cue_fn on_read,
 /**
  * Helper to validate a cue and, if valid, notify the application that a cue has
  * been read.
- * If it fails to validate, silently delete the cue.
+ * If it fails to validate, silently delete the cue. If a borrowed string can
+ * not be copied, the cue is deleted and WEBVTT_ALLOCATION_FAILED reported.
  *
  * ( This might not be the best way to go about this, and additionally,
  * webvtt_validate_cue has no means to report errors with the cue, and we do
  * nothing with its return value )
  */
-static void
+static webvtt_status
 finish_cue( webvtt_parser self, webvtt_cue **pcue )
 {
   if( pcue ) {
     webvtt_cue *cue = *pcue;
+    *pcue = 0;
     if( cue ) {
       if( webvtt_validate_cue( cue ) ) {
-        self->read( self->userdata, cue );
+        /**
+         * Cues may be kept for a long time, so give back the room left over
+         * from building their text. An arena never frees, so there it would
+         * only cost more.
+         */
+        if( self->copy_borrowed
+            && ( WEBVTT_FAILED( webvtt_string_detach( &cue->id ) )
+                 || WEBVTT_FAILED( webvtt_string_detach( &cue->body ) ) ) ) {
+          webvtt_release_cue( &cue );
+          ERROR( WEBVTT_ALLOCATION_FAILED );
+          return WEBVTT_OUT_OF_MEMORY;
+        }
+        if( self->allocator != &self->arena ) {
+          webvtt_string_shrink_to_fit( &cue->id );
+          webvtt_string_shrink_to_fit( &cue->body );
+        }
+        webvtt_deliver_cue( self, cue );
       } else {
         webvtt_release_cue( &cue );
       }
-      *pcue = 0;
     }
   }
+  return WEBVTT_SUCCESS;
 }
 
 /**
- * This routine tries to clean up the stack
- * for us, to prevent leaks.
- *
- * It should also help find errors in stack management.
+ * Release whatever the states on the stack hold and bring 'top' back down to
+ * the bottom of it, leaving the stack itself where it is.
  */
-WEBVTT_INTERN void
-cleanup_stack( webvtt_parser self )
+static void
+clear_stack( webvtt_parser self )
 {
   webvtt_state *st = self->top;
   while( st >= self->stack ) {
@@ -137,6 +195,18 @@ cleanup_stack( webvtt_parser self )
     }
     --st;
   }
+}
+
+/**
+ * This routine tries to clean up the stack
+ * for us, to prevent leaks.
+ *
+ * It should also help find errors in stack management.
+ */
+WEBVTT_INTERN void
+cleanup_stack( webvtt_parser self )
+{
+  clear_stack( self );
   if( self->stack != self->astack ) {
     /**
      * If the stack is dynamically allocated (probably not),
@@ -151,11 +221,8 @@ cleanup_stack( webvtt_parser self )
   }
 }
 
-/**
- *
- */
-WEBVTT_EXPORT webvtt_status
-webvtt_finish_parsing( webvtt_parser self )
+static webvtt_status
+finish_parsing( webvtt_parser self )
 {
   webvtt_status status = WEBVTT_SUCCESS;
   const char buffer[] = "\0";
@@ -188,7 +255,7 @@ retry:
           cue = self->top->v.cue;
           SAFE_ASSERT( self->popped && (self->top+1)->state == T_CUEREAD );
           SAFE_ASSERT( cue != 0 );
-          text.d = (self->top+1)->v.text.d;
+          text = (self->top+1)->v.text;
           (self->top+1)->v.text.d = 0;
           (self->top+1)->type = V_NONE;
           (self->top+1)->state = 0;
@@ -218,19 +285,304 @@ retry:
     }
     cleanup_stack( self );
   }
+  webvtt_flush_cues( self );
 
   return status;
 }
 
+/**
+ * Add 'cue' to the end of the queue of pulled cues, growing it if need be.
+ */
+static void
+queue_cue( webvtt_parser self, webvtt_cue *cue )
+{
+  if( self->queue_count == self->queue_alloc ) {
+    webvtt_uint alloc = self->queue_alloc ? self->queue_alloc * 2 : 8;
+    webvtt_uint i;
+    webvtt_cue **queue = ( webvtt_cue ** )webvtt_alloc_from( self->heap,
+                           sizeof( *queue ) * alloc,
+                           WEBVTT_ALLOC_PARSER_STACK );
+    if( !queue ) {
+      webvtt_release_cue( &cue );
+      self->pull_status = WEBVTT_OUT_OF_MEMORY;
+      return;
+    }
+    for( i = 0; i < self->queue_count; ++i ) {
+      queue[ i ] = self->queue[ ( self->queue_head + i ) % self->queue_alloc ];
+    }
+    webvtt_free( self->queue );
+    self->queue = queue;
+    self->queue_head = 0;
+    self->queue_alloc = alloc;
+  }
+  self->queue[ ( self->queue_head + self->queue_count++ )
+               % self->queue_alloc ] = cue;
+}
+
+/**
+ * Release the cues nobody has pulled yet, and forget the input.
+ */
+static void
+drop_queue( webvtt_parser self )
+{
+  while( self->queue_count ) {
+    webvtt_release_cue( &self->queue[ self->queue_head ] );
+    self->queue_head = ( self->queue_head + 1 ) % self->queue_alloc;
+    --self->queue_count;
+  }
+  self->queue_head = 0;
+  self->pull = 0;
+  self->input = 0;
+  self->input_left = 0;
+  self->input_last = 0;
+  self->pull_status = WEBVTT_SUCCESS;
+}
+
+WEBVTT_INTERN void
+webvtt_deliver_cue( webvtt_parser self, webvtt_cue *cue )
+{
+  if( self->pull ) {
+    queue_cue( self, cue );
+    return;
+  }
+  if( !self->read_batch ) {
+    self->read( self->userdata, cue );
+    return;
+  }
+  self->batch[ self->batch_count++ ] = cue;
+  if( self->batch_count == self->batch_max ) {
+    webvtt_flush_cues( self );
+  }
+}
+
+WEBVTT_INTERN void
+webvtt_flush_cues( webvtt_parser self )
+{
+  webvtt_uint count = self->batch_count;
+  if( count ) {
+    self->batch_count = 0;
+    self->read_batch( self->userdata, self->batch, count );
+  }
+}
+
+/**
+ * Release the cues waiting in the batch without handing them over.
+ */
+static void
+drop_batch( webvtt_parser self )
+{
+  while( self->batch_count ) {
+    webvtt_release_cue( &self->batch[ --self->batch_count ] );
+  }
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_set_cue_batch_callback( webvtt_parser self,
+                               webvtt_cue_batch_fn on_batch, webvtt_uint max )
+{
+  webvtt_cue **batch = 0;
+  if( !self ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  if( on_batch ) {
+    if( !max ) {
+      max = 64;
+    }
+    if( max != self->batch_max ) {
+      if( !( batch = ( webvtt_cue ** )webvtt_alloc_from( self->heap,
+                       sizeof( *batch ) * max,
+                       WEBVTT_ALLOC_PARSER_STACK ) ) ) {
+        return WEBVTT_OUT_OF_MEMORY;
+      }
+    }
+  }
+
+  /* Whatever was waiting goes out the way it was meant to */
+  webvtt_flush_cues( self );
+  if( batch ) {
+    webvtt_free( self->batch );
+    self->batch = batch;
+    self->batch_max = max;
+  }
+  self->read_batch = on_batch;
+  return WEBVTT_SUCCESS;
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parser_set_input( webvtt_parser self, const void *buffer,
+                         webvtt_uint len, webvtt_bool last )
+{
+  if( !self || ( !buffer && len ) || self->input_left || self->input_last ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  self->pull = 1;
+  self->input = ( const char * )buffer;
+  self->input_left = len;
+  self->input_last = last;
+  return WEBVTT_SUCCESS;
+}
+
+/**
+ * The length of the text at the start of 'input' up to and including the
+ * next empty line, which ends whatever block came before it, or all of it if
+ * there is none.
+ */
+static webvtt_uint
+next_block( const char *input, webvtt_uint len )
+{
+  const char *p = input, *end = input + len;
+  while( p < end ) {
+    const char *line = p;
+    p = webvtt_scan_eol( p, end );
+    if( p < end ) {
+      p += ( *p == '\r' && p + 1 < end && p[ 1 ] == '\n' ) ? 2 : 1;
+    }
+    if( *line == '\n' || *line == '\r' ) {
+      break;
+    }
+  }
+  return ( webvtt_uint )( p - input );
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parser_next_cue( webvtt_parser self, webvtt_cue **pcue )
+{
+  if( !self || !pcue ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  *pcue = 0;
+
+  /**
+   * Parse a block at a time, only until there is a cue to give, so that the
+   * application need not wait for the rest of the input.
+   */
+  while( !self->queue_count ) {
+    if( WEBVTT_FAILED( self->pull_status ) ) {
+      return self->pull_status;
+    } else if( self->input_left ) {
+      webvtt_uint n = next_block( self->input, self->input_left );
+      webvtt_status status = webvtt_parse_chunk( self, self->input, n );
+      self->input += n;
+      self->input_left -= n;
+      if( WEBVTT_FAILED( status ) && status != WEBVTT_UNFINISHED ) {
+        self->pull_status = status;
+      }
+    } else if( self->input_last && !self->finished ) {
+      webvtt_status status = webvtt_finish_parsing( self );
+      if( WEBVTT_FAILED( status ) && status != WEBVTT_UNFINISHED ) {
+        self->pull_status = status;
+      }
+    } else if( self->input_last ) {
+      /* The end of the document */
+      return WEBVTT_SUCCESS;
+    } else {
+      return WEBVTT_UNFINISHED;
+    }
+  }
+
+  *pcue = self->queue[ self->queue_head ];
+  self->queue_head = ( self->queue_head + 1 ) % self->queue_alloc;
+  --self->queue_count;
+  return WEBVTT_SUCCESS;
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_finish_parsing( webvtt_parser self )
+{
+  webvtt_alloc_context *saved = webvtt_swap_alloc_context( self->allocator );
+  webvtt_status status = finish_parsing( self );
+  webvtt_swap_alloc_context( saved );
+  return status;
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_get_parser_alloc_stats( webvtt_parser self, webvtt_alloc_stats *stats )
+{
+  if( !self || !stats ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  webvtt_get_context_stats( self->heap, stats );
+  return WEBVTT_SUCCESS;
+}
+
 WEBVTT_EXPORT void
 webvtt_delete_parser( webvtt_parser self )
 {
   if( self ) {
+    webvtt_alloc_context *heap = self->heap;
     cleanup_stack( self );
+    drop_batch( self );
+    webvtt_free( self->batch );
+    drop_queue( self );
+    webvtt_free( self->queue );
 
     webvtt_release_string( &self->line_buffer );
+    if( self->allocator == &self->arena ) {
+      webvtt_release_arena( &self->arena );
+    }
     webvtt_free( self );
+    webvtt_release_alloc_context( heap );
+  }
+}
+
+WEBVTT_EXPORT void
+webvtt_reset_parser( webvtt_parser self )
+{
+  if( !self ) {
+    return;
+  }
+
+  drop_batch( self );
+  drop_queue( self );
+  if( self->allocator == &self->arena ) {
+    /**
+     * A grown stack and the line buffer came from the arena as well, so they
+     * have to go before the arena is emptied.
+     */
+    webvtt_release_string( &self->line_buffer );
+    cleanup_stack( self );
+    webvtt_release_arena( &self->arena );
+    webvtt_init_arena( &self->arena, self->heap );
+  } else {
+    webvtt_string_clear( &self->line_buffer );
+    clear_stack( self );
+  }
+  self->top->state = T_INITIAL;
+  self->top->flags = 0;
+  self->top->back = 0;
+  self->popped = 0;
+
+  self->state = 0;
+  self->bytes = 0;
+  self->column = self->line = 1;
+  self->finished = 0;
+  self->cuetext_line = 0;
+  self->mode = M_WEBVTT;
+  self->truncate = 0;
+  self->line_pos = 0;
+  self->line_ready = 0;
+  self->last_newline = 0;
+  if( self->copy_borrowed ) {
+    /* Interrupted in the middle of webvtt_parse_buffer() */
+    self->borrow = 0;
+    self->copy_borrowed = 0;
+  }
+  self->tstate = L_START;
+  self->token_pos = 0;
+  self->token[ 0 ] = 0;
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_set_parser_callbacks( webvtt_parser self, webvtt_cue_fn on_read,
+                             webvtt_error_fn on_error, void *userdata )
+{
+  if( !self || !on_read || !on_error ) {
+    return WEBVTT_INVALID_PARAM;
   }
+  self->read = on_read;
+  self->error = on_error;
+  self->userdata = userdata;
+  return WEBVTT_SUCCESS;
 }
 
 #define BEGIN_STATE(State) case State: {
@@ -248,32 +600,100 @@ webvtt_delete_parser( webvtt_parser self )
 static int
 find_newline( const char *buffer, webvtt_uint *pos, webvtt_uint len )
 {
-  while( *pos < len ) {
-    if( buffer[ *pos ] == '\r' || buffer[ *pos ] == '\n' ) {
-      return 1;
-    } else {
-      ( *pos )++;
+  const char *eol = webvtt_scan_eol( buffer + *pos, buffer + len );
+  *pos = ( webvtt_uint )( eol - buffer );
+  return *pos < len ? 1 : -1;
+}
+
+/**
+ * webvtt_string_getline() for the parser's input. In WEBVTT_PARSER_BORROW_INPUT
+ * mode, the line is borrowed from 'buffer' if 'str' is empty or already ends
+ * where the line begins, and it has no NUL bytes to replace.
+ */
+static int
+read_line( webvtt_parser self, webvtt_string *str, const char *buffer,
+           webvtt_uint *pos, webvtt_uint len, int *truncate,
+           webvtt_bool finish )
+{
+  if( self->borrow ) {
+    const char *s = buffer + *pos;
+    const char *n = buffer + len;
+    const char *p = webvtt_scan3( s, n, '\r', '\n', '\0' );
+
+    if( p < n && *p == '\0' ) {
+      return webvtt_string_getline( str, buffer, pos, len, truncate, finish );
+    }
+
+    if( p == s ) {
+      if( !str->d ) {
+        webvtt_init_string( str );
+      }
+      return p < n || finish ? 1 : 0;
+    }
+
+    if( p > s && webvtt_string_length( str ) + ( p - s ) < WEBVTT_MAX_LINE
+        && webvtt_string_extend_borrowed( str, s, ( webvtt_uint32 )( p - s ) ) ) {
+      *pos += ( webvtt_uint )( p - s );
+      return p < n || finish ? 1 : 0;
     }
   }
-  return -1;
+  return webvtt_string_getline( str, buffer, pos, len, truncate, finish );
 }
 
 /**
- * basic strnstr-ish routine
+ * Append a line of cue text to 'body', after a line feed if 'body' is not
+ * empty. In WEBVTT_PARSER_BORROW_INPUT mode the body remains borrowed from the
+ * input for as long as its lines are separated by a single line feed there.
  */
 static webvtt_status
-find_bytes( const char *buffer, webvtt_uint len,
-    const char *sbytes, webvtt_uint slen )
+append_cuetext_line( webvtt_parser self, webvtt_string *body,
+                     const webvtt_string *line )
+{
+  webvtt_status status;
+  const char *text = webvtt_string_text( line );
+  webvtt_uint32 length = webvtt_string_length( line );
+
+  if( self->borrow && webvtt_string_is_borrowed( line ) ) {
+    if( webvtt_string_length( body ) == 0 ) {
+      webvtt_release_string( body );
+      webvtt_copy_string( body, line );
+      return WEBVTT_SUCCESS;
+    }
+    if( self->last_newline && self->last_newline + 1 == text
+        && webvtt_string_extend_borrowed( body, self->last_newline,
+                                          length + 1 ) ) {
+      return WEBVTT_SUCCESS;
+    }
+  }
+
+  if( webvtt_string_length( body ) &&
+      WEBVTT_FAILED( status = webvtt_string_putc( body, '\n' ) ) ) {
+    return status;
+  }
+  return webvtt_string_append( body, text, length );
+}
+
+/**
+ * basic strnstr-ish routine
+ */
+WEBVTT_INTERN webvtt_status
+webvtt_find_bytes( const char *buffer, webvtt_uint len,
+                   const char *sbytes, webvtt_uint slen )
 {
-  webvtt_uint slen2;
+  const char *end;
   // check params for integrity
   if( !buffer || len < 1 || !sbytes || slen < 1 ) {
     return WEBVTT_INVALID_PARAM;
   }
+  if( len < slen ) {
+    return WEBVTT_NO_MATCH_FOUND;
+  }
 
-  slen2 = slen - 1;
-  while( len-- >= slen && *buffer ){
-    if( *buffer == *sbytes && memcmp( buffer + 1, sbytes + 1, slen2 ) == 0 ) {
+  /* Candidates start at the first byte of 'sbytes'; a NUL ends the search */
+  end = buffer + ( len - slen ) + 1;
+  while( ( buffer = webvtt_scan2( buffer, end, *sbytes, '\0' ) ) < end
+         && *buffer ) {
+    if( memcmp( buffer + 1, sbytes + 1, slen - 1 ) == 0 ) {
       return WEBVTT_SUCCESS;
     }
     buffer++;
@@ -303,8 +723,10 @@ do_push( webvtt_parser self, webvtt_uint token, webvtt_uint back,
 {
   if( STACK_SIZE + 1 >= self->stack_alloc ) {
     webvtt_state *stack =
-        ( webvtt_state * )webvtt_alloc0( sizeof( webvtt_state ) *
-                                         ( self->stack_alloc << 1 ) ), *tmp;
+        ( webvtt_state * )webvtt_alloc0_kind( sizeof( webvtt_state ) *
+                                              ( self->stack_alloc << 1 ),
+                                              WEBVTT_ALLOC_PARSER_STACK ),
+        *tmp;
     if( !stack ) {
       ERROR( WEBVTT_ALLOCATION_FAILED );
       return WEBVTT_OUT_OF_MEMORY;
@@ -480,6 +902,10 @@ webvtt_collect_timings_and_settings( webvtt_parser self,
     ERROR( WEBVTT_EXPECTED_WHITESPACE );
   }
 
+  if( self->skip & WEBVTT_PARSER_SKIP_SETTINGS ) {
+    return WEBVTT_SUCCESS;
+  }
+
   /**
    * 11. Let remainder be the trailing substring of input starting at position.
    */
@@ -502,16 +928,23 @@ webvtt_proc_cueline( webvtt_parser self, webvtt_cue *cue,
   text = webvtt_string_text( line );
   /* backup the column */
   self->column = 1;
-  if( find_bytes( text, length, separator, sizeof( separator ) )
+  if( webvtt_find_bytes( text, length, separator, sizeof( separator ) )
       == WEBVTT_SUCCESS) {
     /* It's not a cue id, we found '-->'. It can't be a second
        cueparams line, because if we had it, we would be in
        a different state. */
     int v;
     self->cuetext_line = self->line + 1;
+    /* Settings are parsed as NUL-terminated text */
+    if( WEBVTT_FAILED( webvtt_string_detach( line ) ) ) {
+      webvtt_release_string( line );
+      ERROR( WEBVTT_ALLOCATION_FAILED );
+      return WEBVTT_OUT_OF_MEMORY;
+    }
     if( ( v = webvtt_collect_timings_and_settings( self,
                                                    line, cue ) ) < 0 ) {
         if( v == WEBVTT_PARSE_ERROR ) {
+          webvtt_release_string( line );
           return WEBVTT_PARSE_ERROR;
         }
         self->mode = M_SKIP_CUE;
@@ -537,8 +970,14 @@ webvtt_proc_cueline( webvtt_parser self, webvtt_cue *cue,
       webvtt_token token = UNFINISHED;
       self->column += length;
       self->cuetext_line = self->line;
-      if( WEBVTT_FAILED( webvtt_string_append( &cue->id, text,
-                                               length ) ) ) {
+      if( self->skip & WEBVTT_PARSER_SKIP_IDS ) {
+        /* Recognized, but not kept */
+      } else if( webvtt_string_is_borrowed( line )
+                 && webvtt_string_length( &cue->id ) == 0 ) {
+        webvtt_release_string( &cue->id );
+        webvtt_copy_string( &cue->id, line );
+      } else if( WEBVTT_FAILED( webvtt_string_append( &cue->id, text,
+                                                      length ) ) ) {
         webvtt_release_string( line );
         ERROR( WEBVTT_ALLOCATION_FAILED );
         return WEBVTT_OUT_OF_MEMORY;
@@ -579,8 +1018,8 @@ parse_webvtt( webvtt_parser self, const char *buffer, webvtt_uint *ppos,
       DIE_IF( SP->type != V_TEXT );
       if( SP->flags == 0 ) {
         int v;
-        if( ( v = webvtt_string_getline( &SP->v.text, buffer, &pos, len, 0,
-                                         finish ) ) ) {
+        if( ( v = read_line( self, &SP->v.text, buffer, &pos, len, 0,
+                             finish ) ) ) {
           if( v < 0 ) {
             webvtt_release_string( &SP->v.text );
             SP->type = V_NONE;
@@ -589,17 +1028,6 @@ parse_webvtt( webvtt_parser self, const char *buffer, webvtt_uint *ppos,
             status = WEBVTT_OUT_OF_MEMORY;
             goto _finish;
           }
-          /* replace '\0' with u+fffd */
-          if( WEBVTT_FAILED( status = webvtt_string_replace_all( &SP->v.text,
-                                                                 "\0", 1,
-                                                                 replacement,
-                                                                 3 ) ) ) {
-            webvtt_release_string( &SP->v.text );
-            SP->type = V_NONE;
-            POP();
-            ERROR( WEBVTT_ALLOCATION_FAILED );
-            goto _finish;
-          }
           SP->flags = 1;
         }
       }
@@ -765,8 +1193,17 @@ _recheck:
             }
             goto _finish;
           }
-          if( WEBVTT_FAILED( status = webvtt_create_string_with_text( &tk,
-            self->token, self->token_pos ) ) ) {
+          if( self->borrow && self->token_pos && pos >= self->token_pos
+              && memcmp( buffer + pos - self->token_pos, self->token,
+                         self->token_pos ) == 0 ) {
+            /* The token is still in the input, so the cue id can borrow it */
+            status = webvtt_create_borrowed_string( &tk,
+              buffer + pos - self->token_pos, ( int )self->token_pos );
+          } else {
+            status = webvtt_create_string_with_text( &tk, self->token,
+                                                     self->token_pos );
+          }
+          if( WEBVTT_FAILED( status ) ) {
             if( status == WEBVTT_OUT_OF_MEMORY ) {
               ERROR( WEBVTT_ALLOCATION_FAILED );
             }
@@ -775,7 +1212,7 @@ _recheck:
           }
           PUSH0( T_CUE, cue, V_CUE );
           PUSH0( T_CUEREAD, 0, V_TEXT );
-          SP->v.text.d = tk.d;
+          SP->v.text = tk;
         }
         break;
 
@@ -792,7 +1229,7 @@ _recheck:
          */
         cue = SP->v.cue;
         st = FRAMEUP( 1 );
-        text.d = st->v.text.d;
+        text = st->v.text;
 
         st->type = V_NONE;
         st->v.cue = NULL;
@@ -836,66 +1273,51 @@ webvtt_read_cuetext( webvtt_parser self, const char *b,
   webvtt_status status = WEBVTT_SUCCESS;
   webvtt_uint pos = *ppos;
   int finished = 0;
-  int flags = 0;
   webvtt_cue *cue;
 
   /* Ensure that we have a cue to work with */
   SAFE_ASSERT( self->top->type = V_CUE );
   cue = self->top->v.cue;
 
-  /**
-   * Hack to support lines spanning multiple buffers.
-   *
-   * TODO: Do this some better way. This is not good!
-   */
-  if( self->line_buffer.d != 0 && self->line_buffer.d->text[
-      self->line_buffer.d->length - 1 ] == '\n' ) {
-    flags = 1;
-  }
-
   do {
-    if( !flags ) {
+    /**
+     * 'line_ready' remembers, across buffers, that the line has been read and
+     * only its newline is missing.
+     */
+    if( !self->line_ready ) {
       int v;
-      if( ( v = webvtt_string_getline( &self->line_buffer, b, &pos, len,
-                                       &self->truncate, finish ) ) ) {
-        if( v < 0 || WEBVTT_FAILED( webvtt_string_putc( &self->line_buffer,
-                                                        '\n' ) ) ) {
+      if( ( v = read_line( self, &self->line_buffer, b, &pos, len,
+                           &self->truncate, finish ) ) ) {
+        if( v < 0 ) {
           ERROR( WEBVTT_ALLOCATION_FAILED );
           status = WEBVTT_OUT_OF_MEMORY;
           goto _finish;
         }
-        /* replace '\0' with u+fffd */
-        if( WEBVTT_FAILED( status =
-                           webvtt_string_replace_all( &self->line_buffer,
-                                                      "\0", 1, replacement,
-                                                      3 ) ) ) {
-          ERROR( WEBVTT_ALLOCATION_FAILED );
-          goto _finish;
-        }
-
-        flags = 1;
+        self->line_ready = 1;
       }
     }
-    if( flags ) {
+    if( self->line_ready ) {
+      webvtt_uint start = pos;
       webvtt_token token = webvtt_lex_newline( self, b, &pos, len, finish );
       if( token == NEWLINE ) {
+        const char *newline = pos == start + 1 && b[ start ] == '\n'
+                              ? b + start : 0;
         self->token_pos = 0;
         self->line++;
+        self->line_ready = 0;
 
-        /* Remove the '\n' that we appended to determine that we're in state 1
-         */
-        self->line_buffer.d->text[ --self->line_buffer.d->length ] = 0;
         /**
          * We've encountered a line without any cuetext on it, i.e. there is no
          * newline character and len is 0 or there is and len is 1, therefore,
          * the cue text is finished.
          */
-        if( self->line_buffer.d->length == 0 ) {
+        if( webvtt_string_length( &self->line_buffer ) == 0 ) {
           webvtt_release_string( &self->line_buffer );
           finished = 1;
-        } else if( find_bytes( webvtt_string_text( &self->line_buffer ),
-                   webvtt_string_length( &self->line_buffer ), separator,
-                   sizeof( separator ) ) == WEBVTT_SUCCESS ) {
+        } else if( webvtt_find_bytes(
+                     webvtt_string_text( &self->line_buffer ),
+                     webvtt_string_length( &self->line_buffer ), separator,
+                     sizeof( separator ) ) == WEBVTT_SUCCESS ) {
           /**
            * Line contains cue-times separator, and thus we treat it as a
            * separate cue. Trick program into thinking that T_CUEREAD had read
@@ -912,14 +1334,13 @@ webvtt_read_cuetext( webvtt_parser self, const char *b,
            * If it's not the end of a cue, simply append it to the cue's payload
            * text.
            */
-          if( webvtt_string_length( &cue->body ) &&
-              WEBVTT_FAILED( webvtt_string_putc( &cue->body, '\n' ) ) ) {
-            status = WEBVTT_OUT_OF_MEMORY;
+          if( WEBVTT_FAILED( status = append_cuetext_line( self, &cue->body,
+                                                     &self->line_buffer ) ) ) {
+            ERROR( WEBVTT_ALLOCATION_FAILED );
             goto _finish;
           }
-          webvtt_string_append_string( &cue->body, &self->line_buffer );
           webvtt_release_string( &self->line_buffer );
-          flags = 0;
+          self->last_newline = newline;
         }
       }
     }
@@ -940,6 +1361,43 @@ _finish:
   return status;
 }
 
+/**
+ * Parse the text of 'cue', which has been read in full, and return the cue to
+ * the user, or drop it if it is being skipped.
+ */
+static webvtt_status
+complete_cue( webvtt_parser self, webvtt_cue *cue )
+{
+  webvtt_status status = WEBVTT_SUCCESS, delivered;
+  if( self->mode == M_SKIP_CUE ) {
+    webvtt_release_cue( &cue );
+    return WEBVTT_SUCCESS;
+  }
+
+  /**
+   * Once we've successfully read the cuetext into line_buffer, call the
+   * cuetext parser from cuetext.c
+   */
+  if( self->copy_borrowed ) {
+    /* The nodes must not borrow from the input either */
+    status = webvtt_string_detach( &cue->body );
+  }
+  if( self->skip & WEBVTT_PARSER_SKIP_CUETEXT ) {
+    cue->flags |= CUE_SKIP_CUETEXT;
+  } else if( status == WEBVTT_SUCCESS && !self->lazy_cuetext ) {
+    status = webvtt_parse_cuetext( self, cue, &cue->body, self->finished );
+  }
+
+  /**
+   * return the cue to the user, if possible.
+   */
+  delivered = finish_cue( self, &cue );
+  if( status == WEBVTT_SUCCESS ) {
+    status = delivered;
+  }
+  return status;
+}
+
 WEBVTT_INTERN webvtt_status
 webvtt_proc_cuetext( webvtt_parser self, const char *b,
                      webvtt_uint *ppos, webvtt_uint len, webvtt_bool finish )
@@ -953,21 +1411,7 @@ webvtt_proc_cuetext( webvtt_parser self, const char *b,
   status  = webvtt_read_cuetext( self, b, ppos, len, finish );
 
   if( status == WEBVTT_SUCCESS ) {
-    if( self->mode != M_SKIP_CUE ) {
-      /**
-       * Once we've successfully read the cuetext into line_buffer, call the
-       * cuetext parser from cuetext.c
-       */
-      status = webvtt_parse_cuetext( self, cue, &cue->body,
-                                     self->finished );
-
-      /**
-       * return the cue to the user, if possible.
-       */
-      finish_cue( self, &cue );
-    } else {
-      webvtt_release_cue( &cue );
-    }
+    status = complete_cue( self, cue );
 
     self->top->type = V_NONE;
     self->top->state = 0;
@@ -991,16 +1435,214 @@ webvtt_proc_cuetext( webvtt_parser self, const char *b,
   return status;
 }
 
-WEBVTT_EXPORT webvtt_status
-webvtt_parse_chunk( webvtt_parser self, const void *buffer, webvtt_uint len )
+/**
+ * Return true if the parser is at the start of a line between two blocks of
+ * the body, with nothing left over from earlier input.
+ */
+static webvtt_bool
+between_blocks( webvtt_parser self )
+{
+  return self->mode == M_WEBVTT && self->top == self->stack
+         && self->top->state == T_BODY && self->tstate == L_START
+         && !self->token_pos && !self->line_ready
+         && !webvtt_string_length( &self->line_buffer );
+}
+
+/**
+ * Find the end of the line at 'pos', and in 'next' the start of the line
+ * after it. Returns 0 unless the line ends before 'len' and read_line() would
+ * borrow it as it is: a CR at the very end may yet be followed by a LF, and
+ * lines with NUL bytes or longer than WEBVTT_MAX_LINE are copied.
+ */
+static int
+block_line( const char *b, webvtt_uint pos, webvtt_uint len, webvtt_uint *end,
+            webvtt_uint *next )
+{
+  const char *p = webvtt_scan3( b + pos, b + len, '\r', '\n', '\0' );
+  webvtt_uint e = ( webvtt_uint )( p - b );
+  if( e >= len || *p == '\0' || e - pos >= WEBVTT_MAX_LINE
+      || ( *p == '\r' && e + 1 == len ) ) {
+    return 0;
+  }
+  *end = e;
+  *next = e + ( *p == '\r' && b[ e + 1 ] == '\n' ? 2 : 1 );
+  return 1;
+}
+
+/**
+ * Return true if the line in [pos, end) has '-->' on it.
+ */
+static int
+has_separator( const char *b, webvtt_uint pos, webvtt_uint end )
+{
+  return webvtt_find_bytes( b + pos, end - pos, separator,
+                            sizeof( separator ) ) == WEBVTT_SUCCESS;
+}
+
+/**
+ * Put 'cue' on the stack the way parse_webvtt() does when it reads the first
+ * line of a block, so that it can carry on with it. The stack owns 'cue' from
+ * then on, even if this fails.
+ */
+static webvtt_status
+push_cue( webvtt_parser self, webvtt_cue *cue )
+{
+  if( do_push( self, UNFINISHED, BACK + 1, T_CUE, cue, V_CUE, self->line,
+               self->column ) == WEBVTT_OUT_OF_MEMORY ) {
+    webvtt_release_cue( &cue );
+    return WEBVTT_OUT_OF_MEMORY;
+  }
+  if( do_push( self, UNFINISHED, BACK + 1, T_CUEREAD, 0, V_NONE, self->line,
+               self->column ) == WEBVTT_OUT_OF_MEMORY ) {
+    return WEBVTT_OUT_OF_MEMORY;
+  }
+  POP();
+  return WEBVTT_SUCCESS;
+}
+
+/**
+ * Read whole blocks at 'pos' straight out of input which stays put, a line at
+ * a time, without the lexer or the state stack: empty lines, and cues made of
+ * an optional id, a timings line and text up to an empty line. The cues,
+ * errors and line numbers are those parse_webvtt() and webvtt_proc_cuetext()
+ * would give. At the first line which needs anything more, they take over in
+ * the state they would have left the parser in; if that is the first line,
+ * 'pos' stays where it is.
+ */
+static webvtt_status
+read_blocks( webvtt_parser self, const char *b, webvtt_uint *ppos,
+             webvtt_uint len )
+{
+  webvtt_status status = WEBVTT_SUCCESS;
+  webvtt_uint pos = *ppos, end, next;
+
+  while( pos < len && block_line( b, pos, len, &end, &next ) ) {
+    webvtt_uint timings = pos, id_end = pos;
+    webvtt_string line;
+    webvtt_cue *cue;
+    int complete;
+
+    if( end == pos ) {
+      self->line++;
+      self->column = 1;
+      pos = next;
+      continue;
+    }
+
+    /* A cue id has to be followed by the timings, or it is left to the rest */
+    if( !has_separator( b, pos, end ) ) {
+      id_end = end;
+      timings = next;
+      if( !block_line( b, timings, len, &end, &next ) || end == timings
+          || !has_separator( b, timings, end ) ) {
+        break;
+      }
+    }
+    if( next == len ) {
+      /* parse_webvtt() leaves the last line to webvtt_finish_parsing() */
+      break;
+    }
+
+    if( WEBVTT_FAILED( status = webvtt_create_cue( &cue ) ) ) {
+      if( status == WEBVTT_OUT_OF_MEMORY ) {
+        ERROR( WEBVTT_ALLOCATION_FAILED );
+      }
+      break;
+    }
+
+    if( id_end != pos ) {
+      /* Just as webvtt_proc_cueline() takes a cue id */
+      self->column = 1 + ( id_end - pos );
+      self->cuetext_line = self->line;
+      if( !( self->skip & WEBVTT_PARSER_SKIP_IDS ) ) {
+        webvtt_release_string( &cue->id );
+        webvtt_create_borrowed_string( &cue->id, b + pos,
+                                       ( int )( id_end - pos ) );
+      }
+      cue->flags |= CUE_HAVE_ID;
+      self->line++;
+    }
+
+    webvtt_create_borrowed_string( &line, b + timings,
+                                   ( int )( end - timings ) );
+    status = webvtt_proc_cueline( self, cue, &line );
+    self->line++;
+    pos = next;
+    if( self->mode == M_WEBVTT ) {
+      /**
+       * The timings could not be read. parse_webvtt() goes on from here with
+       * the cue still on the stack, which fails at the next token, and keeps
+       * this status if the buffer ends first.
+       */
+      webvtt_status rest = push_cue( self, cue );
+      if( !WEBVTT_FAILED( rest ) ) {
+        self->popped = 0;
+        rest = parse_webvtt( self, b, &pos, len, self->finished );
+        if( rest == WEBVTT_SUCCESS ) {
+          if( status == WEBVTT_OUT_OF_MEMORY ) {
+            cleanup_stack( self );
+          }
+          rest = status;
+        }
+      }
+      *ppos = pos;
+      return rest;
+    }
+
+    /**
+     * As in webvtt_read_cuetext(), but a line with '-->' on it, or one which
+     * isn't all there, is left to it.
+     */
+    while( ( complete = block_line( b, pos, len, &end, &next ) ) != 0
+           && end > pos && !has_separator( b, pos, end ) ) {
+      webvtt_create_borrowed_string( &line, b + pos, ( int )( end - pos ) );
+      self->line++;
+      pos = next;
+      if( WEBVTT_FAILED( status = append_cuetext_line( self, &cue->body,
+                                                       &line ) ) ) {
+        ERROR( WEBVTT_ALLOCATION_FAILED );
+        push_cue( self, cue );
+        *ppos = pos;
+        return status;
+      }
+      self->last_newline = next == end + 1 && b[ end ] == '\n' ? b + end : 0;
+    }
+    if( !complete || end > pos ) {
+      status = push_cue( self, cue );
+      break;
+    }
+
+    self->line++;
+    pos = next;
+    status = complete_cue( self, cue );
+    self->mode = M_WEBVTT;
+    if( WEBVTT_FAILED( status ) ) {
+      break;
+    }
+  }
+
+  *ppos = pos;
+  return status;
+}
+
+static webvtt_status
+parse_chunk( webvtt_parser self, const char *b, webvtt_uint len )
 {
   webvtt_status status;
   webvtt_uint pos = 0;
-  const char *b = ( const char * )buffer;
 
   while( pos < len ) {
     switch( self->mode ) {
       case M_WEBVTT:
+        if( self->borrow && between_blocks( self ) ) {
+          webvtt_uint start = pos;
+          if( WEBVTT_FAILED( status = read_blocks( self, b, &pos, len ) ) ) {
+            return status;
+          }
+          if( pos != start ) {
+            break;
+          }
+        }
         if( WEBVTT_FAILED( status = parse_webvtt( self, b, &pos, len,
                                                   self->finished ) ) ) {
           return status;
@@ -1038,6 +1680,66 @@ webvtt_parse_chunk( webvtt_parser self, const void *buffer, webvtt_uint len )
   return WEBVTT_SUCCESS;
 }
 
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_chunk( webvtt_parser self, const void *buffer, webvtt_uint len )
+{
+  webvtt_alloc_context *saved = webvtt_swap_alloc_context( self->allocator );
+  webvtt_status status = parse_chunk( self, ( const char * )buffer, len );
+  webvtt_flush_cues( self );
+  webvtt_swap_alloc_context( saved );
+  return status;
+}
+
+WEBVTT_INTERN void
+webvtt_begin_segment( webvtt_parser self, webvtt_bool body )
+{
+  static const char header[] = "WEBVTT\n\n";
+
+  /**
+   * All of the input is here and stays put until parsing is finished, so
+   * lines can be borrowed from it instead of being copied out a piece at a
+   * time.
+   */
+  self->copy_borrowed = !self->borrow;
+  self->borrow = 1;
+  if( body ) {
+    /* Get past the header, then count lines from the start of the segment */
+    webvtt_parse_chunk( self, header, sizeof( header ) - 1 );
+    self->line = 1;
+  }
+}
+
+WEBVTT_INTERN webvtt_bool
+webvtt_segment_is_clean( webvtt_parser self, webvtt_uint lines )
+{
+  return between_blocks( self ) && self->line == lines + 1;
+}
+
+WEBVTT_INTERN webvtt_status
+webvtt_end_segment( webvtt_parser self, webvtt_status status )
+{
+  webvtt_alloc_context *saved = webvtt_swap_alloc_context( self->allocator );
+  webvtt_status finished = finish_parsing( self );
+  if( !WEBVTT_FAILED( status ) || status == WEBVTT_UNFINISHED ) {
+    status = finished;
+  }
+  self->borrow = !self->copy_borrowed;
+  self->copy_borrowed = 0;
+  self->last_newline = 0;
+  webvtt_swap_alloc_context( saved );
+  return status;
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_parse_buffer( webvtt_parser self, const void *buffer, webvtt_uint len )
+{
+  if( !self || ( !buffer && len ) ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  webvtt_begin_segment( self, 0 );
+  return webvtt_end_segment( self, webvtt_parse_chunk( self, buffer, len ) );
+}
+
 #undef SP
 #undef AT_BOTTOM
 #undef ON_HEAP
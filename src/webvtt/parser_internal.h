@@ -29,6 +29,7 @@
 # define __INTERN_PARSER_H__
 # include <webvtt/parser.h>
 # include "string_internal.h"
+# include "alloc_internal.h"
 # ifndef NDEBUG
 #   define NDEBUG
 # endif
@@ -177,6 +178,31 @@ webvtt_parser_t {
   webvtt_cue_fn read;
   webvtt_error_fn error;
   void *userdata;
+
+  /**
+   * webvtt_set_cue_batch_callback() was called: cues wait in 'batch' until
+   * 'batch_max' of them are ready or webvtt_flush_cues() is called.
+   */
+  webvtt_cue_batch_fn read_batch;
+  webvtt_cue **batch;
+  webvtt_uint batch_count;
+  webvtt_uint batch_max;
+
+  /**
+   * webvtt_parser_set_input() was called: cues wait in 'queue' (a ring of
+   * 'queue_alloc' entries) for webvtt_parser_next_cue() instead of going to
+   * the callbacks, and 'input' is what has not been parsed yet of the text
+   * it was last given. 'pull_status' is the failure which stopped parsing.
+   */
+  webvtt_bool pull;
+  const char *input;
+  webvtt_uint input_left;
+  webvtt_bool input_last;
+  webvtt_status pull_status;
+  webvtt_cue **queue;
+  webvtt_uint queue_head;
+  webvtt_uint queue_count;
+  webvtt_uint queue_alloc;
   webvtt_bool finished;
 
   webvtt_uint cuetext_line; /* start line of cuetext */
@@ -198,6 +224,32 @@ webvtt_parser_t {
   int truncate;
   webvtt_uint line_pos;
   webvtt_string line_buffer;
+  webvtt_bool line_ready; /* 'line_buffer' holds a whole line of cue text */
+
+  /**
+   * WEBVTT_PARSER_BORROW_INPUT was given. 'last_newline' is the lone LF in the
+   * input which followed the last line of cue text, if there was one.
+   */
+  webvtt_bool borrow;
+  const char *last_newline;
+
+  /**
+   * webvtt_parse_buffer() borrows from its input while parsing even without
+   * WEBVTT_PARSER_BORROW_INPUT; cues are then given their own copies of
+   * anything borrowed before they are handed over.
+   */
+  webvtt_bool copy_borrowed;
+
+  /**
+   * WEBVTT_PARSER_LAZY_CUETEXT was given; cue text is left for
+   * webvtt_cue_get_nodes() to parse.
+   */
+  webvtt_bool lazy_cuetext;
+
+  /**
+   * The WEBVTT_PARSER_SKIP_* flags given for this parser
+   */
+  webvtt_uint skip;
 
   /**
    * tokenizer
@@ -205,15 +257,67 @@ webvtt_parser_t {
   webvtt_lexer_state tstate;
   webvtt_uint token_pos;
   char token[0x100];
+
+  /**
+   * allocation context made current while parsing: either 'heap', which is
+   * owned by this parser alone, or 'arena' when that is in use.
+   */
+  webvtt_alloc_context *allocator;
+  webvtt_alloc_context *heap;
+  webvtt_alloc_context arena;
 };
 
+/**
+ * Hand 'cue' over to the application, straight away or as part of a batch.
+ */
+WEBVTT_INTERN void
+webvtt_deliver_cue( webvtt_parser self, webvtt_cue *cue );
+
+/**
+ * Hand over the cues waiting in the batch, if there are any.
+ */
+WEBVTT_INTERN void
+webvtt_flush_cues( webvtt_parser self );
+
+/**
+ * webvtt_parse_buffer() in steps: webvtt_begin_segment(), webvtt_parse_chunk()
+ * with consecutive pieces of one buffer which outlives the parse, then
+ * webvtt_end_segment() with the status of the last of them, which finishes
+ * parsing.
+ *
+ * If 'body' is set, the buffer is a run of blocks cut from the body of a
+ * file at an empty line: the parser starts out as if it had just read the
+ * header, and counts lines from the start of the buffer.
+ */
+WEBVTT_INTERN void
+webvtt_begin_segment( webvtt_parser self, webvtt_bool body );
+
+WEBVTT_INTERN webvtt_status
+webvtt_end_segment( webvtt_parser self, webvtt_status status );
+
+/**
+ * Return true if the parser, having read 'lines' whole lines of a segment,
+ * is between blocks in just the state webvtt_begin_segment() leaves a body
+ * segment in, so that what follows can be parsed on its own.
+ */
+WEBVTT_INTERN webvtt_bool
+webvtt_segment_is_clean( webvtt_parser self, webvtt_uint lines );
+
+/**
+ * The number of threads webvtt_parse_parallel() parses 'len' bytes on when
+ * left to choose, given 'processors' processors: one for every
+ * WEBVTT_PARALLEL_SEGMENT bytes, as far as there are processors.
+ */
+WEBVTT_INTERN webvtt_uint
+webvtt_parallel_threads( webvtt_uint len, webvtt_uint processors );
+
 WEBVTT_INTERN webvtt_token
 webvtt_lex( webvtt_parser self, const char *buffer, webvtt_uint *pos,
             webvtt_uint length, webvtt_bool finish );
 
 WEBVTT_INTERN webvtt_status
 webvtt_lex_word( webvtt_parser self, webvtt_string *pba, const char *buffer,
-                 webvtt_uint *pos, webvtt_uint length, webvtt_bool finish );
+                 webvtt_uint *pos, webvtt_uint length );
 
 /* Tokenize newline sequence, without incrementing 'self->line'. Returns
  * BAD_TOKEN when a newline sequence is not found. */
@@ -248,6 +352,14 @@ WEBVTT_INTERN int
 webvtt_parse_timestamp( const char *b, int *tokenLength,
                         webvtt_timestamp *result );
 
+/**
+ * Search the first 'len' bytes of 'buffer' for 'sbytes', stopping at a NUL.
+ * Returns WEBVTT_SUCCESS if found, WEBVTT_NO_MATCH_FOUND if not.
+ */
+WEBVTT_INTERN webvtt_status
+webvtt_find_bytes( const char *buffer, webvtt_uint len,
+                   const char *sbytes, webvtt_uint slen );
+
 WEBVTT_INTERN webvtt_status
 do_push( webvtt_parser self, webvtt_uint token, webvtt_uint back,
          webvtt_uint state, void *data, webvtt_state_value_type type,
@@ -358,8 +470,13 @@ if( !(condition) ) { \
 #define __ERROR_AT_OR(errno, line, column, __or) \
 do \
 { \
+  if( self->batch_count ) { \
+    webvtt_flush_cues( self ); \
+  } \
   if( !self->error \
-    || self->error( (self->userdata), (line), (column), (errno) ) < 0 ) { \
+    || self->error( (self->userdata), (line), \
+                    ( self->skip & WEBVTT_PARSER_SKIP_ERROR_COLUMNS ) \
+                      ? 0 : (column), (errno) ) < 0 ) { \
     __or \
   } \
 } while(0)
@@ -0,0 +1,872 @@
+/**
+ * Copyright (c) 2013 Mozilla Foundation and Contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scan_internal.h"
+#include <stddef.h>
+#if WEBVTT_CC_MSVC
+# include <intrin.h>
+#endif
+
+/**
+ * Which vector routines can be built. SSE2 is part of every x86-64 processor,
+ * and NEON of every AArch64 one; AVX2 is only used after checking for it.
+ */
+#if WEBVTT_SIMD && ( defined(__x86_64__) || defined(_M_X64) \
+  || ( defined(__i386__) && defined(__SSE2__) ) \
+  || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) )
+# define HAVE_SSE2 1
+# include <emmintrin.h>
+# if ( WEBVTT_CC_GCC && ( defined(__clang__) || __GNUC__ > 4 \
+       || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) \
+     || ( WEBVTT_CC_MSVC && _MSC_VER >= 1700 )
+#   define HAVE_AVX2 1
+#   include <immintrin.h>
+#   if WEBVTT_CC_MSVC
+#     define TARGET_AVX2
+#   else
+#     define TARGET_AVX2 __attribute__((target("avx2")))
+#   endif
+# endif
+#elif WEBVTT_SIMD && ( defined(__ARM_NEON) || defined(__ARM_NEON__) \
+  || defined(__aarch64__) || defined(_M_ARM64) )
+# define HAVE_NEON 1
+# include <arm_neon.h>
+#endif
+
+/**
+ * webvtt_scan_cstr2() reads whole aligned blocks, which may extend past the
+ * end of the object holding the text. That cannot fault, and the bytes after
+ * the terminator are ignored, but it would upset the sanitizers.
+ */
+#if WEBVTT_CC_GCC && ( defined(__clang__) || __GNUC__ >= 5 )
+# define NO_SANITIZE __attribute__((no_sanitize_address, no_sanitize_thread))
+#else
+# define NO_SANITIZE
+#endif
+
+#if WEBVTT_CC_GCC && defined(__ATOMIC_RELAXED)
+# define LOAD_LEVEL() __atomic_load_n( &level, __ATOMIC_RELAXED )
+# define STORE_LEVEL(v) __atomic_store_n( &level, (v), __ATOMIC_RELAXED )
+#else
+# define LOAD_LEVEL() ( level )
+# define STORE_LEVEL(v) ( level = (v) )
+#endif
+
+/* Routines in use, or -1 before the processor has been looked at */
+static int level = -1;
+
+/**
+ * Index of the lowest set bit of a non-zero mask
+ */
+#if defined(HAVE_SSE2)
+static int
+lowest_bit( webvtt_uint32 mask )
+{
+# if WEBVTT_CC_GCC
+  return __builtin_ctz( mask );
+# elif WEBVTT_CC_MSVC
+  unsigned long index;
+  _BitScanForward( &index, mask );
+  return ( int )index;
+# else
+  int index = 0;
+  while( !( mask & 1 ) ) {
+    mask >>= 1;
+    ++index;
+  }
+  return index;
+# endif
+}
+#endif
+
+/**
+ * Portable versions
+ */
+static const char *
+scan3_scalar( const char *p, const char *end, char a, char b, char c )
+{
+  for( ; p < end; ++p ) {
+    if( *p == a || *p == b || *p == c ) {
+      break;
+    }
+  }
+  return p;
+}
+
+static const char *
+scan_cstr2_scalar( const char *p, char a, char b )
+{
+  while( *p && *p != a && *p != b ) {
+    ++p;
+  }
+  return p;
+}
+
+#if defined(HAVE_SSE2)
+static int
+match_sse2( __m128i v, __m128i a, __m128i b, __m128i c )
+{
+  return _mm_movemask_epi8( _mm_or_si128( _mm_or_si128(
+    _mm_cmpeq_epi8( v, a ), _mm_cmpeq_epi8( v, b ) ), _mm_cmpeq_epi8( v, c ) ) );
+}
+
+static const char *
+scan3_sse2( const char *p, const char *end, char a, char b, char c )
+{
+  const __m128i va = _mm_set1_epi8( a );
+  const __m128i vb = _mm_set1_epi8( b );
+  const __m128i vc = _mm_set1_epi8( c );
+  for( ; end - p >= 16; p += 16 ) {
+    int mask = match_sse2( _mm_loadu_si128( ( const __m128i * )p ),
+                           va, vb, vc );
+    if( mask ) {
+      return p + lowest_bit( ( webvtt_uint32 )mask );
+    }
+  }
+  return scan3_scalar( p, end, a, b, c );
+}
+
+static NO_SANITIZE const char *
+scan_cstr2_sse2( const char *p, char a, char b )
+{
+  const __m128i va = _mm_set1_epi8( a );
+  const __m128i vb = _mm_set1_epi8( b );
+  const __m128i zero = _mm_setzero_si128();
+  size_t skip = ( size_t )p & 15;
+  const char *q = p - skip;
+  webvtt_uint32 mask = ( webvtt_uint32 )match_sse2(
+    _mm_load_si128( ( const __m128i * )q ), va, vb, zero ) >> skip;
+  if( mask ) {
+    return p + lowest_bit( mask );
+  }
+  for( ;; ) {
+    q += 16;
+    mask = ( webvtt_uint32 )match_sse2( _mm_load_si128( ( const __m128i * )q ),
+                                        va, vb, zero );
+    if( mask ) {
+      return q + lowest_bit( mask );
+    }
+  }
+}
+#endif
+
+#if defined(HAVE_AVX2)
+static TARGET_AVX2 webvtt_uint32
+match_avx2( __m256i v, __m256i a, __m256i b, __m256i c )
+{
+  return ( webvtt_uint32 )_mm256_movemask_epi8( _mm256_or_si256(
+    _mm256_or_si256( _mm256_cmpeq_epi8( v, a ), _mm256_cmpeq_epi8( v, b ) ),
+    _mm256_cmpeq_epi8( v, c ) ) );
+}
+
+static TARGET_AVX2 const char *
+scan3_avx2( const char *p, const char *end, char a, char b, char c )
+{
+  const __m256i va = _mm256_set1_epi8( a );
+  const __m256i vb = _mm256_set1_epi8( b );
+  const __m256i vc = _mm256_set1_epi8( c );
+  for( ; end - p >= 32; p += 32 ) {
+    webvtt_uint32 mask = match_avx2(
+      _mm256_loadu_si256( ( const __m256i * )p ), va, vb, vc );
+    if( mask ) {
+      return p + lowest_bit( mask );
+    }
+  }
+  return scan3_sse2( p, end, a, b, c );
+}
+
+static TARGET_AVX2 NO_SANITIZE const char *
+scan_cstr2_avx2( const char *p, char a, char b )
+{
+  const __m256i va = _mm256_set1_epi8( a );
+  const __m256i vb = _mm256_set1_epi8( b );
+  const __m256i zero = _mm256_setzero_si256();
+  size_t skip = ( size_t )p & 31;
+  const char *q = p - skip;
+  webvtt_uint32 mask = match_avx2( _mm256_load_si256( ( const __m256i * )q ),
+                                   va, vb, zero ) >> skip;
+  if( mask ) {
+    return p + lowest_bit( mask );
+  }
+  for( ;; ) {
+    q += 32;
+    mask = match_avx2( _mm256_load_si256( ( const __m256i * )q ), va, vb, zero );
+    if( mask ) {
+      return q + lowest_bit( mask );
+    }
+  }
+}
+#endif
+
+#if defined(HAVE_NEON)
+/**
+ * NEON has no movemask; narrowing the comparison result gives four bits per
+ * byte instead.
+ */
+static webvtt_uint64
+match_neon( uint8x16_t v, uint8x16_t a, uint8x16_t b, uint8x16_t c )
+{
+  uint8x16_t eq = vorrq_u8( vorrq_u8( vceqq_u8( v, a ), vceqq_u8( v, b ) ),
+                            vceqq_u8( v, c ) );
+  uint8x8_t bits = vshrn_n_u16( vreinterpretq_u16_u8( eq ), 4 );
+  return vget_lane_u64( vreinterpret_u64_u8( bits ), 0 );
+}
+
+static int
+lowest_nibble( webvtt_uint64 mask )
+{
+# if WEBVTT_CC_MSVC
+  unsigned long index;
+  _BitScanForward64( &index, mask );
+  return ( int )( index >> 2 );
+# else
+  return __builtin_ctzll( mask ) >> 2;
+# endif
+}
+
+static const char *
+scan3_neon( const char *p, const char *end, char a, char b, char c )
+{
+  const uint8x16_t va = vdupq_n_u8( ( webvtt_uint8 )a );
+  const uint8x16_t vb = vdupq_n_u8( ( webvtt_uint8 )b );
+  const uint8x16_t vc = vdupq_n_u8( ( webvtt_uint8 )c );
+  for( ; end - p >= 16; p += 16 ) {
+    webvtt_uint64 mask = match_neon( vld1q_u8( ( const webvtt_uint8 * )p ),
+                                     va, vb, vc );
+    if( mask ) {
+      return p + lowest_nibble( mask );
+    }
+  }
+  return scan3_scalar( p, end, a, b, c );
+}
+
+static NO_SANITIZE const char *
+scan_cstr2_neon( const char *p, char a, char b )
+{
+  const uint8x16_t va = vdupq_n_u8( ( webvtt_uint8 )a );
+  const uint8x16_t vb = vdupq_n_u8( ( webvtt_uint8 )b );
+  const uint8x16_t zero = vdupq_n_u8( 0 );
+  size_t skip = ( size_t )p & 15;
+  const char *q = p - skip;
+  webvtt_uint64 mask = match_neon( vld1q_u8( ( const webvtt_uint8 * )q ),
+                                   va, vb, zero ) >> ( skip * 4 );
+  if( mask ) {
+    return p + lowest_nibble( mask );
+  }
+  for( ;; ) {
+    q += 16;
+    mask = match_neon( vld1q_u8( ( const webvtt_uint8 * )q ), va, vb, zero );
+    if( mask ) {
+      return q + lowest_nibble( mask );
+    }
+  }
+}
+#endif
+
+static webvtt_scan_level
+detect_level( void )
+{
+#if defined(HAVE_AVX2) && WEBVTT_CC_GCC
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) ) {
+    return WEBVTT_SCAN_AVX2;
+  }
+#elif defined(HAVE_AVX2) && WEBVTT_CC_MSVC
+  int info[ 4 ];
+  __cpuid( info, 0 );
+  if( info[ 0 ] >= 7 ) {
+    __cpuid( info, 1 );
+    /* The OS must save the AVX registers too */
+    if( ( info[ 2 ] & ( 1 << 27 ) ) && ( info[ 2 ] & ( 1 << 28 ) )
+        && ( _xgetbv( 0 ) & 6 ) == 6 ) {
+      __cpuidex( info, 7, 0 );
+      if( info[ 1 ] & ( 1 << 5 ) ) {
+        return WEBVTT_SCAN_AVX2;
+      }
+    }
+  }
+#endif
+#if defined(HAVE_SSE2)
+  return WEBVTT_SCAN_SSE2;
+#elif defined(HAVE_NEON)
+  return WEBVTT_SCAN_NEON;
+#else
+  return WEBVTT_SCAN_SCALAR;
+#endif
+}
+
+WEBVTT_INTERN webvtt_scan_level
+webvtt_get_scan_level( void )
+{
+  int current = LOAD_LEVEL();
+  if( current < 0 ) {
+    current = ( int )detect_level();
+    STORE_LEVEL( current );
+  }
+  return ( webvtt_scan_level )current;
+}
+
+WEBVTT_INTERN webvtt_scan_level
+webvtt_set_scan_level( webvtt_scan_level wanted )
+{
+  webvtt_scan_level best = detect_level();
+  int ok = wanted == WEBVTT_SCAN_SCALAR || wanted == best;
+#if defined(HAVE_SSE2)
+  ok = ok || wanted == WEBVTT_SCAN_SSE2;
+#endif
+  if( ok ) {
+    STORE_LEVEL( ( int )wanted );
+  }
+  return webvtt_get_scan_level();
+}
+
+WEBVTT_INTERN const char *
+webvtt_scan3( const char *p, const char *end, char a, char b, char c )
+{
+  switch( webvtt_get_scan_level() ) {
+#if defined(HAVE_AVX2)
+    case WEBVTT_SCAN_AVX2:
+      return scan3_avx2( p, end, a, b, c );
+#endif
+#if defined(HAVE_SSE2)
+    case WEBVTT_SCAN_SSE2:
+      return scan3_sse2( p, end, a, b, c );
+#endif
+#if defined(HAVE_NEON)
+    case WEBVTT_SCAN_NEON:
+      return scan3_neon( p, end, a, b, c );
+#endif
+    default:
+      return scan3_scalar( p, end, a, b, c );
+  }
+}
+
+WEBVTT_INTERN const char *
+webvtt_scan2( const char *p, const char *end, char a, char b )
+{
+  return webvtt_scan3( p, end, a, b, b );
+}
+
+WEBVTT_INTERN const char *
+webvtt_scan_cstr2( const char *p, char a, char b )
+{
+  switch( webvtt_get_scan_level() ) {
+#if defined(HAVE_AVX2)
+    case WEBVTT_SCAN_AVX2:
+      return scan_cstr2_avx2( p, a, b );
+#endif
+#if defined(HAVE_SSE2)
+    case WEBVTT_SCAN_SSE2:
+      return scan_cstr2_sse2( p, a, b );
+#endif
+#if defined(HAVE_NEON)
+    case WEBVTT_SCAN_NEON:
+      return scan_cstr2_neon( p, a, b );
+#endif
+    default:
+      return scan_cstr2_scalar( p, a, b );
+  }
+}
+
+/**
+ * UTF-8
+ *
+ * Validation is done a sequence at a time by the portable routine. The vector
+ * routines skip over blocks of ASCII, and AVX2 checks whole blocks with the
+ * table lookups of Keiser and Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte". Whenever a block looks wrong, the portable routine
+ * takes over from the start of the sequence it is in to find the exact place.
+ */
+
+/**
+ * Length of the well-formed sequence at 'u', which has 'avail' bytes after it,
+ * or 0 if it is ill-formed.
+ */
+static int
+utf8_sequence( const unsigned char *u, ptrdiff_t avail )
+{
+  unsigned char lo = 0x80, hi = 0xBF;
+  int i, n;
+  if( u[ 0 ] < 0x80 ) {
+    return 1;
+  } else if( u[ 0 ] >= 0xC2 && u[ 0 ] <= 0xDF ) {
+    n = 2;
+  } else if( u[ 0 ] >= 0xE0 && u[ 0 ] <= 0xEF ) {
+    n = 3;
+    if( u[ 0 ] == 0xE0 ) {
+      lo = 0xA0; /* overlong */
+    } else if( u[ 0 ] == 0xED ) {
+      hi = 0x9F; /* surrogate */
+    }
+  } else if( u[ 0 ] >= 0xF0 && u[ 0 ] <= 0xF4 ) {
+    n = 4;
+    if( u[ 0 ] == 0xF0 ) {
+      lo = 0x90; /* overlong */
+    } else if( u[ 0 ] == 0xF4 ) {
+      hi = 0x8F; /* past U+10FFFF */
+    }
+  } else {
+    return 0;
+  }
+
+  if( avail < n || u[ 1 ] < lo || u[ 1 ] > hi ) {
+    return 0;
+  }
+  for( i = 2; i < n; ++i ) {
+    if( ( u[ i ] & 0xC0 ) != 0x80 ) {
+      return 0;
+    }
+  }
+  return n;
+}
+
+static const char *
+utf8_invalid_scalar( const char *p, const char *end )
+{
+  while( p < end ) {
+    int n = utf8_sequence( ( const unsigned char * )p, end - p );
+    if( !n ) {
+      break;
+    }
+    p += n;
+  }
+  return p;
+}
+
+/**
+ * Validate the sequences which begin in [p, stop), returning the first
+ * ill-formed one, or where the last one ends.
+ */
+static const char *
+utf8_invalid_until( const char *p, const char *stop, const char *end )
+{
+  while( p < stop ) {
+    int n = utf8_sequence( ( const unsigned char * )p, end - p );
+    if( !n ) {
+      return 0;
+    }
+    p += n;
+  }
+  return p;
+}
+
+static const char *
+widen_ascii_scalar( const char *p, const char *end, webvtt_uint16 *out )
+{
+  for( ; p < end && ( unsigned char )*p < 0x80; ++p ) {
+    if( out ) {
+      *out++ = ( webvtt_uint16 )*p;
+    }
+  }
+  return p;
+}
+
+static webvtt_uint32
+count_leads_scalar( const char *p, const char *end )
+{
+  webvtt_uint32 n = 0;
+  for( ; p < end; ++p ) {
+    n += ( *p & 0xC0 ) != 0x80;
+  }
+  return n;
+}
+
+#if defined(HAVE_SSE2)
+static const char *
+utf8_invalid_sse2( const char *p, const char *end )
+{
+  while( end - p >= 16 ) {
+    const char *next;
+    if( !_mm_movemask_epi8( _mm_loadu_si128( ( const __m128i * )p ) ) ) {
+      p += 16;
+      continue;
+    }
+    if( !( next = utf8_invalid_until( p, p + 16, end ) ) ) {
+      return utf8_invalid_scalar( p, end );
+    }
+    p = next;
+  }
+  return utf8_invalid_scalar( p, end );
+}
+
+/**
+ * Continuation bytes are the only ones below -64 as signed bytes. The
+ * comparison gives -1 for every other byte, which is subtracted from per-byte
+ * counters; these are summed before they can overflow.
+ */
+static const char *
+widen_ascii_sse2( const char *p, const char *end, webvtt_uint16 *out )
+{
+  const __m128i zero = _mm_setzero_si128();
+  for( ; end - p >= 16; p += 16 ) {
+    __m128i v = _mm_loadu_si128( ( const __m128i * )p );
+    int mask = _mm_movemask_epi8( v );
+    if( out ) {
+      _mm_storeu_si128( ( __m128i * )out, _mm_unpacklo_epi8( v, zero ) );
+      _mm_storeu_si128( ( __m128i * )( out + 8 ), _mm_unpackhi_epi8( v, zero ) );
+      out += 16;
+    }
+    if( mask ) {
+      return p + lowest_bit( ( webvtt_uint32 )mask );
+    }
+  }
+  return widen_ascii_scalar( p, end, out );
+}
+
+static webvtt_uint32
+count_leads_sse2( const char *p, const char *end )
+{
+  const __m128i limit = _mm_set1_epi8( -65 );
+  const __m128i zero = _mm_setzero_si128();
+  webvtt_uint32 n = 0;
+  while( end - p >= 16 ) {
+    __m128i counts = zero, sums;
+    int i;
+    for( i = 0; i < 255 && end - p >= 16; ++i, p += 16 ) {
+      counts = _mm_sub_epi8( counts, _mm_cmpgt_epi8(
+        _mm_loadu_si128( ( const __m128i * )p ), limit ) );
+    }
+    sums = _mm_sad_epu8( counts, zero );
+    n += ( webvtt_uint32 )( _mm_cvtsi128_si32( sums )
+                            + _mm_extract_epi16( sums, 4 ) );
+  }
+  return n + count_leads_scalar( p, end );
+}
+#endif
+
+#if defined(HAVE_AVX2)
+/* The bytes before each byte of 'input', coming from the end of 'prev' */
+# define PREV_AVX2(input,prev,n) _mm256_alignr_epi8( (input), \
+  _mm256_permute2x128_si256( (prev), (input), 0x21 ), 16 - (n) )
+
+/* Errors looked up by the nibbles of a byte and the one before it */
+# define TOO_SHORT  (1 << 0) /* lead or ASCII followed by a lead or ASCII */
+# define TOO_LONG   (1 << 1) /* ASCII followed by a continuation */
+# define OVERLONG_3 (1 << 2) /* E0 followed by 80..9F */
+# define TOO_LARGE  (1 << 3) /* F4 followed by 90..BF, or F5..FF */
+# define SURROGATE  (1 << 4) /* ED followed by A0..BF */
+# define OVERLONG_2 (1 << 5) /* C0 or C1 */
+# define TOO_LARGE_1000 (1 << 6) /* F5..FF followed by 80..8F */
+# define OVERLONG_4 (1 << 6) /* F0 followed by 80..8F */
+# define TWO_CONTS  (1 << 7) /* continuation followed by a continuation */
+# define CARRY ( TOO_SHORT | TOO_LONG | TWO_CONTS )
+# define TABLE16(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p) \
+  _mm256_setr_epi8( a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p, \
+                    a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p )
+
+/**
+ * Non-zero bytes where 'input', following 'prev', is not well-formed, other
+ * than sequences which are cut off at the end of 'input'.
+ */
+static TARGET_AVX2 __m256i
+utf8_errors_avx2( __m256i input, __m256i prev )
+{
+  const __m256i nibble = _mm256_set1_epi8( 0x0F );
+  const __m256i byte_1_high = TABLE16(
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4 );
+  const __m256i byte_1_low = TABLE16(
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 );
+  const __m256i byte_2_high = TABLE16(
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000
+      | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT );
+  __m256i prev1 = PREV_AVX2( input, prev, 1 );
+  __m256i special = _mm256_and_si256( _mm256_and_si256(
+    _mm256_shuffle_epi8( byte_1_high, _mm256_and_si256(
+      _mm256_srli_epi16( prev1, 4 ), nibble ) ),
+    _mm256_shuffle_epi8( byte_1_low, _mm256_and_si256( prev1, nibble ) ) ),
+    _mm256_shuffle_epi8( byte_2_high, _mm256_and_si256(
+      _mm256_srli_epi16( input, 4 ), nibble ) ) );
+
+  /**
+   * The third and fourth bytes of a sequence must be continuations, which
+   * 'special' reports as TWO_CONTS; anything else is an error.
+   */
+  __m256i third = _mm256_subs_epu8( PREV_AVX2( input, prev, 2 ),
+                                    _mm256_set1_epi8( 0xE0 - 0x80 ) );
+  __m256i fourth = _mm256_subs_epu8( PREV_AVX2( input, prev, 3 ),
+                                     _mm256_set1_epi8( ( char )( 0xF0 - 0x80 ) ) );
+  __m256i must_continue = _mm256_and_si256( _mm256_or_si256( third, fourth ),
+                                            _mm256_set1_epi8( ( char )0x80 ) );
+  return _mm256_xor_si256( must_continue, special );
+}
+
+# undef TABLE16
+# undef CARRY
+# undef TWO_CONTS
+# undef OVERLONG_4
+# undef TOO_LARGE_1000
+# undef OVERLONG_2
+# undef SURROGATE
+# undef TOO_LARGE
+# undef OVERLONG_3
+# undef TOO_LONG
+# undef TOO_SHORT
+
+static TARGET_AVX2 const char *
+utf8_invalid_avx2( const char *p, const char *end )
+{
+  /* Non-zero where a sequence starting in the last three bytes is cut off */
+  const __m256i max_tail = _mm256_setr_epi8(
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    ( char )( 0xF0 - 1 ), ( char )( 0xE0 - 1 ), ( char )( 0xC0 - 1 ) );
+  const char *start = p;
+  __m256i prev = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  int i;
+
+  for( ; end - p >= 32; p += 32 ) {
+    __m256i input = _mm256_loadu_si256( ( const __m256i * )p );
+    __m256i error;
+    if( !_mm256_movemask_epi8( input ) ) {
+      error = incomplete;
+      incomplete = _mm256_setzero_si256();
+    } else {
+      error = utf8_errors_avx2( input, prev );
+      incomplete = _mm256_subs_epu8( input, max_tail );
+    }
+    if( !_mm256_testz_si256( error, error ) ) {
+      break;
+    }
+    prev = input;
+  }
+
+  /* Go back to the start of the sequence which is still open at 'p' */
+  for( i = 1; i <= 3 && p - i >= start; ++i ) {
+    unsigned char c = ( unsigned char )p[ -i ];
+    if( c >= 0xC0 ) {
+      p -= i;
+      break;
+    } else if( c < 0x80 ) {
+      break;
+    }
+  }
+  return utf8_invalid_scalar( p, end );
+}
+
+static TARGET_AVX2 const char *
+widen_ascii_avx2( const char *p, const char *end, webvtt_uint16 *out )
+{
+  for( ; end - p >= 32; p += 32 ) {
+    __m256i v = _mm256_loadu_si256( ( const __m256i * )p );
+    webvtt_uint32 mask = ( webvtt_uint32 )_mm256_movemask_epi8( v );
+    if( out ) {
+      _mm256_storeu_si256( ( __m256i * )out,
+        _mm256_cvtepu8_epi16( _mm256_castsi256_si128( v ) ) );
+      _mm256_storeu_si256( ( __m256i * )( out + 16 ),
+        _mm256_cvtepu8_epi16( _mm256_extracti128_si256( v, 1 ) ) );
+      out += 32;
+    }
+    if( mask ) {
+      return p + lowest_bit( mask );
+    }
+  }
+  return widen_ascii_sse2( p, end, out );
+}
+
+static TARGET_AVX2 webvtt_uint32
+count_leads_avx2( const char *p, const char *end )
+{
+  const __m256i limit = _mm256_set1_epi8( -65 );
+  const __m256i zero = _mm256_setzero_si256();
+  webvtt_uint32 n = 0;
+  while( end - p >= 32 ) {
+    __m256i counts = zero, sums;
+    __m128i half;
+    int i;
+    for( i = 0; i < 255 && end - p >= 32; ++i, p += 32 ) {
+      counts = _mm256_sub_epi8( counts, _mm256_cmpgt_epi8(
+        _mm256_loadu_si256( ( const __m256i * )p ), limit ) );
+    }
+    sums = _mm256_sad_epu8( counts, zero );
+    half = _mm_add_epi64( _mm256_castsi256_si128( sums ),
+                          _mm256_extracti128_si256( sums, 1 ) );
+    n += ( webvtt_uint32 )( _mm_cvtsi128_si32( half )
+                            + _mm_extract_epi16( half, 4 ) );
+  }
+  return n + count_leads_sse2( p, end );
+}
+#endif
+
+#if defined(HAVE_NEON)
+static const char *
+utf8_invalid_neon( const char *p, const char *end )
+{
+  const int8x16_t zero = vdupq_n_s8( 0 );
+  while( end - p >= 16 ) {
+    const char *next;
+    uint8x16_t high = vcltq_s8( vld1q_s8( ( const int8_t * )p ), zero );
+    if( !vget_lane_u64( vreinterpret_u64_u8( vshrn_n_u16(
+          vreinterpretq_u16_u8( high ), 4 ) ), 0 ) ) {
+      p += 16;
+      continue;
+    }
+    if( !( next = utf8_invalid_until( p, p + 16, end ) ) ) {
+      return utf8_invalid_scalar( p, end );
+    }
+    p = next;
+  }
+  return utf8_invalid_scalar( p, end );
+}
+
+static const char *
+widen_ascii_neon( const char *p, const char *end, webvtt_uint16 *out )
+{
+  const int8x16_t zero = vdupq_n_s8( 0 );
+  for( ; end - p >= 16; p += 16 ) {
+    int8x16_t v = vld1q_s8( ( const int8_t * )p );
+    webvtt_uint64 mask = vget_lane_u64( vreinterpret_u64_u8( vshrn_n_u16(
+      vreinterpretq_u16_u8( vcltq_s8( v, zero ) ), 4 ) ), 0 );
+    if( out ) {
+      uint8x16_t u = vreinterpretq_u8_s8( v );
+      vst1q_u16( out, vmovl_u8( vget_low_u8( u ) ) );
+      vst1q_u16( out + 8, vmovl_u8( vget_high_u8( u ) ) );
+      out += 16;
+    }
+    if( mask ) {
+      return p + lowest_nibble( mask );
+    }
+  }
+  return widen_ascii_scalar( p, end, out );
+}
+
+static webvtt_uint32
+count_leads_neon( const char *p, const char *end )
+{
+  const int8x16_t limit = vdupq_n_s8( -65 );
+  webvtt_uint32 n = 0;
+  while( end - p >= 16 ) {
+    uint8x16_t counts = vdupq_n_u8( 0 );
+    uint64x2_t sums;
+    int i;
+    for( i = 0; i < 255 && end - p >= 16; ++i, p += 16 ) {
+      counts = vsubq_u8( counts, vcgtq_s8( vld1q_s8( ( const int8_t * )p ),
+                                           limit ) );
+    }
+    sums = vpaddlq_u32( vpaddlq_u16( vpaddlq_u8( counts ) ) );
+    n += ( webvtt_uint32 )( vgetq_lane_u64( sums, 0 )
+                            + vgetq_lane_u64( sums, 1 ) );
+  }
+  return n + count_leads_scalar( p, end );
+}
+#endif
+
+WEBVTT_INTERN const char *
+webvtt_scan_utf8_invalid( const char *p, const char *end )
+{
+  switch( webvtt_get_scan_level() ) {
+#if defined(HAVE_AVX2)
+    case WEBVTT_SCAN_AVX2:
+      return utf8_invalid_avx2( p, end );
+#endif
+#if defined(HAVE_SSE2)
+    case WEBVTT_SCAN_SSE2:
+      return utf8_invalid_sse2( p, end );
+#endif
+#if defined(HAVE_NEON)
+    case WEBVTT_SCAN_NEON:
+      return utf8_invalid_neon( p, end );
+#endif
+    default:
+      return utf8_invalid_scalar( p, end );
+  }
+}
+
+WEBVTT_INTERN webvtt_uint32
+webvtt_count_utf8_leads( const char *p, const char *end )
+{
+  switch( webvtt_get_scan_level() ) {
+#if defined(HAVE_AVX2)
+    case WEBVTT_SCAN_AVX2:
+      return count_leads_avx2( p, end );
+#endif
+#if defined(HAVE_SSE2)
+    case WEBVTT_SCAN_SSE2:
+      return count_leads_sse2( p, end );
+#endif
+#if defined(HAVE_NEON)
+    case WEBVTT_SCAN_NEON:
+      return count_leads_neon( p, end );
+#endif
+    default:
+      return count_leads_scalar( p, end );
+  }
+}
+
+WEBVTT_INTERN int
+webvtt_utf8_sequence( const char *p, const char *end )
+{
+  return p < end ? utf8_sequence( ( const unsigned char * )p, end - p ) : 0;
+}
+
+WEBVTT_INTERN const char *
+webvtt_widen_ascii( const char *p, const char *end, webvtt_uint16 *out )
+{
+  switch( webvtt_get_scan_level() ) {
+#if defined(HAVE_AVX2)
+    case WEBVTT_SCAN_AVX2:
+      return widen_ascii_avx2( p, end, out );
+#endif
+#if defined(HAVE_SSE2)
+    case WEBVTT_SCAN_SSE2:
+      return widen_ascii_sse2( p, end, out );
+#endif
+#if defined(HAVE_NEON)
+    case WEBVTT_SCAN_NEON:
+      return widen_ascii_neon( p, end, out );
+#endif
+    default:
+      return widen_ascii_scalar( p, end, out );
+  }
+}
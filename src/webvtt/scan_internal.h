@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2013 Mozilla Foundation and Contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __INTERN_SCAN_H__
+# define __INTERN_SCAN_H__
+# include <webvtt/util.h>
+
+/**
+ * Use vector instructions to look for delimiters in text. Without this, or on
+ * processors for which there are no vector routines, plain loops are used.
+ */
+# ifndef WEBVTT_SIMD
+#   define WEBVTT_SIMD 1
+# endif
+
+typedef enum
+webvtt_scan_level_t {
+  WEBVTT_SCAN_SCALAR = 0,
+  WEBVTT_SCAN_SSE2,
+  WEBVTT_SCAN_AVX2,
+  WEBVTT_SCAN_NEON
+} webvtt_scan_level;
+
+/**
+ * The routines in use, which are picked by looking at the processor the first
+ * time they are needed.
+ */
+WEBVTT_INTERN webvtt_scan_level webvtt_get_scan_level( void );
+
+/**
+ * Use the routines of 'level' from now on, if the processor supports them.
+ * Returns the level in use afterwards. Meant for tests and benchmarks; not to
+ * be called while other threads are parsing.
+ */
+WEBVTT_INTERN webvtt_scan_level webvtt_set_scan_level( webvtt_scan_level level );
+
+/**
+ * Return the first byte in [p, end) which is 'a' or 'b', or 'end' if there is
+ * none.
+ */
+WEBVTT_INTERN const char *webvtt_scan2( const char *p, const char *end,
+                                        char a, char b );
+
+/**
+ * Return the first byte in [p, end) which is 'a', 'b' or 'c', or 'end' if
+ * there is none.
+ */
+WEBVTT_INTERN const char *webvtt_scan3( const char *p, const char *end,
+                                        char a, char b, char c );
+
+/**
+ * Return the first byte of the NUL-terminated text at 'p' which is 'a', 'b' or
+ * the terminator.
+ *
+ * The vector routines read whole aligned blocks, so they may look at bytes
+ * after the terminator, but never past the end of the block containing it.
+ */
+WEBVTT_INTERN const char *webvtt_scan_cstr2( const char *p, char a, char b );
+
+/**
+ * Return the first byte of the first sequence in [p, end) which is not
+ * well-formed UTF-8, or 'end' if there is none. Overlong forms, surrogates,
+ * code points past U+10FFFF and sequences cut off by 'end' are all
+ * ill-formed.
+ */
+WEBVTT_INTERN const char *webvtt_scan_utf8_invalid( const char *p,
+                                                    const char *end );
+
+/**
+ * Return the number of bytes in [p, end) which are not UTF-8 continuation
+ * bytes. For well-formed text, that is the number of code points.
+ */
+WEBVTT_INTERN webvtt_uint32 webvtt_count_utf8_leads( const char *p,
+                                                     const char *end );
+
+/**
+ * Return the length of the well-formed UTF-8 sequence at 'p', or 0 if the
+ * sequence there is ill-formed or cut off by 'end'.
+ */
+WEBVTT_INTERN int webvtt_utf8_sequence( const char *p, const char *end );
+
+/**
+ * Return the first byte in [p, end) which is not ASCII, or 'end' if there is
+ * none. Unless 'out' is null, the bytes before it are written there as UTF-16;
+ * 'out' must have room for all of [p, end), as the vector routines may write
+ * whole blocks.
+ */
+WEBVTT_INTERN const char *webvtt_widen_ascii( const char *p, const char *end,
+                                              webvtt_uint16 *out );
+
+# define webvtt_scan_eol(p,end) webvtt_scan2( (p), (end), '\r', '\n' )
+
+#endif
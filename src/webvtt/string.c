@@ -26,9 +26,14 @@
  */
 
 #include "string_internal.h"
+#include "alloc_internal.h"
+#include "scan_internal.h"
 #include <stdlib.h>
 #include <string.h>
 
+/* UTF8 encoding of U+FFFD REPLACEMENT CHAR */
+static const char replacement[] = { ( char )0xEF, ( char )0xBF, ( char )0xBD };
+
 /* TODO: Use libc implementation if we have one */
 
 void *
@@ -72,12 +77,102 @@ static webvtt_string_data empty_string = {
   { '\0' } /* array */
 };
 
+/**
+ * 'inline_string' is never looked at; a string whose data pointer refers to it
+ * keeps its text in 'inline_text'. The last byte of that buffer holds the
+ * number of unused bytes, so that it doubles as the NUL terminator when the
+ * buffer is full.
+ */
+static webvtt_string_data inline_string;
+
+#define INLINE_CAPACITY ( WEBVTT_STRING_INLINE_SIZE - 1 )
+#define IS_INLINE(str) ( (str)->d == &inline_string )
+#define INLINE_LENGTH(str) ( ( webvtt_uint32 )( INLINE_CAPACITY \
+  - ( unsigned char )(str)->inline_text[ INLINE_CAPACITY ] ) )
+
+/**
+ * Likewise, a string whose data pointer refers to 'borrowed_string' keeps a
+ * webvtt_string_view of somebody else's text in 'inline_text'.
+ */
+static webvtt_string_data borrowed_string;
+
+#define IS_BORROWED(str) ( (str)->d == &borrowed_string )
+
+static void
+get_borrowed( const webvtt_string *str, webvtt_string_view *view )
+{
+  memcpy( view, str->inline_text, sizeof( *view ) );
+}
+
+static void
+set_borrowed( webvtt_string *str, const char *text, webvtt_uint32 length )
+{
+  webvtt_string_view view;
+  view.text = text;
+  view.length = length;
+  str->d = &borrowed_string;
+  memcpy( str->inline_text, &view, sizeof( view ) );
+}
+
+/**
+ * 'empty_string' is shared by every empty string and is never freed, so its
+ * reference count is left alone. Objects whose teardown is skipped because
+ * they live in an arena can therefore never overflow it.
+ */
+static void
+retain_data( webvtt_string_data *d )
+{
+  if( d != &empty_string && d != &inline_string && d != &borrowed_string ) {
+    webvtt_ref( &d->refs );
+  }
+}
+
+static void
+release_data( webvtt_string_data *d )
+{
+  if( d && d != &empty_string && d != &inline_string && d != &borrowed_string
+      && webvtt_deref( &d->refs ) == 0 ) {
+    webvtt_pool_free( d );
+  }
+}
+
+/**
+ * Writable text of a string which is either inline or has heap data
+ */
+static char *
+string_buffer( webvtt_string *str )
+{
+  return IS_INLINE( str ) ? str->inline_text : str->d->text;
+}
+
+/**
+ * Set the length of a string which is either inline or has heap data, and
+ * terminate it.
+ */
+static void
+set_length( webvtt_string *str, webvtt_uint32 length )
+{
+  if( IS_INLINE( str ) ) {
+    str->inline_text[ length ] = 0;
+    str->inline_text[ INLINE_CAPACITY ] = ( char )( INLINE_CAPACITY - length );
+  } else {
+    str->d->length = length;
+    str->d->text[ length ] = 0;
+  }
+}
+
+static void
+set_inline( webvtt_string *str )
+{
+  str->d = &inline_string;
+  set_length( str, 0 );
+}
+
 WEBVTT_EXPORT void
 webvtt_init_string( webvtt_string *result )
 {
   if( result ) {
     result->d = &empty_string;
-    webvtt_ref( &result->d->refs );
   }
 }
 
@@ -98,8 +193,13 @@ webvtt_create_string( webvtt_uint32 alloc, webvtt_string *result )
     return WEBVTT_INVALID_PARAM;
   }
 
-  d = ( webvtt_string_data * )webvtt_alloc( sizeof( webvtt_string_data ) +
-                                            ( alloc * sizeof( char ) ) );
+  if( alloc <= INLINE_CAPACITY ) {
+    set_inline( result );
+    return WEBVTT_SUCCESS;
+  }
+
+  d = ( webvtt_string_data * )webvtt_pool_alloc( sizeof( webvtt_string_data )
+                                                 + ( alloc * sizeof( char ) ) );
 
   if( !d ) {
     return WEBVTT_OUT_OF_MEMORY;
@@ -148,6 +248,61 @@ webvtt_create_string_with_text( webvtt_string *out, const char *init_text,
   return webvtt_string_append( out, init_text, len );
 }
 
+WEBVTT_EXPORT webvtt_status
+webvtt_create_borrowed_string( webvtt_string *out, const char *text, int len )
+{
+  if( !out || !text ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+
+  if( len < 0 ) {
+    len = strlen( text );
+  }
+
+  set_borrowed( out, text, ( webvtt_uint32 )len );
+  return WEBVTT_SUCCESS;
+}
+
+WEBVTT_EXPORT webvtt_bool
+webvtt_string_is_borrowed( const webvtt_string *str )
+{
+  return str && IS_BORROWED( str );
+}
+
+WEBVTT_EXPORT void
+webvtt_string_get_view( const webvtt_string *str, webvtt_string_view *view )
+{
+  if( view ) {
+    view->text = webvtt_string_text( str );
+    view->length = webvtt_string_length( str );
+  }
+}
+
+WEBVTT_INTERN webvtt_bool
+webvtt_string_extend_borrowed( webvtt_string *str, const char *text,
+                               webvtt_uint32 len )
+{
+  webvtt_string_view view;
+
+  if( !str->d || webvtt_string_length( str ) == 0 ) {
+    webvtt_release_string( str );
+    set_borrowed( str, text, len );
+    return 1;
+  }
+
+  if( !IS_BORROWED( str ) ) {
+    return 0;
+  }
+
+  get_borrowed( str, &view );
+  if( view.text + view.length != text ) {
+    return 0;
+  }
+
+  set_borrowed( str, view.text, view.length + len );
+  return 1;
+}
+
 /**
  * reference counting
  */
@@ -155,7 +310,7 @@ WEBVTT_EXPORT void
 webvtt_ref_string( webvtt_string *str )
 {
   if( str ) {
-    webvtt_ref( &str->d->refs );
+    retain_data( str->d );
   }
 }
 
@@ -168,9 +323,7 @@ webvtt_release_string( webvtt_string *str )
   if( str ) {
     webvtt_string_data *d = str->d;
     str->d = 0;
-    if( d && webvtt_deref( &d->refs ) == 0 ) {
-      webvtt_free( d );
-    }
+    release_data( d );
   }
 }
 
@@ -188,24 +341,34 @@ webvtt_string_detach( /* in, out */ webvtt_string *str )
 
   q = str->d;
 
-  if( q->refs.value == 1 ) {
+  /* Borrowed strings are copied as soon as they are about to change */
+  if( q && IS_BORROWED( str ) ) {
+    webvtt_string_view view;
+    get_borrowed( str, &view );
+    return webvtt_create_string_with_text( str, view.text, view.length );
+  }
+
+  /* Inline strings are never shared */
+  if( !q || IS_INLINE( str ) || webvtt_ref_count( &q->refs ) == 1 ) {
     return WEBVTT_SUCCESS;
   }
 
-  d = ( webvtt_string_data * )webvtt_alloc( sizeof( webvtt_string_data ) +
-                                           ( sizeof( char ) * str->d->alloc ) );
+  d = ( webvtt_string_data * )webvtt_pool_alloc( sizeof( webvtt_string_data )
+                                       + ( sizeof( char ) * str->d->alloc ) );
+  if( !d ) {
+    return WEBVTT_OUT_OF_MEMORY;
+  }
 
   d->refs.value = 1;
   d->text = d->array;
   d->alloc = q->alloc;
   d->length = q->length;
   memcpy( d->text, q->text, q->length );
+  d->text[ d->length ] = 0;
 
   str->d = d;
 
-  if( webvtt_deref( &q->refs ) == 0 ) {
-    webvtt_free( q );
-  }
+  release_data( q );
 
   return WEBVTT_SUCCESS;
 }
@@ -215,11 +378,11 @@ webvtt_copy_string( webvtt_string *left, const webvtt_string *right )
 {
   if( left ) {
     if( right && right->d ) {
-      left->d = right->d;
+      *left = *right;
     } else {
       left->d = &empty_string;
     }
-    webvtt_ref( &left->d->refs );
+    retain_data( left->d );
   }
 }
 
@@ -231,7 +394,13 @@ webvtt_string_text(const webvtt_string *str)
     return 0;
   }
 
-  return str->d->text;
+  if( IS_BORROWED( str ) ) {
+    webvtt_string_view view;
+    get_borrowed( str, &view );
+    return view.text;
+  }
+
+  return IS_INLINE( str ) ? str->inline_text : str->d->text;
 }
 
 WEBVTT_EXPORT webvtt_uint32
@@ -242,7 +411,13 @@ webvtt_string_length(const webvtt_string *str)
     return 0;
   }
 
-  return str->d->length;
+  if( IS_BORROWED( str ) ) {
+    webvtt_string_view view;
+    get_borrowed( str, &view );
+    return view.length;
+  }
+
+  return IS_INLINE( str ) ? INLINE_LENGTH( str ) : str->d->length;
 }
 
 WEBVTT_EXPORT webvtt_uint32
@@ -253,19 +428,67 @@ webvtt_string_capacity(const webvtt_string *str)
     return 0;
   }
 
-  return str->d->alloc;
+  if( IS_BORROWED( str ) ) {
+    return webvtt_string_length( str );
+  }
+
+  return IS_INLINE( str ) ? INLINE_CAPACITY : str->d->alloc;
+}
+
+/**
+ * Move the text of 'str' into a new heap block of 'n' bytes, or into the
+ * string itself if it leaves room for 'need' more bytes and still fits.
+ */
+static webvtt_status
+reallocate( webvtt_string *str, webvtt_uint32 n, webvtt_uint need )
+{
+  webvtt_uint32 length = webvtt_string_length( str );
+  const char *text = webvtt_string_text( str );
+  webvtt_string_data *p, *d = str->d;
+
+  if( length + need <= INLINE_CAPACITY ) {
+    /* Only reached by strings without room, such as 'empty_string', or by
+       borrowed strings and strings given back their slack */
+    if( length ) {
+      memmove( str->inline_text, text, length );
+    }
+    str->d = &inline_string;
+    set_length( str, length );
+    release_data( d );
+    return WEBVTT_SUCCESS;
+  }
+
+  p = ( webvtt_string_data * )webvtt_pool_alloc( n );
+
+  if( !p ) {
+    return WEBVTT_OUT_OF_MEMORY;
+  }
+
+  p->refs.value = 1;
+  p->alloc = ( n - sizeof( *p ) ) / sizeof( char );
+  p->length = length;
+  p->text = p->array;
+  if( length ) {
+    memcpy( p->text, text, sizeof( char ) * length );
+  }
+  p->text[ p->length ] = 0;
+  str->d = p;
+
+  release_data( d );
+
+  return WEBVTT_SUCCESS;
 }
 
 /**
  * Reallocate string.
- * Grow to at least 'need' characters. Power of 2 growth.
+ * Make room for 'need' more characters. Power of 2 growth. Strings which still
+ * fit are kept inline. Borrowed strings are always given their own copy.
  */
 static webvtt_status
 grow( webvtt_string *str, webvtt_uint need )
 {
   static const webvtt_uint page = 0x1000;
-  webvtt_uint32 n;
-  webvtt_string_data *p, *d;
+  webvtt_uint32 n, length;
   webvtt_uint32 grow;
 
   if( !str )
@@ -273,13 +496,14 @@ grow( webvtt_string *str, webvtt_uint need )
     return WEBVTT_INVALID_PARAM;
   }
 
-  if( ( str->d->length + need ) <= str->d->alloc )
+  length = webvtt_string_length( str );
+  if( !IS_BORROWED( str )
+      && ( length + need ) <= webvtt_string_capacity( str ) )
   {
     return WEBVTT_SUCCESS;
   }
 
-  p = d = str->d;
-  grow = sizeof( *d ) + ( sizeof( char ) * ( d->length + need ) );
+  grow = sizeof( webvtt_string_data ) + ( sizeof( char ) * ( length + need ) );
 
   if( grow < page ) {
     n = page;
@@ -298,25 +522,65 @@ grow( webvtt_string *str, webvtt_uint need )
     } while ( n < grow );
   }
 
-  p = ( webvtt_string_data * )webvtt_alloc( n );
+  return reallocate( str, n, need );
+}
 
-  if( !p ) {
-    return WEBVTT_OUT_OF_MEMORY;
+WEBVTT_EXPORT webvtt_status
+webvtt_string_reserve( webvtt_string *str, webvtt_uint32 capacity )
+{
+  webvtt_status status;
+  webvtt_uint32 length;
+
+  if( !str ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+  if( !str->d ) {
+    webvtt_init_string( str );
   }
 
-  p->refs.value = 1;
-  p->alloc = ( n - sizeof( *p ) ) / sizeof( char );
-  p->length = d->length;
-  p->text = p->array;
-  memcpy( p->text, d->text, sizeof( char ) * p->length );
-  p->text[ p->length ] = 0;
-  str->d = p;
+  if( WEBVTT_FAILED( status = webvtt_string_detach( str ) ) ) {
+    return status;
+  }
 
-  if( webvtt_deref( &d->refs ) == 0 ) {
-    webvtt_free( d );
+  if( capacity <= webvtt_string_capacity( str ) ) {
+    return WEBVTT_SUCCESS;
   }
 
-  return WEBVTT_SUCCESS;
+  /* Reserve exactly what was asked for; the caller knows best */
+  length = webvtt_string_length( str );
+  return reallocate( str, sizeof( webvtt_string_data ) + capacity,
+                     capacity - length );
+}
+
+WEBVTT_EXPORT webvtt_status
+webvtt_string_shrink_to_fit( webvtt_string *str )
+{
+  webvtt_uint32 length;
+
+  if( !str ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+
+  /**
+   * Inline and borrowed strings have no slack to give back, and giving a
+   * shared string its own copy would only cost more memory.
+   */
+  if( !str->d || str->d == &empty_string || IS_INLINE( str )
+      || IS_BORROWED( str ) || webvtt_ref_count( &str->d->refs ) != 1 ) {
+    return WEBVTT_SUCCESS;
+  }
+
+  length = webvtt_string_length( str );
+  if( length == str->d->alloc ) {
+    return WEBVTT_SUCCESS;
+  }
+  if( length == 0 ) {
+    webvtt_release_string( str );
+    webvtt_init_string( str );
+    return WEBVTT_SUCCESS;
+  }
+
+  return reallocate( str, sizeof( webvtt_string_data ) + length, 0 );
 }
 
 WEBVTT_EXPORT int
@@ -326,10 +590,11 @@ webvtt_string_getline( webvtt_string *src, const char *buffer,
 {
   int ret = 0;
   webvtt_string *str = src;
-  webvtt_string_data *d = 0;
+  webvtt_uint32 length;
   const char *s = buffer + *pos;
   const char *p = s;
   const char *n;
+  webvtt_bool nul, truncated = 0;
 
   /**
    *if this is public now, maybe we should return webvtt_status so we can
@@ -340,45 +605,58 @@ webvtt_string_getline( webvtt_string *src, const char *buffer,
   }
 
   /* This had better be a valid string_data, or else NULL. */
-  d = str->d;
   if( !str->d ) {
     if(WEBVTT_FAILED(webvtt_create_string( 0x100, str ))) {
       return -1;
     }
-    d = str->d;
   }
   if( len < 0 ) {
     len = strlen( buffer );
   }
   n = buffer + len;
 
-  while( p < n && *p != '\r' && *p != '\n' ) {
-    ++p;
-  }
-
-  if( p < n || finish ) {
-    ret = 1; /* indicate that we found EOL */
-  }
-  len = (webvtt_uint)( p - s );
-  *pos += len;
-  if( d->length + len + 1 >= d->alloc ) {
-    if( truncate && d->alloc >= WEBVTT_MAX_LINE ) {
-      /* truncate. */
-      (*truncate)++;
-    } else {
-      if( grow( str, len + 1 ) == WEBVTT_OUT_OF_MEMORY ) {
+  /**
+   * Copy the line a run at a time, stopping at each NUL to put U+FFFD in its
+   * place, so that the line is only looked at once.
+   */
+  length = webvtt_string_length( str );
+  for( ;; ) {
+    webvtt_uint32 run, need;
+    p = webvtt_scan3( s, n, '\r', '\n', '\0' );
+    nul = p < n && *p == '\0';
+    run = ( webvtt_uint32 )( p - s );
+    need = run + ( nul ? sizeof( replacement ) : 0 );
+    if( need && !truncated && ret >= 0
+        && length + need + 1 >= webvtt_string_capacity( str ) ) {
+      if( truncate && webvtt_string_capacity( str ) >= WEBVTT_MAX_LINE ) {
+        /* truncate. */
+        (*truncate)++;
+        truncated = 1;
+      } else if( grow( str, need + 1 ) == WEBVTT_OUT_OF_MEMORY ) {
         ret = -1;
       }
-      d = str->d;
     }
+
+    if( need && !truncated && ret >= 0 ) {
+      char *text = string_buffer( str ) + length;
+      memcpy( text, s, run );
+      if( nul ) {
+        memcpy( text + run, replacement, sizeof( replacement ) );
+      }
+      length += need;
+      set_length( str, length );
+    }
+
+    if( !nul ) {
+      break;
+    }
+    s = p + 1;
   }
 
-  /* Copy everything in */
-  if( len && ret >= 0 && d->length + len < d->alloc ) {
-    memcpy( d->text + d->length, s, len );
-    d->length += len;
-    d->text[ d->length ] = 0;
+  if( ret == 0 && ( p < n || finish ) ) {
+    ret = 1; /* indicate that we found EOL */
   }
+  *pos = ( webvtt_uint )( p - buffer );
 
   return ret;
 }
@@ -398,13 +676,54 @@ webvtt_string_putc( webvtt_string *str, char to_append )
 
   if( !WEBVTT_FAILED( result = grow( str, 1 ) ) )
   {
-    str->d->text[ str->d->length++ ] = to_append;
-    str->d->text[ str->d->length ] = 0;
+    webvtt_uint32 length = webvtt_string_length( str );
+    string_buffer( str )[ length ] = to_append;
+    set_length( str, length + 1 );
   }
 
   return result;
 }
 
+WEBVTT_INTERN webvtt_status
+webvtt_string_truncate( webvtt_string *str, webvtt_uint32 length )
+{
+  webvtt_status status;
+
+  if( !str || !str->d ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+
+  if( length >= webvtt_string_length( str ) ) {
+    return WEBVTT_SUCCESS;
+  }
+
+  if( IS_BORROWED( str ) ) {
+    set_borrowed( str, webvtt_string_text( str ), length );
+    return WEBVTT_SUCCESS;
+  }
+
+  if( WEBVTT_FAILED( status = webvtt_string_detach( str ) ) ) {
+    return status;
+  }
+
+  set_length( str, length );
+  return WEBVTT_SUCCESS;
+}
+
+WEBVTT_INTERN void
+webvtt_string_clear( webvtt_string *str )
+{
+  if( !str->d || str->d == &empty_string ) {
+    return;
+  }
+  if( IS_INLINE( str )
+      || ( !IS_BORROWED( str ) && webvtt_ref_count( &str->d->refs ) == 1 ) ) {
+    set_length( str, 0 );
+  } else {
+    webvtt_release_string( str );
+  }
+}
+
 WEBVTT_EXPORT webvtt_bool
 webvtt_string_is_equal( const webvtt_string *str, const char *to_compare,
                         int len )
@@ -417,7 +736,7 @@ webvtt_string_is_equal( const webvtt_string *str, const char *to_compare,
     len = strlen( to_compare );
   }
 
-  if( str->d->length != (unsigned)len ) {
+  if( webvtt_string_length( str ) != (unsigned)len ) {
     return 0;
   }
 
@@ -428,6 +747,7 @@ WEBVTT_EXPORT webvtt_status
 webvtt_string_append( webvtt_string *str, const char *buffer, int len )
 {
   webvtt_status result;
+  webvtt_uint32 length;
 
   if( !str || !buffer ) {
     return WEBVTT_INVALID_PARAM;
@@ -444,11 +764,11 @@ webvtt_string_append( webvtt_string *str, const char *buffer, int len )
     return WEBVTT_SUCCESS;
   }
 
-  if( !WEBVTT_FAILED( result = grow( str, str->d->length + len ) ) ) {
-    memcpy( str->d->text + str->d->length, buffer, len );
-    str->d->length += len;
+  length = webvtt_string_length( str );
+  if( !WEBVTT_FAILED( result = grow( str, len ) ) ) {
+    memcpy( string_buffer( str ) + length, buffer, len );
     /* null-terminate string */
-    str->d->text[ str->d->length ] = 0;
+    set_length( str, length + len );
   }
 
   return result;
@@ -461,7 +781,8 @@ WEBVTT_EXPORT webvtt_status
     return WEBVTT_INVALID_PARAM;
   }
 
-  return webvtt_string_append( str, other->d->text, other->d->length );
+  return webvtt_string_append( str, webvtt_string_text( other ),
+                               webvtt_string_length( other ) );
 }
 
 WEBVTT_EXPORT webvtt_status
@@ -469,6 +790,7 @@ webvtt_string_replace( webvtt_string *str, const char *search, int search_len,
                        const char *replace, int replace_len )
 {
   webvtt_status status = WEBVTT_SUCCESS;
+  webvtt_uint32 length;
   char *p;
   if( !str || !search || !replace ) {
     return WEBVTT_INVALID_PARAM;
@@ -482,22 +804,22 @@ webvtt_string_replace( webvtt_string *str, const char *search, int search_len,
     replace_len = ( int )strlen( replace );
   }
 
-  if( ( p = (char *)memmem( str->d->text, str->d->length, search,
+  length = webvtt_string_length( str );
+  if( ( p = (char *)memmem( webvtt_string_text( str ), length, search,
                             search_len ) ) ) {
     const char *end;
-    size_t pos = p - str->d->text;
+    size_t pos = p - webvtt_string_text( str );
     if( WEBVTT_FAILED( status = grow( str, replace_len ) ) ) {
       return status;
     }
-    p = str->d->text + pos;
-    end = str->d->text + str->d->length - 1; /* Don't worry about the NULL
+    p = string_buffer( str ) + pos;
+    end = string_buffer( str ) + length - 1; /* Don't worry about the NULL
                                               * byte. */
     if( search_len != replace_len ) {
       memmove( p + replace_len, p + search_len, end - p );
     }
     memcpy( p, replace, replace_len );
-    str->d->length = ( str->d->length - search_len ) + replace_len;
-    str->d->text[ str->d->length ] = 0;
+    set_length( str, ( length - search_len ) + replace_len );
     status = ( webvtt_status )1;
   }
   return status;
@@ -513,7 +835,9 @@ webvtt_string_replace_all( webvtt_string *str, const char *search,
                            int search_len, const char *replace,
                            int replace_len )
 {
-  webvtt_status status = WEBVTT_SUCCESS;
+  webvtt_status status;
+  webvtt_string result;
+  const char *text, *end, *p;
   if( !str || !search || !replace ) {
     return WEBVTT_INVALID_PARAM;
   }
@@ -526,9 +850,46 @@ webvtt_string_replace_all( webvtt_string *str, const char *search,
     replace_len = ( int )strlen( replace );
   }
 
-  while( ( status = webvtt_string_replace( str, search, search_len, replace,
-                                           replace_len ) ) == 1 );
-  return status;
+  if( search_len == 0 ) {
+    return WEBVTT_INVALID_PARAM;
+  }
+
+  text = webvtt_string_text( str );
+  end = text + webvtt_string_length( str );
+  if( !( p = ( const char * )memmem( text, end - text, search,
+                                     search_len ) ) ) {
+    return WEBVTT_SUCCESS;
+  }
+
+  /**
+   * Build the result in one pass, rather than searching from the start and
+   * moving the tail along for every match.
+   */
+  if( WEBVTT_FAILED( status = webvtt_create_string( ( webvtt_uint32 )( end - text ),
+                                                   &result ) ) ) {
+    return status;
+  }
+  do {
+    if( WEBVTT_FAILED( status = webvtt_string_append( &result, text,
+                                                      ( int )( p - text ) ) )
+        || WEBVTT_FAILED( status = webvtt_string_append( &result, replace,
+                                                         replace_len ) ) ) {
+      webvtt_release_string( &result );
+      return status;
+    }
+    text = p + search_len;
+  } while( ( p = ( const char * )memmem( text, end - text, search,
+                                         search_len ) ) );
+
+  if( WEBVTT_FAILED( status = webvtt_string_append( &result, text,
+                                                    ( int )( end - text ) ) ) ) {
+    webvtt_release_string( &result );
+    return status;
+  }
+
+  webvtt_release_string( str );
+  *str = result;
+  return WEBVTT_SUCCESS;
 }
 
 /**
@@ -543,7 +904,8 @@ webvtt_create_stringlist( webvtt_stringlist **result )
     return WEBVTT_INVALID_PARAM;
   }
 
-  list = ( webvtt_stringlist * )webvtt_alloc0( sizeof( *list ) );
+  list = ( webvtt_stringlist * )webvtt_alloc0_kind( sizeof( *list ),
+                                                 WEBVTT_ALLOC_STRINGLIST );
 
   if( !list ) {
     return WEBVTT_OUT_OF_MEMORY;
@@ -586,7 +948,8 @@ webvtt_release_stringlist( webvtt_stringlist **list )
   }
   l = *list;
 
-  if( webvtt_deref( &l->refs ) == 0 ) {
+  /* Arena-allocated lists (and their items) go away with the arena. */
+  if( webvtt_deref( &l->refs ) == 0 && !webvtt_is_arena_allocated( l ) ) {
     if( l->items ) {
       for( i = 0; i < l->length; i++ ) {
         webvtt_release_string( &l->items[ i ] );
@@ -609,8 +972,9 @@ webvtt_stringlist_push( webvtt_stringlist *list, webvtt_string *str )
     webvtt_string *arr, *old;
 
     list->alloc = list->alloc == 0 ? 8 : list->alloc * 2;
-    arr = ( webvtt_string * )webvtt_alloc0( sizeof( webvtt_string ) *
-                                            list->alloc );
+    arr = ( webvtt_string * )webvtt_alloc0_kind( sizeof( webvtt_string ) *
+                                                 list->alloc,
+                                                 WEBVTT_ALLOC_STRINGLIST );
 
     if( !arr ) {
       return WEBVTT_OUT_OF_MEMORY;
@@ -623,8 +987,7 @@ webvtt_stringlist_push( webvtt_stringlist *list, webvtt_string *str )
     webvtt_free( old );
   }
 
-  list->items[list->length].d = str->d;
-  webvtt_ref_string( list->items + list->length++ );
+  webvtt_copy_string( list->items + list->length++, str );
 
   return WEBVTT_SUCCESS;
 }
@@ -835,6 +1198,94 @@ webvtt_utf8_to_utf16( const char *utf8, const char *end,
   return 0;
 }
 
+WEBVTT_EXPORT webvtt_uint32
+webvtt_utf8_decode( const char **utf8, const char *end )
+{
+  const unsigned char *u;
+  int n;
+  if( !utf8 || !*utf8 || !end || *utf8 >= end ) {
+    return 0;
+  }
+
+  u = ( const unsigned char * )*utf8;
+  switch( n = webvtt_utf8_sequence( *utf8, end ) ) {
+    case 1:
+      *utf8 += 1;
+      return u[ 0 ];
+    case 2:
+      *utf8 += 2;
+      return ( ( webvtt_uint32 )( u[ 0 ] & 0x1F ) << 6 ) | ( u[ 1 ] & 0x3F );
+    case 3:
+      *utf8 += 3;
+      return ( ( webvtt_uint32 )( u[ 0 ] & 0x0F ) << 12 )
+             | ( ( webvtt_uint32 )( u[ 1 ] & 0x3F ) << 6 ) | ( u[ 2 ] & 0x3F );
+    case 4:
+      *utf8 += 4;
+      return ( ( webvtt_uint32 )( u[ 0 ] & 0x07 ) << 18 )
+             | ( ( webvtt_uint32 )( u[ 1 ] & 0x3F ) << 12 )
+             | ( ( webvtt_uint32 )( u[ 2 ] & 0x3F ) << 6 ) | ( u[ 3 ] & 0x3F );
+  }
+
+  /* Ill-formed: skip the first byte and any continuation bytes after it */
+  for( n = 1; u + n < ( const unsigned char * )end
+              && ( u[ n ] & 0xC0 ) == 0x80; ++n );
+  *utf8 += n;
+  return 0xFFFD;
+}
+
+WEBVTT_EXPORT webvtt_uint32
+webvtt_utf8_to_utf16_buffer( const char *utf8, const char *end,
+                             webvtt_uint16 *out, webvtt_uint32 out_len )
+{
+  webvtt_uint32 n = 0;
+  if( !utf8 ) {
+    return 0;
+  }
+  if( !end ) {
+    end = utf8 + strlen( utf8 );
+  }
+  if( !out ) {
+    out_len = 0;
+  }
+
+  while( utf8 < end ) {
+    webvtt_uint32 uc;
+    const char *p;
+
+    /* Runs of ASCII are widened a block at a time */
+    if( n < out_len ) {
+      const char *limit = ( webvtt_uint32 )( end - utf8 ) > out_len - n
+                          ? utf8 + ( out_len - n ) : end;
+      p = webvtt_widen_ascii( utf8, limit, out + n );
+    } else {
+      /* The buffer is full, but the text must still be measured */
+      p = webvtt_widen_ascii( utf8, end, 0 );
+    }
+    n += ( webvtt_uint32 )( p - utf8 );
+    if( ( utf8 = p ) >= end ) {
+      break;
+    }
+
+    uc = webvtt_utf8_decode( &utf8, end );
+    if( uc > 0xFFFF ) {
+      if( n + 2 <= out_len ) {
+        out[ n ] = UTF_HIGH_SURROGATE( uc );
+        out[ n + 1 ] = UTF_LOW_SURROGATE( uc );
+      } else {
+        /* Never write half of a pair, or anything after it */
+        out_len = 0;
+      }
+      n += 2;
+    } else {
+      if( n < out_len ) {
+        out[ n ] = ( webvtt_uint16 )uc;
+      }
+      n += 1;
+    }
+  }
+  return n;
+}
+
 WEBVTT_EXPORT int
 webvtt_utf8_chcount( const char *utf8, const char *end )
 {
@@ -847,7 +1298,13 @@ webvtt_utf8_chcount( const char *utf8, const char *end )
     end = utf8 + strlen( utf8 );
   }
 
-  for( p = utf8; p < end; ++n ) {
+  /**
+   * Every code point of well-formed text has exactly one lead byte, so those
+   * can be counted in bulk. Whatever follows is walked as before.
+   */
+  p = webvtt_scan_utf8_invalid( utf8, end );
+  n = ( int )webvtt_count_utf8_leads( utf8, p );
+  for( ; p < end; ++n ) {
     int c = webvtt_utf8_length( p );
     if( c < 1 ) {
       break;
@@ -858,6 +1315,25 @@ webvtt_utf8_chcount( const char *utf8, const char *end )
   return n;
 }
 
+WEBVTT_EXPORT webvtt_bool
+webvtt_utf8_validate( const char *utf8, const char *end,
+                      webvtt_uint32 *invalid )
+{
+  const char *p;
+  if( !utf8 || ( end && end < utf8 ) ) {
+    return 0;
+  }
+  if( !end ) {
+    end = utf8 + strlen( utf8 );
+  }
+
+  p = webvtt_scan_utf8_invalid( utf8, end );
+  if( invalid ) {
+    *invalid = ( webvtt_uint32 )( p - utf8 );
+  }
+  return p == end;
+}
+
 WEBVTT_EXPORT int
 webvtt_utf8_length( const char *utf8 )
 {
@@ -69,6 +69,37 @@ webvtt_string_data_t {
   char array[1];
 };
 
+/**
+ * webvtt_string_truncate
+ *
+ * shorten 'str' to its first 'length' bytes, detaching it if it is shared
+ */
+WEBVTT_INTERN webvtt_status
+webvtt_string_truncate( webvtt_string *str, webvtt_uint32 length );
+
+/**
+ * webvtt_string_clear
+ *
+ * make 'str' empty, keeping its buffer for reuse if nothing else refers to it.
+ * borrowed or shared text is let go of instead.
+ */
+WEBVTT_INTERN void
+webvtt_string_clear( webvtt_string *str );
+
+/**
+ * webvtt_string_extend_borrowed
+ *
+ * if 'str' is empty, make it borrow the 'len' bytes at 'text'. if it is
+ * borrowed and its text ends where 'text' begins, make it cover those bytes as
+ * well. returns 0, leaving 'str' alone, in every other case.
+ *
+ * the caller guarantees that the bytes in between stay alive; this is only
+ * used on the parser's input in WEBVTT_PARSER_BORROW_INPUT mode.
+ */
+WEBVTT_INTERN webvtt_bool
+webvtt_string_extend_borrowed( webvtt_string *str, const char *text,
+                               webvtt_uint32 len );
+
 static __WEBVTT_STRING_INLINE  int
 webvtt_isalpha( char ch )
 {
@@ -27,15 +27,27 @@
 
 #include <webvttxx/abstract_parser>
 #include <webvttxx/cue>
+#include <webvttxx/parser_pool>
 
 namespace WebVTT
 {
 
-AbstractParser::AbstractParser()
+AbstractParser::AbstractParser( webvtt_uint flags ) : pool( 0 )
 {
   webvtt_status status;
-  if(WEBVTT_FAILED(status = webvtt_create_parser( &__parsedCue, &__reportError,
-                                                  this, &parser ) ) ) {
+  webvtt_parser_options options = webvtt_parser_options();
+  options.flags = flags;
+  if(WEBVTT_FAILED(status = webvtt_create_parser_with_options( &__parsedCue,
+                              &__reportError, this, &options, &parser ) ) ) {
+    /**
+     * TODO: Throw error
+     */
+  }
+}
+
+AbstractParser::AbstractParser( ParserPool &owner ) : pool( &owner )
+{
+  if( !( parser = owner.acquire( &__parsedCue, &__reportError, this ) ) ) {
     /**
      * TODO: Throw error
      */
@@ -44,7 +56,11 @@ AbstractParser::AbstractParser()
 
 AbstractParser::~AbstractParser()
 {
-  webvtt_delete_parser( parser );
+  if( pool ) {
+    pool->release( parser );
+  } else {
+    webvtt_delete_parser( parser );
+  }
 }
 
 ::webvtt_status
@@ -59,19 +75,70 @@ AbstractParser::parseChunk( const void *chunk, webvtt_uint length )
   return webvtt_parse_chunk( parser, chunk, length );
 }
 
+::webvtt_status
+AbstractParser::parseBuffer( const void *buffer, webvtt_uint length )
+{
+  return webvtt_parse_buffer( parser, buffer, length );
+}
+
+::webvtt_status
+AbstractParser::parseFile( const char *path )
+{
+  return webvtt_parse_file( parser, path );
+}
+
+::webvtt_status
+AbstractParser::parseParallel( const void *buffer, webvtt_uint length,
+                               webvtt_uint threads )
+{
+  return webvtt_parse_parallel( parser, buffer, length, threads );
+}
+
+::webvtt_status
+AbstractParser::parseFileParallel( const char *path, webvtt_uint threads )
+{
+  return webvtt_parse_file_parallel( parser, path, threads );
+}
+
 void WEBVTT_CALLBACK
 AbstractParser::__parsedCue( void *userdata, webvtt_cue *pcue )
 {
-  Cue cue(pcue);
-  /**
-   * Cue object increases the reference count of pcue, so we can dereference it
-   */
-  webvtt_release_cue( &pcue );
+  /* The parser's reference is handed over to the Cue */
+  Cue cue = Cue::adopt( pcue );
 
   AbstractParser *self = reinterpret_cast<AbstractParser *>( userdata );
   self->parsedCue( cue );
 }
 
+void
+AbstractParser::parsedCues( std::vector<Cue> &cues )
+{
+  for( size_t i = 0; i < cues.size(); ++i ) {
+    parsedCue( cues[ i ] );
+  }
+}
+
+::webvtt_status
+AbstractParser::batchCues( webvtt_uint max )
+{
+  return webvtt_set_cue_batch_callback( parser, &__parsedCues, max );
+}
+
+void WEBVTT_CALLBACK
+AbstractParser::__parsedCues( void *userdata, webvtt_cue **pcues,
+                              webvtt_uint count )
+{
+  AbstractParser *self = reinterpret_cast<AbstractParser *>( userdata );
+  std::vector<Cue> &cues = self->batch;
+  cues.reserve( count );
+  for( webvtt_uint i = 0; i < count; ++i ) {
+    /* The parser's reference is handed over to the Cue */
+    cues.push_back( Cue::adopt( pcues[ i ] ) );
+  }
+  self->parsedCues( cues );
+  cues.clear();
+}
+
 int WEBVTT_CALLBACK
 AbstractParser::__reportError( void *userdata, webvtt_uint line,
                                webvtt_uint col, webvtt_error error )
@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2013 Mozilla Foundation and Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  - Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//  - Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <webvttxx/cue_reader>
+
+namespace WebVTT
+{
+
+CueReader::CueReader( webvtt_uint flags )
+  : parser( 0 ), lastStatus( WEBVTT_UNFINISHED )
+{
+  webvtt_parser_options options = webvtt_parser_options();
+  webvtt_status status;
+  options.flags = flags;
+  if( WEBVTT_FAILED( status = webvtt_create_parser_with_options( &__parsedCue,
+                       &__reportError, this, &options, &parser ) ) ) {
+    parser = 0;
+    lastStatus = status;
+  }
+}
+
+CueReader::~CueReader()
+{
+  webvtt_delete_parser( parser );
+}
+
+::webvtt_status
+CueReader::setInput( const void *buffer, webvtt_uint length, bool last )
+{
+  if( !parser ) {
+    return lastStatus;
+  }
+  return webvtt_parser_set_input( parser, buffer, length, last ? 1 : 0 );
+}
+
+bool
+CueReader::next()
+{
+  webvtt_cue *pcue = 0;
+  if( !parser ) {
+    return false;
+  }
+  lastStatus = webvtt_parser_next_cue( parser, &pcue );
+  if( !pcue ) {
+    current = Cue();
+    return false;
+  }
+  current = Cue::adopt( pcue );
+  return true;
+}
+
+void WEBVTT_CALLBACK
+CueReader::__parsedCue( void *, webvtt_cue *pcue )
+{
+  /* Cues are pulled, never pushed, once there is input */
+  webvtt_release_cue( &pcue );
+}
+
+int WEBVTT_CALLBACK
+CueReader::__reportError( void *userdata, webvtt_uint line, webvtt_uint col,
+                          webvtt_error error )
+{
+  CueReader *self = reinterpret_cast<CueReader *>( userdata );
+  if( !self->reportError( Error( line, col, error ) ) ) {
+    return -1;
+  }
+  return 0;
+}
+
+}
@@ -25,7 +25,6 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
-#include <stdlib.h>
 #include <webvttxx/file_parser>
 
 namespace WebVTT
@@ -34,42 +33,16 @@ namespace WebVTT
 FileParser::FileParser( const char *fPath )
  : filePath( fPath )
 {
-  reader.open( fPath, std::ios::in | std::ios::binary );
-
-  if( !reader.good() ) {
-    // TODO: Throw
-  }
 }
 
 FileParser::~FileParser()
 {
-  if( reader.is_open() ) {
-    reader.close();
-  }
 }
 
 bool
 FileParser::parse()
 {
-  bool final = false;
-  ::webvtt_status status;
-  ::webvtt_status finishStatus;
-  char buffer[0x1000];
-  if( !reader.good() ) {
-    return false;
-  }
-
-  do {
-    reader.read( buffer, sizeof buffer );
-    uint len = (uint)reader.gcount();
-    final = reader.eof();
-    status = parseChunk( buffer, len );
-  } while( !final && !WEBVTT_FAILED(status) );
-  if( status == WEBVTT_UNFINISHED ) {
-    status = WEBVTT_SUCCESS;
-  }
-  finishStatus = finishParsing();
-  return !( WEBVTT_FAILED(status) || WEBVTT_FAILED(finishStatus) );
+  return !WEBVTT_FAILED( parseFile( filePath.c_str() ) );
 }
 
 }
@@ -0,0 +1,101 @@
+//
+// Copyright (c) 2013 Mozilla Foundation and Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  - Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//  - Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <webvttxx/parser_pool>
+
+namespace WebVTT
+{
+
+ParserPool::ParserPool( webvtt_uint flags, uint idleLimit )
+ : parserFlags( flags ), maxIdle( idleLimit )
+{
+}
+
+ParserPool::~ParserPool()
+{
+  for( size_t i = 0; i < idle.size(); ++i ) {
+    webvtt_delete_parser( idle[ i ] );
+  }
+}
+
+webvtt_parser
+ParserPool::acquire( webvtt_cue_fn onRead, webvtt_error_fn onError,
+                     void *userdata )
+{
+  webvtt_parser parser = 0;
+  if( !onRead || !onError ) {
+    return 0;
+  }
+  {
+    std::lock_guard<std::mutex> guard( lock );
+    if( !idle.empty() ) {
+      parser = idle.back();
+      idle.pop_back();
+    }
+  }
+
+  if( parser ) {
+    webvtt_set_parser_callbacks( parser, onRead, onError, userdata );
+    webvtt_set_cue_batch_callback( parser, 0, 0 );
+  } else {
+    webvtt_parser_options options = webvtt_parser_options();
+    options.flags = parserFlags;
+    if( WEBVTT_FAILED( webvtt_create_parser_with_options( onRead, onError,
+                         userdata, &options, &parser ) ) ) {
+      return 0;
+    }
+  }
+  return parser;
+}
+
+void
+ParserPool::release( webvtt_parser parser )
+{
+  if( !parser ) {
+    return;
+  }
+  /* Resetting may free a good deal; do it before taking the lock */
+  webvtt_reset_parser( parser );
+  {
+    std::lock_guard<std::mutex> guard( lock );
+    if( idle.size() < maxIdle ) {
+      idle.push_back( parser );
+      return;
+    }
+  }
+  webvtt_delete_parser( parser );
+}
+
+uint
+ParserPool::idleCount() const
+{
+  std::lock_guard<std::mutex> guard( lock );
+  return static_cast<uint>( idle.size() );
+}
+
+}
@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <string>
+#include <vector>
+#include "cuecollector_testfixture"
+
+namespace {
+
+const char Styled[] =
+  "WEBVTT\n"
+  "\n"
+  "first\n"
+  "00:00.000 --> 00:01.000 align:start\n"
+  "<b>Hello</b> <c.a.b>World</c>\n"
+  "\n"
+  "00:01.000 --> 00:02.000\n"
+  "<v Bob>Bye</v>\n";
+
+webvtt_parser
+createParser( std::vector<webvtt_cue *> &cues, webvtt_uint flags = 0 )
+{
+  webvtt_parser_options options = { 0 };
+  webvtt_parser parser = 0;
+  options.flags = flags | WEBVTT_PARSER_ALLOC_STATS;
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                &cues, &options, &parser ) );
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, Styled, sizeof( Styled ) - 1 ) );
+  EXPECT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  return parser;
+}
+
+}
+
+TEST(AllocStats,GlobalCountsApplicationAllocations)
+{
+  webvtt_alloc_stats before, during, after;
+  webvtt_collect_alloc_stats( 1 );
+  webvtt_get_alloc_stats( &before );
+
+  void *block = webvtt_alloc( 100 );
+  ASSERT_TRUE( block != 0 );
+  webvtt_get_alloc_stats( &during );
+  EXPECT_EQ( before.kinds[ WEBVTT_ALLOC_OTHER ].allocs + 1,
+             during.kinds[ WEBVTT_ALLOC_OTHER ].allocs );
+  EXPECT_EQ( before.total.live_bytes + 100, during.total.live_bytes );
+  EXPECT_LE( during.total.live_bytes, during.total.peak_bytes );
+
+  webvtt_free( block );
+  webvtt_get_alloc_stats( &after );
+  EXPECT_EQ( before.kinds[ WEBVTT_ALLOC_OTHER ].frees + 1,
+             after.kinds[ WEBVTT_ALLOC_OTHER ].frees );
+  EXPECT_EQ( before.total.live_bytes, after.total.live_bytes );
+  EXPECT_EQ( during.total.peak_bytes, after.total.peak_bytes );
+  webvtt_collect_alloc_stats( 0 );
+}
+
+/**
+ * Blocks allocated while the global statistics are off stay out of them.
+ */
+TEST(AllocStats,GlobalOffByDefault)
+{
+  webvtt_alloc_stats before, after;
+  webvtt_get_alloc_stats( &before );
+  void *block = webvtt_alloc( 100 );
+  ASSERT_TRUE( block != 0 );
+  webvtt_get_alloc_stats( &after );
+  EXPECT_EQ( before.total.allocs, after.total.allocs );
+
+  webvtt_collect_alloc_stats( 1 );
+  webvtt_free( block );
+  webvtt_get_alloc_stats( &after );
+  webvtt_collect_alloc_stats( 0 );
+  EXPECT_EQ( before.total.frees, after.total.frees );
+  EXPECT_EQ( before.total.live_bytes, after.total.live_bytes );
+}
+
+TEST(AllocStats,GlobalCountsStrings)
+{
+  webvtt_alloc_stats before, during, after;
+  webvtt_string str;
+  webvtt_collect_alloc_stats( 1 );
+  webvtt_get_alloc_stats( &before );
+
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &str, "Too long to be inline",
+                                             -1 ) );
+  webvtt_get_alloc_stats( &during );
+  EXPECT_EQ( before.kinds[ WEBVTT_ALLOC_STRING ].allocs + 1,
+             during.kinds[ WEBVTT_ALLOC_STRING ].allocs );
+  EXPECT_LT( before.kinds[ WEBVTT_ALLOC_STRING ].live_bytes,
+             during.kinds[ WEBVTT_ALLOC_STRING ].live_bytes );
+
+  webvtt_release_string( &str );
+  webvtt_get_alloc_stats( &after );
+  EXPECT_EQ( before.kinds[ WEBVTT_ALLOC_STRING ].live_bytes,
+             after.kinds[ WEBVTT_ALLOC_STRING ].live_bytes );
+  webvtt_collect_alloc_stats( 0 );
+}
+
+/**
+ * Parsers keep their own figures, and leave the global ones alone.
+ */
+TEST(AllocStats,ParserByKind)
+{
+  webvtt_alloc_stats global_before, global_after, stats;
+  std::vector<webvtt_cue *> cues;
+  webvtt_collect_alloc_stats( 1 );
+  webvtt_get_alloc_stats( &global_before );
+  webvtt_parser parser = createParser( cues );
+  ASSERT_EQ( 2U, cues.size() );
+
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_get_parser_alloc_stats( parser, &stats ) );
+  EXPECT_EQ( 2U, stats.kinds[ WEBVTT_ALLOC_CUE ].allocs );
+  EXPECT_EQ( 0U, stats.kinds[ WEBVTT_ALLOC_CUE ].frees );
+  EXPECT_LT( 0U, stats.kinds[ WEBVTT_ALLOC_NODE ].allocs );
+  EXPECT_LT( 0U, stats.kinds[ WEBVTT_ALLOC_TOKEN ].allocs );
+  EXPECT_EQ( stats.kinds[ WEBVTT_ALLOC_TOKEN ].allocs,
+             stats.kinds[ WEBVTT_ALLOC_TOKEN ].frees );
+  EXPECT_LT( 0U, stats.kinds[ WEBVTT_ALLOC_STRING ].allocs );
+  EXPECT_LT( 0U, stats.kinds[ WEBVTT_ALLOC_STRINGLIST ].allocs );
+  EXPECT_LT( 0U, stats.kinds[ WEBVTT_ALLOC_PARSER_STACK ].live_bytes );
+  EXPECT_EQ( 0U, stats.kinds[ WEBVTT_ALLOC_OTHER ].allocs );
+
+  webvtt_uint64 sum = 0;
+  for( int kind = 0; kind < WEBVTT_ALLOC_KIND_COUNT; ++kind ) {
+    sum += stats.kinds[ kind ].live_bytes;
+    EXPECT_LE( stats.kinds[ kind ].live_bytes, stats.kinds[ kind ].peak_bytes );
+  }
+  EXPECT_EQ( sum, stats.total.live_bytes );
+  EXPECT_LE( stats.total.live_bytes, stats.total.peak_bytes );
+
+  releaseCues( cues );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_get_parser_alloc_stats( parser, &stats ) );
+  EXPECT_EQ( 2U, stats.kinds[ WEBVTT_ALLOC_CUE ].frees );
+  EXPECT_EQ( 0U, stats.kinds[ WEBVTT_ALLOC_CUE ].live_bytes );
+  EXPECT_EQ( 0U, stats.kinds[ WEBVTT_ALLOC_NODE ].live_bytes );
+  webvtt_delete_parser( parser );
+
+  webvtt_get_alloc_stats( &global_after );
+  webvtt_collect_alloc_stats( 0 );
+  EXPECT_EQ( global_before.total.allocs, global_after.total.allocs );
+}
+
+/**
+ * Parsers only keep statistics when asked to.
+ */
+TEST(AllocStats,ParserOffByDefault)
+{
+  webvtt_alloc_stats stats;
+  std::vector<webvtt_cue *> cues;
+  webvtt_parser parser;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &collectCue, &ignoreError, &cues,
+                                   &parser ) );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_buffer( parser, Styled, sizeof( Styled ) - 1 ) );
+  ASSERT_EQ( 2U, cues.size() );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_get_parser_alloc_stats( parser, &stats ) );
+  EXPECT_EQ( 0U, stats.total.allocs );
+  EXPECT_EQ( 0U, stats.total.live_bytes );
+  releaseCues( cues );
+  webvtt_delete_parser( parser );
+}
+
+TEST(AllocStats,ArenaObjectsLiveUntilParserIsDeleted)
+{
+  webvtt_alloc_stats stats;
+  std::vector<webvtt_cue *> cues;
+  webvtt_parser parser = createParser( cues, WEBVTT_PARSER_USE_ARENA );
+  ASSERT_EQ( 2U, cues.size() );
+
+  releaseCues( cues );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_get_parser_alloc_stats( parser, &stats ) );
+  EXPECT_EQ( 2U, stats.kinds[ WEBVTT_ALLOC_CUE ].allocs );
+  EXPECT_EQ( 0U, stats.kinds[ WEBVTT_ALLOC_CUE ].frees );
+  EXPECT_LT( 0U, stats.kinds[ WEBVTT_ALLOC_CUE ].live_bytes );
+  webvtt_delete_parser( parser );
+}
+
+/**
+ * Cue text is handed over without the slack left from building it.
+ */
+TEST(AllocStats,CueStringsAreShrunk)
+{
+  std::vector<webvtt_cue *> cues;
+  std::string text( "WEBVTT\n\n00:00.000 --> 00:01.000\n" );
+  for( int i = 0; i < 40; ++i ) {
+    text += "A fairly long line of cue text\n";
+  }
+  webvtt_parser parser;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &collectCue, &ignoreError,
+                                   &cues, &parser ) );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, text.data(),
+                                 static_cast<webvtt_uint>( text.size() ) ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  webvtt_delete_parser( parser );
+
+  ASSERT_EQ( 1U, cues.size() );
+  EXPECT_EQ( webvtt_string_length( &cues[ 0 ]->body ),
+             webvtt_string_capacity( &cues[ 0 ]->body ) );
+  releaseCues( cues );
+}
+
+TEST(AllocStats,InvalidParams)
+{
+  webvtt_alloc_stats stats;
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_get_parser_alloc_stats( 0, &stats ) );
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <string>
+#include <vector>
+#include "cuecollector_testfixture"
+
+namespace {
+
+webvtt_parser
+createArenaParser( CollectedCues &cues )
+{
+  webvtt_parser_options options = { WEBVTT_PARSER_USE_ARENA };
+  webvtt_parser parser = 0;
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                &cues, &options, &parser ) );
+  return parser;
+}
+
+const char Simple[] =
+  "WEBVTT\n"
+  "\n"
+  "first\n"
+  "00:00.000 --> 00:01.000 align:start\n"
+  "<b>Hello</b> <i>World</i>\n"
+  "\n"
+  "second\n"
+  "00:01.000 --> 00:02.000\n"
+  "<v Bob>Bye</v>\n";
+
+}
+
+TEST(Arena,ParsesCues)
+{
+  CollectedCues cues;
+  webvtt_parser parser = createArenaParser( cues );
+  ASSERT_TRUE( parser != 0 );
+
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, Simple, sizeof( Simple ) - 1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  ASSERT_EQ( 2U, cues.size() );
+
+  webvtt_cue *cue = cues[ 0 ];
+  EXPECT_STREQ( "first", webvtt_string_text( &cue->id ) );
+  EXPECT_EQ( 1000U, cue->until );
+  EXPECT_EQ( WEBVTT_ALIGN_START, cue->settings.align );
+  ASSERT_TRUE( cue->node_head != 0 );
+  ASSERT_EQ( 3U, cue->node_head->data.internal_data->length );
+  EXPECT_EQ( WEBVTT_BOLD,
+             cue->node_head->data.internal_data->children[ 0 ]->kind );
+
+  cue = cues[ 1 ];
+  EXPECT_STREQ( "second", webvtt_string_text( &cue->id ) );
+  ASSERT_EQ( 1U, cue->node_head->data.internal_data->length );
+  webvtt_node *voice = cue->node_head->data.internal_data->children[ 0 ];
+  EXPECT_EQ( WEBVTT_VOICE, voice->kind );
+  EXPECT_STREQ( "Bob",
+                webvtt_string_text( &voice->data.internal_data->annotation ) );
+
+  releaseCues( cues );
+  webvtt_delete_parser( parser );
+}
+
+/**
+ * Cues may be held until the parser goes away, and the application is free to
+ * skip releasing them entirely.
+ */
+TEST(Arena,CuesReleasedByParser)
+{
+  CollectedCues cues;
+  webvtt_parser parser = createArenaParser( cues );
+  ASSERT_TRUE( parser != 0 );
+
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, Simple, sizeof( Simple ) - 1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  ASSERT_EQ( 2U, cues.size() );
+  webvtt_delete_parser( parser );
+}
+
+/**
+ * Enough cues to spill over several arena chunks, and some payloads bigger
+ * than a chunk.
+ */
+TEST(Arena,ManyChunks)
+{
+  std::string input( "WEBVTT\n\n" );
+  std::string big( 0x20000, 'x' );
+  for( int i = 0; i < 200; ++i ) {
+    input += "00:00.000 --> 00:01.000\n";
+    input += ( i % 50 == 0 ) ? big : std::string( "<c.a.b>text</c>" );
+    input += "\n\n";
+  }
+
+  CollectedCues cues;
+  webvtt_parser parser = createArenaParser( cues );
+  ASSERT_TRUE( parser != 0 );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, input.data(),
+                                 static_cast<webvtt_uint>( input.size() ) ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  ASSERT_EQ( 200U, cues.size() );
+  EXPECT_EQ( big.size(),
+             static_cast<size_t>(
+               webvtt_string_length( &cues[ 50 ]->body ) ) );
+  EXPECT_STREQ( "text",
+    webvtt_string_text(
+      &cues[ 1 ]->node_head->data.internal_data->children[ 0 ]
+        ->data.internal_data->children[ 0 ]->data.text ) );
+  releaseCues( cues );
+  webvtt_delete_parser( parser );
+}
+
+/**
+ * Objects created outside of the parser are unaffected by the arena, even if
+ * they are released while a parser is in use.
+ */
+TEST(Arena,HeapObjectsUnaffected)
+{
+  webvtt_string before;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &before, "heap", -1 ) );
+
+  CollectedCues cues;
+  webvtt_parser parser = createArenaParser( cues );
+  ASSERT_TRUE( parser != 0 );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, Simple, sizeof( Simple ) - 1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+
+  /* Allocations made between parser calls are not taken from the arena */
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &before, "!", 1 ) );
+  releaseCues( cues );
+  webvtt_delete_parser( parser );
+
+  EXPECT_STREQ( "heap!", webvtt_string_text( &before ) );
+  webvtt_release_string( &before );
+}
+
+TEST(Arena,DefaultOptionsMatchCreateParser)
+{
+  CollectedCues cues;
+  webvtt_parser_options options = { 0 };
+  webvtt_parser parser = 0;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                &cues, &options, &parser ) );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, Simple, sizeof( Simple ) - 1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  webvtt_delete_parser( parser );
+
+  /* Heap-allocated cues outlive the parser */
+  ASSERT_EQ( 2U, cues.size() );
+  EXPECT_STREQ( "second", webvtt_string_text( &cues[ 1 ]->id ) );
+  releaseCues( cues );
+}
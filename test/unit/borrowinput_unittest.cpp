@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <string>
+#include <vector>
+#include "cuecollector_testfixture"
+
+namespace {
+
+std::string
+viewOf( const webvtt_string *str )
+{
+  webvtt_string_view view;
+  webvtt_string_get_view( str, &view );
+  return std::string( view.text, view.length );
+}
+
+webvtt_node *
+child( webvtt_node *node, webvtt_uint i )
+{
+  return node->data.internal_data->children[ i ];
+}
+
+}
+
+class BorrowInput : public ::testing::Test
+{
+public:
+  virtual void TearDown() {
+    releaseCues( cues );
+  }
+
+  /**
+   * Parse 'text', passing it to the parser in chunks of 'chunk' bytes which
+   * all live in 'input'.
+   */
+  void parse( const std::string &text, webvtt_uint flags,
+              size_t chunk = std::string::npos ) {
+    webvtt_parser_options options = { 0 };
+    webvtt_parser parser;
+    input = text;
+    options.flags = flags;
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                  &cues, &options, &parser ) );
+    for( size_t pos = 0; pos < input.size(); pos += chunk ) {
+      size_t n = std::min( chunk, input.size() - pos );
+      ASSERT_EQ( WEBVTT_SUCCESS,
+                 webvtt_parse_chunk( parser, input.data() + pos,
+                                     static_cast<webvtt_uint>( n ) ) );
+    }
+    ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+    webvtt_delete_parser( parser );
+  }
+
+  bool inInput( const webvtt_string *str ) const {
+    const char *text = webvtt_string_text( str );
+    return webvtt_string_is_borrowed( str ) && text >= input.data() &&
+           text + webvtt_string_length( str ) <= input.data() + input.size();
+  }
+
+protected:
+  std::string input;
+  std::vector<webvtt_cue *> cues;
+};
+
+TEST_F(BorrowInput,CueFieldsPointIntoInput)
+{
+  parse( "WEBVTT\n\n"
+         "an identifier for this cue\n"
+         "00:00.000 --> 00:01.000\n"
+         "The first line of the cue text\n"
+         "and the second line of it\n", WEBVTT_PARSER_BORROW_INPUT );
+  ASSERT_EQ( 1U, cues.size() );
+  EXPECT_TRUE( inInput( &cues[ 0 ]->id ) );
+  EXPECT_EQ( "an identifier for this cue", viewOf( &cues[ 0 ]->id ) );
+  EXPECT_TRUE( inInput( &cues[ 0 ]->body ) );
+  EXPECT_EQ( "The first line of the cue text\nand the second line of it",
+             viewOf( &cues[ 0 ]->body ) );
+
+  webvtt_node *text = child( cues[ 0 ]->node_head, 0 );
+  ASSERT_EQ( WEBVTT_TEXT, text->kind );
+  EXPECT_TRUE( inInput( &text->data.text ) );
+  EXPECT_EQ( viewOf( &cues[ 0 ]->body ), viewOf( &text->data.text ) );
+}
+
+TEST_F(BorrowInput,TextInsideTagsIsBorrowed)
+{
+  parse( "WEBVTT\n\n"
+         "00:00.000 --> 00:01.000\n"
+         "<b>some bold text</b> and <v Bob>a voice</v>\n",
+         WEBVTT_PARSER_BORROW_INPUT );
+  ASSERT_EQ( 1U, cues.size() );
+  webvtt_node *head = cues[ 0 ]->node_head;
+  ASSERT_EQ( 3U, head->data.internal_data->length );
+
+  webvtt_node *bold = child( child( head, 0 ), 0 );
+  EXPECT_TRUE( inInput( &bold->data.text ) );
+  EXPECT_EQ( "some bold text", viewOf( &bold->data.text ) );
+
+  EXPECT_TRUE( inInput( &child( head, 1 )->data.text ) );
+  EXPECT_EQ( " and ", viewOf( &child( head, 1 )->data.text ) );
+
+  webvtt_node *voice = child( head, 2 );
+  EXPECT_STREQ( "Bob",
+                webvtt_string_text( &voice->data.internal_data->annotation ) );
+  EXPECT_EQ( "a voice", viewOf( &child( voice, 0 )->data.text ) );
+}
+
+/**
+ * Text which differs from the input is still copied.
+ */
+TEST_F(BorrowInput,EscapesAreCopied)
+{
+  parse( "WEBVTT\n\n"
+         "00:00.000 --> 00:01.000\n"
+         "Salt &amp; pepper\n", WEBVTT_PARSER_BORROW_INPUT );
+  ASSERT_EQ( 1U, cues.size() );
+  webvtt_node *text = child( cues[ 0 ]->node_head, 0 );
+  EXPECT_FALSE( webvtt_string_is_borrowed( &text->data.text ) );
+  EXPECT_STREQ( "Salt & pepper", webvtt_string_text( &text->data.text ) );
+}
+
+TEST_F(BorrowInput,CRLFBodyIsCopied)
+{
+  parse( "WEBVTT\r\n\r\n"
+         "00:00.000 --> 00:01.000\r\n"
+         "The first line of the cue text\r\n"
+         "and the second line of it\r\n", WEBVTT_PARSER_BORROW_INPUT );
+  ASSERT_EQ( 1U, cues.size() );
+  EXPECT_FALSE( webvtt_string_is_borrowed( &cues[ 0 ]->body ) );
+  EXPECT_STREQ( "The first line of the cue text\nand the second line of it",
+                webvtt_string_text( &cues[ 0 ]->body ) );
+}
+
+TEST_F(BorrowInput,NulIsReplaced)
+{
+  std::string text( "WEBVTT\n\n00:00.000 --> 00:01.000\nA long line with a " );
+  text += '\0';
+  text += " in the middle of it\n";
+  parse( text, WEBVTT_PARSER_BORROW_INPUT );
+  ASSERT_EQ( 1U, cues.size() );
+  EXPECT_FALSE( webvtt_string_is_borrowed( &cues[ 0 ]->body ) );
+  EXPECT_STREQ( "A long line with a \xEF\xBF\xBD in the middle of it",
+                webvtt_string_text( &cues[ 0 ]->body ) );
+}
+
+/**
+ * Chunks which are adjacent in memory still give borrowed cues.
+ */
+TEST_F(BorrowInput,SmallChunks)
+{
+  parse( "WEBVTT\n\n"
+         "an identifier for this cue\n"
+         "00:00.000 --> 00:01.000\n"
+         "The first line of the cue text\n"
+         "and the second line of it\n", WEBVTT_PARSER_BORROW_INPUT, 7 );
+  ASSERT_EQ( 1U, cues.size() );
+  EXPECT_EQ( "an identifier for this cue", viewOf( &cues[ 0 ]->id ) );
+  EXPECT_EQ( "The first line of the cue text\nand the second line of it",
+             viewOf( &cues[ 0 ]->body ) );
+  EXPECT_TRUE( inInput( &cues[ 0 ]->body ) );
+}
+
+/**
+ * Lines split between buffers which are not adjacent are copied.
+ */
+TEST_F(BorrowInput,SeparateBuffers)
+{
+  const char *pieces[] = { "WEBVTT\n\nan identi", "fier\n00:00.000 --> 00:01",
+                           ".000\nThe first line of the cue text\nand the se",
+                           "cond line of it\n" };
+  std::vector<std::string> buffers( pieces, pieces + 4 );
+  webvtt_parser_options options = { 0 };
+  webvtt_parser parser;
+  options.flags = WEBVTT_PARSER_BORROW_INPUT;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                &cues, &options, &parser ) );
+  for( size_t i = 0; i < buffers.size(); ++i ) {
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_parse_chunk( parser, buffers[ i ].c_str(),
+                 static_cast<webvtt_uint>( buffers[ i ].size() ) ) );
+  }
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  webvtt_delete_parser( parser );
+
+  ASSERT_EQ( 1U, cues.size() );
+  EXPECT_EQ( "an identifier", viewOf( &cues[ 0 ]->id ) );
+  EXPECT_EQ( "The first line of the cue text\nand the second line of it",
+             viewOf( &cues[ 0 ]->body ) );
+  EXPECT_EQ( 1000U, cues[ 0 ]->until );
+}
+
+/**
+ * Borrowing changes where the text lives, never what it is.
+ */
+TEST_F(BorrowInput,SameResultAsCopying)
+{
+  const std::string text =
+    "WEBVTT\n\n"
+    "1\n"
+    "00:00.000 --> 00:01.000 align:start line:0\n"
+    "<c.a.b>Hello</c> &lt;world&gt;\n"
+    "second line\n\n"
+    "00:01.000 --> 00:02.000\n"
+    "<ruby>base<rt>annotation</rt></ruby> <00:01.500> later\n";
+  std::vector<webvtt_cue *> copied;
+  parse( text, 0 );
+  copied.swap( cues );
+  parse( text, WEBVTT_PARSER_BORROW_INPUT );
+
+  ASSERT_EQ( copied.size(), cues.size() );
+  for( size_t i = 0; i < cues.size(); ++i ) {
+    EXPECT_EQ( viewOf( &copied[ i ]->id ), viewOf( &cues[ i ]->id ) );
+    EXPECT_EQ( viewOf( &copied[ i ]->body ), viewOf( &cues[ i ]->body ) );
+    EXPECT_EQ( copied[ i ]->from, cues[ i ]->from );
+    EXPECT_EQ( copied[ i ]->until, cues[ i ]->until );
+    EXPECT_EQ( copied[ i ]->settings.align, cues[ i ]->settings.align );
+    EXPECT_EQ( copied[ i ]->node_head->data.internal_data->length,
+               cues[ i ]->node_head->data.internal_data->length );
+    webvtt_release_cue( &copied[ i ] );
+  }
+}
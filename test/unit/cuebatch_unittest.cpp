@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <webvttxx/abstract_parser>
+#include <webvttxx/cue>
+#include <string>
+#include <vector>
+#include "record_testfixture"
+
+namespace {
+
+/**
+ * What the parser reported, in order: cue bodies, and errors as "!line:error"
+ */
+struct Events
+{
+  std::vector<std::string> events;
+  std::vector<webvtt_uint> batches;
+};
+
+void WEBVTT_CALLBACK
+onCue( void *userdata, webvtt_cue *cue )
+{
+  static_cast<Events *>( userdata )->events.push_back( textOf( &cue->body ) );
+  webvtt_release_cue( &cue );
+}
+
+void WEBVTT_CALLBACK
+onBatch( void *userdata, webvtt_cue **cues, webvtt_uint count )
+{
+  static_cast<Events *>( userdata )->batches.push_back( count );
+  for( webvtt_uint i = 0; i < count; ++i ) {
+    onCue( userdata, cues[ i ] );
+  }
+}
+
+int WEBVTT_CALLBACK
+onError( void *userdata, webvtt_uint line, webvtt_uint, webvtt_error error )
+{
+  static_cast<Events *>( userdata )->events.push_back(
+    "!" + std::to_string( line ) + ":" + std::to_string( error ) );
+  return 0;
+}
+
+std::string
+document( int cues )
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < cues; ++i ) {
+    text += "00:00.000 --> 00:01.000\ncue " + std::to_string( i ) + "\n\n";
+  }
+  return text;
+}
+
+}
+
+class CueBatch : public ::testing::Test
+{
+public:
+  virtual void TearDown() {
+    webvtt_delete_parser( parser );
+  }
+
+  void create( webvtt_uint max, webvtt_uint flags = 0 ) {
+    webvtt_parser_options options = { 0 };
+    options.flags = flags;
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_parser_with_options( &onCue, &onError, &events,
+                                                  &options, &parser ) );
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_set_cue_batch_callback( parser, &onBatch, max ) );
+  }
+
+  static Events parseOneByOne( const std::string &text,
+                               webvtt_uint threads = 1 ) {
+    Events result;
+    webvtt_parser p;
+    EXPECT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_parser( &onCue, &onError, &result, &p ) );
+    webvtt_parse_parallel( p, text.data(),
+                           static_cast<webvtt_uint>( text.size() ), threads );
+    webvtt_delete_parser( p );
+    return result;
+  }
+
+protected:
+  webvtt_parser parser = 0;
+  Events events;
+};
+
+TEST_F(CueBatch,UpToMaxAtATime)
+{
+  std::string text = document( 10 );
+  create( 4 );
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  ASSERT_EQ( 3U, events.batches.size() );
+  EXPECT_EQ( 4U, events.batches[ 0 ] );
+  EXPECT_EQ( 4U, events.batches[ 1 ] );
+  EXPECT_EQ( 2U, events.batches[ 2 ] );
+  EXPECT_EQ( parseOneByOne( text ).events, events.events );
+}
+
+/**
+ * Nothing is held back once webvtt_parse_chunk() returns.
+ */
+TEST_F(CueBatch,FlushedAtChunkEnd)
+{
+  std::string text = document( 10 );
+  create( 0 );
+  size_t half = text.size() / 2;
+  webvtt_parse_chunk( parser, text.data(), static_cast<webvtt_uint>( half ) );
+  Events expected;
+  webvtt_parser p;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &onCue, &onError, &expected, &p ) );
+  webvtt_parse_chunk( p, text.data(), static_cast<webvtt_uint>( half ) );
+  EXPECT_EQ( expected.events, events.events );
+  ASSERT_EQ( 1U, events.batches.size() );
+
+  webvtt_parse_chunk( parser, text.data() + half,
+                      static_cast<webvtt_uint>( text.size() - half ) );
+  webvtt_finish_parsing( parser );
+  webvtt_parse_chunk( p, text.data() + half,
+                      static_cast<webvtt_uint>( text.size() - half ) );
+  webvtt_finish_parsing( p );
+  webvtt_delete_parser( p );
+  EXPECT_EQ( expected.events, events.events );
+  EXPECT_EQ( 2U, events.batches.size() );
+}
+
+/**
+ * Cues and errors come in the same order as they do one by one, on one
+ * thread or several.
+ */
+TEST_F(CueBatch,SameOrderForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  create( 3 );
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string text = readFixture( names[ i ] );
+    events.events.clear();
+    webvtt_reset_parser( parser );
+    webvtt_parse_buffer( parser, text.data(),
+                         static_cast<webvtt_uint>( text.size() ) );
+    EXPECT_EQ( parseOneByOne( text ).events, events.events ) << names[ i ];
+  }
+}
+
+TEST_F(CueBatch,Parallel)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 3000; ++i ) {
+    text += "00:00.000 --> 00:01.000" + std::string( i % 7 ? "" : " bad" )
+            + "\ncue " + std::to_string( i ) + "\n\n";
+  }
+  create( 16 );
+  webvtt_parse_parallel( parser, text.data(),
+                         static_cast<webvtt_uint>( text.size() ), 4 );
+  EXPECT_EQ( parseOneByOne( text, 4 ).events, events.events );
+  EXPECT_EQ( parseOneByOne( text ).events, events.events );
+  for( size_t i = 0; i < events.batches.size(); ++i ) {
+    EXPECT_GE( 16U, events.batches[ i ] );
+  }
+}
+
+TEST_F(CueBatch,BackToOneByOne)
+{
+  std::string text = document( 5 );
+  create( 2 );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_set_cue_batch_callback( parser, 0, 0 ) );
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  EXPECT_TRUE( events.batches.empty() );
+  EXPECT_EQ( 5U, events.events.size() );
+}
+
+TEST_F(CueBatch,InvalidParams)
+{
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_set_cue_batch_callback( 0, &onBatch, 4 ) );
+}
+
+namespace {
+
+class BatchCollector : public WebVTT::AbstractParser
+{
+public:
+  BatchCollector( bool overrideBatches )
+    : overrideBatches( overrideBatches ), single( 0 ) {
+    batchCues( 4 );
+  }
+
+  bool parse( const std::string &text ) {
+    return !WEBVTT_FAILED( parseBuffer( text.data(),
+                             static_cast<webvtt_uint>( text.size() ) ) );
+  }
+
+  bool overrideBatches;
+  int single;
+  std::vector<size_t> batches;
+  std::vector<const WebVTT::Cue *> storage;
+  std::vector<std::string> bodies;
+
+protected:
+  virtual bool reportError( const WebVTT::Error & ) { return true; }
+  virtual void parsedCue( WebVTT::Cue &cue ) {
+    ++single;
+    bodies.push_back( cue.body().utf8() );
+  }
+  virtual void parsedCues( std::vector<WebVTT::Cue> &cues ) {
+    if( !overrideBatches ) {
+      AbstractParser::parsedCues( cues );
+      return;
+    }
+    batches.push_back( cues.size() );
+    storage.push_back( cues.data() );
+    for( size_t i = 0; i < cues.size(); ++i ) {
+      bodies.push_back( cues[ i ].body().utf8() );
+    }
+  }
+};
+
+}
+
+TEST(CueBatchCxx,ParsedCues)
+{
+  BatchCollector parser( true );
+  ASSERT_TRUE( parser.parse( document( 6 ) ) );
+  ASSERT_EQ( 2U, parser.batches.size() );
+  EXPECT_EQ( 4U, parser.batches[ 0 ] );
+  EXPECT_EQ( 2U, parser.batches[ 1 ] );
+  EXPECT_EQ( 0, parser.single );
+  ASSERT_EQ( 6U, parser.bodies.size() );
+  EXPECT_EQ( "cue 5", parser.bodies[ 5 ] );
+  /* Every batch is passed in the same vector */
+  EXPECT_EQ( parser.storage[ 0 ], parser.storage[ 1 ] );
+}
+
+TEST(CueBatchCxx,DefaultPassesEachToParsedCue)
+{
+  BatchCollector parser( false );
+  ASSERT_TRUE( parser.parse( document( 6 ) ) );
+  EXPECT_EQ( 6, parser.single );
+  ASSERT_EQ( 6U, parser.bodies.size() );
+  EXPECT_EQ( "cue 0", parser.bodies[ 0 ] );
+}
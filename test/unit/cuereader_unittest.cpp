@@ -0,0 +1,365 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <webvttxx/cue_reader>
+#include <string>
+#include <vector>
+#include "record_testfixture"
+
+namespace {
+
+std::string
+document( int cues, const char *settings = "" )
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < cues; ++i ) {
+    text += "00:00.000 --> 00:01.000" + std::string( settings ) + "\ncue "
+            + std::to_string( i ) + "\n\n";
+  }
+  return text;
+}
+
+Recording
+parsePushed( const std::string &text )
+{
+  Recording result;
+  webvtt_parser parser;
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &recordCue, &recordError, &result,
+                                   &parser ) );
+  result.status =
+    webvtt_parse_buffer( parser, text.data(),
+                         static_cast<webvtt_uint>( text.size() ) );
+  webvtt_delete_parser( parser );
+  return result;
+}
+
+}
+
+class CueReader : public ::testing::Test
+{
+public:
+  virtual void TearDown() {
+    webvtt_delete_parser( parser );
+  }
+
+  void create( webvtt_uint flags = 0 ) {
+    webvtt_parser_options options = { 0 };
+    options.flags = flags;
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_parser_with_options( &recordCue, &recordError,
+                                                  &result, &options,
+                                                  &parser ) );
+  }
+
+  /**
+   * Pull cues into 'pulled' until there are none to be had; returns the
+   * status which said so.
+   */
+  webvtt_status pullAll() {
+    webvtt_cue *cue;
+    webvtt_status status;
+    while( ( status = webvtt_parser_next_cue( parser, &cue ) )
+           == WEBVTT_SUCCESS && cue ) {
+      pulled.push_back( recordOf( cue ) );
+      webvtt_release_cue( &cue );
+    }
+    EXPECT_TRUE( cue == 0 );
+    return status;
+  }
+
+protected:
+  webvtt_parser parser = 0;
+  Recording result;
+  std::vector<RecordedCue> pulled;
+};
+
+/**
+ * Pulling gives the cues and errors the callbacks would have had, and none
+ * of the cues go to the callbacks.
+ */
+TEST_F(CueReader,SameAsCallbacksForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  const webvtt_uint flags[] = { 0, WEBVTT_PARSER_BORROW_INPUT,
+                                WEBVTT_PARSER_USE_ARENA };
+  for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[ 0 ] ); ++f ) {
+    create( flags[ f ] );
+    for( size_t i = 0; i < names.size(); ++i ) {
+      std::string text = readFixture( names[ i ] );
+      Recording expected = parsePushed( text );
+      result = Recording();
+      pulled.clear();
+      webvtt_reset_parser( parser );
+      ASSERT_EQ( WEBVTT_SUCCESS,
+                 webvtt_parser_set_input( parser, text.data(),
+                   static_cast<webvtt_uint>( text.size() ), 1 ) );
+      EXPECT_EQ( expected.status, pullAll() ) << names[ i ];
+      EXPECT_TRUE( result.cues.empty() );
+      EXPECT_EQ( expected.cues, pulled ) << names[ i ];
+      expectSameErrors( expected.errors, result.errors, names[ i ] );
+    }
+    webvtt_delete_parser( parser );
+    parser = 0;
+  }
+}
+
+/**
+ * Each cue is found without parsing the rest of the document.
+ */
+TEST_F(CueReader,ParsesOnlyAsFarAsNeeded)
+{
+  std::string text = document( 1000, " align:nowhere" );
+  create();
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parser_set_input( parser, text.data(),
+                                      static_cast<webvtt_uint>( text.size() ),
+                                      1 ) );
+  for( int i = 0; i < 3; ++i ) {
+    webvtt_cue *cue;
+    ASSERT_EQ( WEBVTT_SUCCESS, webvtt_parser_next_cue( parser, &cue ) );
+    ASSERT_TRUE( cue != 0 );
+    EXPECT_EQ( "cue " + std::to_string( i ), textOf( &cue->body ) );
+    webvtt_release_cue( &cue );
+    EXPECT_GE( ( size_t )i + 1, result.errors.size() );
+  }
+  EXPECT_EQ( WEBVTT_SUCCESS, pullAll() );
+  EXPECT_EQ( 997U, pulled.size() );
+  EXPECT_EQ( 1000U, result.errors.size() );
+}
+
+/**
+ * Input given a piece at a time, split anywhere, including in the middle of
+ * a CRLF.
+ */
+TEST_F(CueReader,SeveralInputs)
+{
+  std::string text = document( 50 );
+  for( size_t at = 0; ( at = text.find( '\n', at ) ) != std::string::npos;
+       at += 2 ) {
+    text.insert( at, "\r" );
+  }
+  const size_t pieces[] = { 1, 7, 13, 64, 1000 };
+  for( size_t p = 0; p < sizeof( pieces ) / sizeof( pieces[ 0 ] ); ++p ) {
+    create();
+    pulled.clear();
+    for( size_t i = 0; i < text.size(); i += pieces[ p ] ) {
+      size_t n = std::min( pieces[ p ], text.size() - i );
+      bool last = i + n == text.size();
+      ASSERT_EQ( WEBVTT_SUCCESS,
+                 webvtt_parser_set_input( parser, text.data() + i,
+                                          static_cast<webvtt_uint>( n ),
+                                          last ) );
+      EXPECT_EQ( last ? WEBVTT_SUCCESS : WEBVTT_UNFINISHED, pullAll() );
+    }
+    EXPECT_EQ( parsePushed( text ).cues, pulled ) << pieces[ p ];
+    webvtt_delete_parser( parser );
+    parser = 0;
+  }
+}
+
+TEST_F(CueReader,InputStates)
+{
+  std::string text = document( 2 );
+  webvtt_cue *cue;
+  create();
+  EXPECT_EQ( WEBVTT_UNFINISHED, webvtt_parser_next_cue( parser, &cue ) );
+  EXPECT_TRUE( cue == 0 );
+
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parser_set_input( parser, text.data(), 10, 0 ) );
+  /* Not used up yet */
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_parser_set_input( parser, text.data(), 10, 0 ) );
+  EXPECT_EQ( WEBVTT_UNFINISHED, pullAll() );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parser_set_input( parser, text.data() + 10,
+               static_cast<webvtt_uint>( text.size() - 10 ), 1 ) );
+  EXPECT_EQ( WEBVTT_SUCCESS, pullAll() );
+  EXPECT_EQ( 2U, pulled.size() );
+  /* The document has ended, and stays that way */
+  EXPECT_EQ( WEBVTT_SUCCESS, webvtt_parser_next_cue( parser, &cue ) );
+  EXPECT_TRUE( cue == 0 );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_parser_set_input( parser, text.data(), 1, 1 ) );
+
+  /* Until the parser is reset */
+  webvtt_reset_parser( parser );
+  pulled.clear();
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parser_set_input( parser, text.data(),
+               static_cast<webvtt_uint>( text.size() ), 1 ) );
+  EXPECT_EQ( WEBVTT_SUCCESS, pullAll() );
+  EXPECT_EQ( 2U, pulled.size() );
+}
+
+TEST_F(CueReader,ErrorStopsParsing)
+{
+  std::string text = document( 2 ) + "00:00.000 -> 00:01.000\nbad\n\n"
+                     + document( 2 ).substr( 8 );
+  create();
+  result.stopAfterErrors = 0;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parser_set_input( parser, text.data(),
+                                      static_cast<webvtt_uint>( text.size() ),
+                                      1 ) );
+  webvtt_status status = pullAll();
+  EXPECT_TRUE( WEBVTT_FAILED( status ) && status != WEBVTT_UNFINISHED );
+  EXPECT_EQ( 2U, pulled.size() );
+  EXPECT_EQ( 1U, result.errors.size() );
+  webvtt_cue *cue;
+  EXPECT_EQ( status, webvtt_parser_next_cue( parser, &cue ) );
+}
+
+/**
+ * Cues not pulled before a reset or the parser is deleted are released.
+ */
+TEST_F(CueReader,UnpulledCues)
+{
+  std::string text = document( 3 );
+  webvtt_cue *cue;
+  create();
+  webvtt_parser_set_input( parser, text.data(),
+                           static_cast<webvtt_uint>( text.size() ), 1 );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_parser_next_cue( parser, &cue ) );
+  webvtt_release_cue( &cue );
+  webvtt_reset_parser( parser );
+  EXPECT_EQ( WEBVTT_UNFINISHED, webvtt_parser_next_cue( parser, &cue ) );
+}
+
+TEST_F(CueReader,InvalidParams)
+{
+  webvtt_cue *cue;
+  create();
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_parser_next_cue( 0, &cue ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_parser_next_cue( parser, 0 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_parser_set_input( 0, "", 0, 1 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_parser_set_input( parser, 0, 1, 1 ) );
+}
+
+TEST(CueReaderCxx,RangeFor)
+{
+  std::string text = document( 5 );
+  WebVTT::CueReader reader;
+  ASSERT_TRUE( reader.valid() );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             reader.setInput( text.data(),
+                              static_cast<webvtt_uint>( text.size() ) ) );
+  std::vector<std::string> bodies;
+  for( const WebVTT::Cue &cue : reader ) {
+    bodies.push_back( cue.body().utf8() );
+  }
+  ASSERT_EQ( 5U, bodies.size() );
+  EXPECT_EQ( "cue 4", bodies[ 4 ] );
+  EXPECT_EQ( WEBVTT_SUCCESS, reader.status() );
+}
+
+/**
+ * id() and body() refer to the cue's own strings, so their text stays valid
+ * after the call even when it is short enough to be stored inline.
+ */
+TEST(CueReaderCxx,TextLivesAsLongAsTheCue)
+{
+  std::string text( "WEBVTT\n\nid\n00:00.000 --> 00:01.000\nshort\n\n" );
+  WebVTT::CueReader reader;
+  reader.setInput( text.data(), static_cast<webvtt_uint>( text.size() ) );
+  WebVTT::CueReader::iterator i = reader.begin();
+  ASSERT_TRUE( i != reader.end() );
+  const char *id = i->id().utf8();
+  const char *body = i->body().utf8();
+  EXPECT_STREQ( "id", id );
+  EXPECT_STREQ( "short", body );
+  EXPECT_EQ( &i->body(), &i->body() );
+}
+
+/**
+ * The iterator stops when the input runs out, and carries on from there
+ * once there is more.
+ */
+TEST(CueReaderCxx,CarriesOnWithMoreInput)
+{
+  std::string text = document( 4 );
+  size_t half = text.size() / 2;
+  WebVTT::CueReader reader;
+  reader.setInput( text.data(), static_cast<webvtt_uint>( half ), false );
+  size_t count = std::distance( reader.begin(), reader.end() );
+  EXPECT_EQ( WEBVTT_UNFINISHED, reader.status() );
+  EXPECT_GT( 4U, count );
+
+  reader.setInput( text.data() + half,
+                   static_cast<webvtt_uint>( text.size() - half ) );
+  WebVTT::CueReader::iterator i = reader.begin();
+  ASSERT_TRUE( i != reader.end() );
+  EXPECT_EQ( "cue " + std::to_string( count ),
+             std::string( i->body().utf8() ) );
+  for( ; i != reader.end(); ++i ) {
+    ++count;
+  }
+  EXPECT_EQ( 4U, count );
+  EXPECT_EQ( WEBVTT_SUCCESS, reader.status() );
+}
+
+namespace {
+
+void *WEBVTT_CALLBACK
+failAlloc( void *, webvtt_uint )
+{
+  return 0;
+}
+
+void WEBVTT_CALLBACK
+unusedFree( void *, void * )
+{
+}
+
+}
+
+/**
+ * A reader whose parser could not be created says so, rather than handing
+ * a NULL parser on to the C API.
+ */
+TEST(CueReaderCxx,ParserNotCreated)
+{
+  webvtt_set_allocator( &failAlloc, &unusedFree, 0 );
+  WebVTT::CueReader reader;
+  webvtt_set_allocator( 0, 0, 0 );
+  std::string text = document( 1 );
+  EXPECT_FALSE( reader.valid() );
+  EXPECT_EQ( WEBVTT_OUT_OF_MEMORY, reader.status() );
+  EXPECT_EQ( WEBVTT_OUT_OF_MEMORY,
+             reader.setInput( text.data(),
+                              static_cast<webvtt_uint>( text.size() ) ) );
+  EXPECT_FALSE( reader.next() );
+  EXPECT_TRUE( reader.begin() == reader.end() );
+  EXPECT_EQ( WEBVTT_OUT_OF_MEMORY, reader.status() );
+}
+
+namespace {
+
+class StoppingReader : public WebVTT::CueReader
+{
+public:
+  int errors = 0;
+  virtual bool reportError( const WebVTT::Error & ) {
+    return ++errors < 2;
+  }
+};
+
+}
+
+TEST(CueReaderCxx,ReportError)
+{
+  std::string text = document( 1, " align:nowhere" )
+                     + "00:00.000 -> 00:01.000\nbad\n\n"
+                     + document( 2 ).substr( 8 );
+  StoppingReader reader;
+  reader.setInput( text.data(), static_cast<webvtt_uint>( text.size() ) );
+  size_t count = 0;
+  while( reader.next() ) {
+    ++count;
+  }
+  EXPECT_EQ( 1U, count );
+  EXPECT_EQ( 2, reader.errors );
+  EXPECT_TRUE( WEBVTT_FAILED( reader.status() )
+               && reader.status() != WEBVTT_UNFINISHED );
+}
@@ -0,0 +1,362 @@
+#include <gtest/gtest.h>
+#include <webvtt/index.h>
+#include <webvtt/parser.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "record_testfixture"
+
+namespace {
+
+webvtt_parser
+createParser( Recording &result )
+{
+  webvtt_parser parser = 0;
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &recordCue, &recordError, &result,
+                                   &parser ) );
+  return parser;
+}
+
+std::vector<RecordedCue>
+parse( const std::string &text )
+{
+  Recording result;
+  webvtt_parser parser = createParser( result );
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  webvtt_delete_parser( parser );
+  return result.cues;
+}
+
+Recording
+parseRange( const std::string &text, const webvtt_index *index,
+            webvtt_timestamp from, webvtt_timestamp until )
+{
+  Recording result;
+  webvtt_parser parser = createParser( result );
+  result.status = webvtt_parse_range( parser, text.data(),
+                                      static_cast<webvtt_uint>( text.size() ),
+                                      index, from, until );
+  webvtt_delete_parser( parser );
+  return result;
+}
+
+/**
+ * The cues of 'all' shown at some point in [from, until]
+ */
+std::vector<RecordedCue>
+overlapping( const std::vector<RecordedCue> &all, webvtt_timestamp from,
+             webvtt_timestamp until )
+{
+  std::vector<RecordedCue> result;
+  for( size_t i = 0; i < all.size(); ++i ) {
+    if( all[ i ].from <= until && all[ i ].until > from ) {
+      result.push_back( all[ i ] );
+    }
+  }
+  return result;
+}
+
+std::string
+timing( int from, int until )
+{
+  char text[ 64 ];
+  snprintf( text, sizeof( text ), "%02d:%02d:%02d.%03d --> %02d:%02d:%02d.%03d",
+            from / 3600000, from / 60000 % 60, from / 1000 % 60, from % 1000,
+            until / 3600000, until / 60000 % 60, until / 1000 % 60,
+            until % 1000 );
+  return text;
+}
+
+}
+
+class Index : public ::testing::Test
+{
+public:
+  virtual void TearDown() {
+    webvtt_release_index( &index );
+  }
+
+  webvtt_status build( const std::string &text ) {
+    webvtt_release_index( &index );
+    return webvtt_build_index( text.data(),
+                               static_cast<webvtt_uint>( text.size() ),
+                               &index );
+  }
+
+  std::string entryText( const std::string &text, webvtt_uint i ) const {
+    return text.substr( index.entries[ i ].offset, index.entries[ i ].length );
+  }
+
+protected:
+  webvtt_index index = { 0 };
+};
+
+TEST_F(Index,FindsCues)
+{
+  std::string text( "WEBVTT\n"
+                    "\n"
+                    "NOTE a comment\n"
+                    "\n"
+                    "first\n"
+                    "00:00.000 --> 00:01.000 align:start\n"
+                    "Hello\n"
+                    "world\n"
+                    "\n"
+                    "\n"
+                    "01:00:00.500 --> 01:00:02.000\n"
+                    "Bye\n" );
+  ASSERT_EQ( WEBVTT_SUCCESS, build( text ) );
+  ASSERT_EQ( 2U, index.count );
+  EXPECT_EQ( "first\n00:00.000 --> 00:01.000 align:start\nHello\nworld",
+             entryText( text, 0 ) );
+  EXPECT_EQ( 0U, index.entries[ 0 ].from );
+  EXPECT_EQ( 1000U, index.entries[ 0 ].until );
+  EXPECT_EQ( "01:00:00.500 --> 01:00:02.000\nBye", entryText( text, 1 ) );
+  EXPECT_EQ( 3600500U, index.entries[ 1 ].from );
+  EXPECT_EQ( 3602000U, index.entries[ 1 ].until );
+}
+
+TEST_F(Index,LineEndings)
+{
+  std::string text( "\xEF\xBB\xBFWEBVTT\r\n\r\n"
+                    "id\r\n00:01.000 --> 00:02.000\r\ntext\r\n\r"
+                    "00:02.000 --> 00:03.000\rmore\r" );
+  ASSERT_EQ( WEBVTT_SUCCESS, build( text ) );
+  ASSERT_EQ( 2U, index.count );
+  EXPECT_EQ( "id\r\n00:01.000 --> 00:02.000\r\ntext", entryText( text, 0 ) );
+  EXPECT_EQ( "00:02.000 --> 00:03.000\rmore", entryText( text, 1 ) );
+}
+
+/**
+ * A line with a separator in cue text starts the next cue, as it does for the
+ * parser; cues with bad timings are left out.
+ */
+TEST_F(Index,SeparatorInCueText)
+{
+  std::string text( "WEBVTT\n\n"
+                    "00:00.000 --> 00:01.000\n"
+                    "text\n"
+                    "00:01.000 --> 00:02.000\n"
+                    "more\n\n"
+                    "00:05.000 --> 00:04.000\n"
+                    "backwards\n\n"
+                    "xx:00.000 --> 00:04.000\n"
+                    "bad\n" );
+  ASSERT_EQ( WEBVTT_SUCCESS, build( text ) );
+  ASSERT_EQ( 2U, index.count );
+  EXPECT_EQ( "00:00.000 --> 00:01.000\ntext", entryText( text, 0 ) );
+  EXPECT_EQ( "00:01.000 --> 00:02.000\nmore", entryText( text, 1 ) );
+}
+
+TEST_F(Index,NoHeader)
+{
+  EXPECT_EQ( WEBVTT_PARSE_ERROR, build( "00:00.000 --> 00:01.000\ntext\n" ) );
+  EXPECT_EQ( 0U, index.count );
+  EXPECT_EQ( WEBVTT_PARSE_ERROR, build( "WEBVTTX\n" ) );
+  EXPECT_EQ( WEBVTT_SUCCESS, build( "WEBVTT" ) );
+  EXPECT_EQ( 0U, index.count );
+}
+
+/**
+ * The index lists exactly the cues the parser produces, and each entry's
+ * bytes parse on their own to that same cue.
+ */
+TEST_F(Index,AgreesWithParserForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string text = readFixture( names[ i ] );
+    std::vector<RecordedCue> cues = parse( text );
+    webvtt_status status = build( text );
+    if( status == WEBVTT_PARSE_ERROR ) {
+      EXPECT_EQ( 0U, cues.size() ) << names[ i ];
+      continue;
+    }
+    ASSERT_EQ( WEBVTT_SUCCESS, status ) << names[ i ];
+    ASSERT_EQ( cues.size(), index.count ) << names[ i ];
+    for( webvtt_uint c = 0; c < index.count; ++c ) {
+      EXPECT_EQ( cues[ c ].from, index.entries[ c ].from ) << names[ i ];
+      EXPECT_EQ( cues[ c ].until, index.entries[ c ].until ) << names[ i ];
+      std::vector<RecordedCue> one = parse( "WEBVTT\n\n" + entryText( text,
+                                            c ) );
+      ASSERT_EQ( 1U, one.size() ) << names[ i ] << " cue " << c;
+      EXPECT_EQ( cues[ c ].id, one[ 0 ].id ) << names[ i ];
+      EXPECT_EQ( cues[ c ].body, one[ 0 ].body ) << names[ i ];
+    }
+  }
+}
+
+TEST_F(Index,LargeDocument)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 20000; ++i ) {
+    text += timing( i * 1000, i * 1000 + 500 ) + "\nSome cue text\n\n";
+  }
+  ASSERT_EQ( WEBVTT_SUCCESS, build( text ) );
+  ASSERT_EQ( 20000U, index.count );
+  for( webvtt_uint i = 0; i < index.count; ++i ) {
+    ASSERT_EQ( i * 1000U, index.entries[ i ].from );
+    ASSERT_EQ( i * 1000U + 500, index.entries[ i ].until );
+  }
+}
+
+TEST_F(Index,InvalidParams)
+{
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_build_index( "WEBVTT", 6, 0 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_build_index( 0, 6, &index ) );
+  webvtt_release_index( 0 );
+}
+
+TEST_F(Index,Lines)
+{
+  std::string text( "WEBVTT\n"
+                    "id\n"
+                    "00:00.000 --> 00:01.000\n"
+                    "text\n"
+                    "\n"
+                    "\n"
+                    "00:02.000 --> 00:03.000\n"
+                    "more\n" );
+  ASSERT_EQ( WEBVTT_SUCCESS, build( text ) );
+  ASSERT_EQ( 2U, index.count );
+  EXPECT_EQ( 2U, index.entries[ 0 ].line );
+  EXPECT_EQ( 7U, index.entries[ 1 ].line );
+  EXPECT_TRUE( index.sorted );
+  EXPECT_EQ( 1000U, index.longest );
+}
+
+/**
+ * A sorted index narrows the search down to the cues which may overlap.
+ */
+TEST_F(Index,FindRange)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 1000; ++i ) {
+    text += timing( i * 1000, i * 1000 + ( i % 10 == 0 ? 5000 : 500 ) )
+            + "\ntext\n\n";
+  }
+  ASSERT_EQ( WEBVTT_SUCCESS, build( text ) );
+  ASSERT_TRUE( index.sorted );
+  EXPECT_EQ( 5000U, index.longest );
+
+  webvtt_uint first, end;
+  end = webvtt_index_find_range( &index, 100200, 100200, &first );
+  EXPECT_LE( 95U, first );
+  EXPECT_GE( 101U, end );
+  std::vector<webvtt_uint> found;
+  for( webvtt_uint i = first; i < end; ++i ) {
+    if( webvtt_index_entry_overlaps( &index.entries[ i ], 100200, 100200 ) ) {
+      found.push_back( i );
+    }
+  }
+  ASSERT_EQ( 1U, found.size() );
+  EXPECT_EQ( 100U, found[ 0 ] );
+  /* The long cue which started 100 earlier is still showing */
+  end = webvtt_index_find_range( &index, 103000, 103000, &first );
+  EXPECT_LE( first, 100U );
+  EXPECT_TRUE( webvtt_index_entry_overlaps( &index.entries[ 100 ], 103000,
+                                            103000 ) );
+
+  /* Past the end */
+  end = webvtt_index_find_range( &index, 5000000, 6000000, &first );
+  EXPECT_EQ( end, first );
+}
+
+TEST_F(Index,UnsortedIsSearchedInFull)
+{
+  std::string text( "WEBVTT\n\n" );
+  text += timing( 5000, 6000 ) + "\nlater\n\n";
+  text += timing( 1000, 2000 ) + "\nearlier\n\n";
+  ASSERT_EQ( WEBVTT_SUCCESS, build( text ) );
+  EXPECT_FALSE( index.sorted );
+  webvtt_uint first;
+  EXPECT_EQ( 2U, webvtt_index_find_range( &index, 1500, 1500, &first ) );
+  EXPECT_EQ( 0U, first );
+
+  Recording result = parseRange( text, &index, 1500, 1500 );
+  EXPECT_EQ( WEBVTT_SUCCESS, result.status );
+  ASSERT_EQ( 1U, result.cues.size() );
+  EXPECT_EQ( "earlier", result.cues[ 0 ].body );
+}
+
+/**
+ * Asking for all of time gives every cue, and any smaller window those which
+ * overlap it, exactly as the full parse produced them.
+ */
+TEST_F(Index,ParseRangeForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  const webvtt_timestamp windows[][ 2 ] = {
+    { 0, ~( webvtt_timestamp )0 }, { 0, 0 }, { 11500, 11500 },
+    { 12000, 20000 }, { 1000, 3600000 }
+  };
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string text = readFixture( names[ i ] );
+    std::vector<RecordedCue> all = parse( text );
+    build( text );
+    for( size_t w = 0; w < sizeof( windows ) / sizeof( windows[ 0 ] ); ++w ) {
+      std::vector<RecordedCue> expected = overlapping( all, windows[ w ][ 0 ],
+                                               windows[ w ][ 1 ] );
+      expectSameCues( expected, parseRange( text, &index, windows[ w ][ 0 ],
+                                            windows[ w ][ 1 ] ).cues,
+                      names[ i ] );
+      expectSameCues( expected, parseRange( text, 0, windows[ w ][ 0 ],
+                                            windows[ w ][ 1 ] ).cues,
+                      names[ i ] );
+    }
+  }
+}
+
+TEST_F(Index,ParseRangeReportsDocumentLines)
+{
+  std::string text( "WEBVTT\n\n"
+                    "00:00.000 --> 00:01.000 align:bad\n"
+                    "first\n"
+                    "\n"
+                    "00:02.000 --> 00:03.000 align:bad\n"
+                    "second\n" );
+  Recording result = parseRange( text, 0, 2500, 2500 );
+  EXPECT_EQ( WEBVTT_SUCCESS, result.status );
+  ASSERT_EQ( 1U, result.cues.size() );
+  ASSERT_EQ( 1U, result.errors.size() );
+  EXPECT_EQ( 6U, result.errors[ 0 ].line );
+}
+
+TEST_F(Index,ParseRangeBadHeader)
+{
+  std::string text( "WEBVTX\n\n00:00.000 --> 00:01.000\ntext\n" );
+  Recording result = parseRange( text, 0, 0, 1000 );
+  EXPECT_EQ( WEBVTT_PARSE_ERROR, result.status );
+  EXPECT_EQ( 0U, result.cues.size() );
+  EXPECT_EQ( 1U, result.errors.size() );
+}
+
+TEST_F(Index,ParseFileRange)
+{
+  std::vector<std::string> names = fixtures();
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string path = TEST_FILE_DIR + std::string( "/" ) + names[ i ];
+    std::string text = readFixture( names[ i ] );
+    build( text );
+    const webvtt_index *indices[] = { 0, &index };
+    for( size_t n = 0; n < 2; ++n ) {
+      Recording result;
+      webvtt_parser parser = createParser( result );
+      webvtt_parse_file_range( parser, path.c_str(), indices[ n ], 11000,
+                               13000 );
+      webvtt_delete_parser( parser );
+      expectSameCues( overlapping( parse( text ), 11000, 13000 ), result.cues,
+                      names[ i ] );
+    }
+  }
+}
+
+TEST_F(Index,ParseRangeInvalidParams)
+{
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_parse_range( 0, "WEBVTT", 6, 0, 0, 1 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_parse_file_range( 0, "x.vtt", 0, 0, 1 ) );
+}
@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <webvttxx/abstract_parser>
+#include <webvttxx/cue>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "cuecollector_testfixture"
+#include "record_testfixture"
+
+namespace {
+
+/**
+ * Compare two node trees, kind by kind and string by string.
+ */
+bool
+sameTree( const webvtt_node *a, const webvtt_node *b )
+{
+  if( !a || !b || a->kind != b->kind ) {
+    return a == b;
+  }
+  if( a->kind == WEBVTT_TEXT ) {
+    return textOf( &a->data.text ) == textOf( &b->data.text );
+  }
+  if( a->kind == WEBVTT_TIME_STAMP ) {
+    return a->data.timestamp == b->data.timestamp;
+  }
+  if( !WEBVTT_IS_VALID_INTERNAL_NODE( a->kind ) ) {
+    return true;
+  }
+  const webvtt_internal_node_data *x = a->data.internal_data;
+  const webvtt_internal_node_data *y = b->data.internal_data;
+  if( x->length != y->length ||
+      textOf( &x->annotation ) != textOf( &y->annotation ) ||
+      textOf( &x->lang ) != textOf( &y->lang ) ||
+      !x->css_classes != !y->css_classes ) {
+    return false;
+  }
+  if( x->css_classes ) {
+    if( x->css_classes->length != y->css_classes->length ) {
+      return false;
+    }
+    for( webvtt_uint i = 0; i < x->css_classes->length; ++i ) {
+      if( textOf( &x->css_classes->items[ i ] ) !=
+          textOf( &y->css_classes->items[ i ] ) ) {
+        return false;
+      }
+    }
+  }
+  for( webvtt_uint i = 0; i < x->length; ++i ) {
+    if( !sameTree( x->children[ i ], y->children[ i ] ) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const char Styled[] =
+  "WEBVTT\n"
+  "\n"
+  "first\n"
+  "00:00.000 --> 00:01.000 align:start\n"
+  "<b>Hello</b> <c.a.b>World</c> &amp; <00:00.500> <v Bob>you</v>\n"
+  "\n"
+  "00:01.000 --> 00:02.000\n"
+  "<ruby>base<rt>annotation</rt></ruby>\n";
+
+}
+
+class LazyCuetext : public ::testing::Test
+{
+public:
+  virtual void TearDown() {
+    releaseCues( eager );
+    releaseCues( lazy );
+    if( parser ) {
+      webvtt_delete_parser( parser );
+    }
+  }
+
+  /**
+   * Parse 'text' into 'cues' with the given flags. The parser is kept until
+   * the end of the test, for the sake of arenas.
+   */
+  void parse( const std::string &text, webvtt_uint flags,
+              std::vector<webvtt_cue *> &cues ) {
+    webvtt_parser_options options = { 0 };
+    input = text;
+    options.flags = flags;
+    if( parser ) {
+      webvtt_delete_parser( parser );
+      parser = 0;
+    }
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                  &cues, &options, &parser ) );
+    webvtt_parse_buffer( parser, input.data(),
+                         static_cast<webvtt_uint>( input.size() ) );
+  }
+
+protected:
+  webvtt_parser parser = 0;
+  std::string input;
+  std::vector<webvtt_cue *> eager;
+  std::vector<webvtt_cue *> lazy;
+};
+
+TEST_F(LazyCuetext,NodesAreLeftUnparsed)
+{
+  parse( Styled, WEBVTT_PARSER_LAZY_CUETEXT, lazy );
+  ASSERT_EQ( 2U, lazy.size() );
+  for( size_t i = 0; i < lazy.size(); ++i ) {
+    EXPECT_TRUE( lazy[ i ]->node_head == 0 );
+  }
+  EXPECT_EQ( "first", textOf( &lazy[ 0 ]->id ) );
+  EXPECT_EQ( 1000U, lazy[ 0 ]->until );
+  EXPECT_EQ( "<ruby>base<rt>annotation</rt></ruby>",
+             textOf( &lazy[ 1 ]->body ) );
+}
+
+/**
+ * The first call builds the tree, later ones return it.
+ */
+TEST_F(LazyCuetext,GetNodesBuildsOnce)
+{
+  parse( Styled, WEBVTT_PARSER_LAZY_CUETEXT, lazy );
+  ASSERT_EQ( 2U, lazy.size() );
+  webvtt_node *head = webvtt_cue_get_nodes( lazy[ 0 ] );
+  ASSERT_TRUE( head != 0 );
+  EXPECT_EQ( head, lazy[ 0 ]->node_head );
+  EXPECT_EQ( head, webvtt_cue_get_nodes( lazy[ 0 ] ) );
+  EXPECT_TRUE( lazy[ 1 ]->node_head == 0 );
+}
+
+/**
+ * Every fixture gives the same trees either way, however the parser
+ * allocates and whether or not it borrows.
+ */
+TEST_F(LazyCuetext,SameTreesForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  const webvtt_uint flags[] = { 0, WEBVTT_PARSER_BORROW_INPUT,
+                                WEBVTT_PARSER_USE_ARENA };
+  for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[ 0 ] ); ++f ) {
+    for( size_t i = 0; i < names.size(); ++i ) {
+      std::string text = readFixture( names[ i ] );
+      releaseCues( eager );
+      releaseCues( lazy );
+      parse( text, 0, eager );
+      parse( text, flags[ f ] | WEBVTT_PARSER_LAZY_CUETEXT, lazy );
+      ASSERT_EQ( eager.size(), lazy.size() ) << names[ i ];
+      for( size_t c = 0; c < lazy.size(); ++c ) {
+        EXPECT_TRUE( lazy[ c ]->node_head == 0 );
+        EXPECT_TRUE( sameTree( eager[ c ]->node_head,
+                               webvtt_cue_get_nodes( lazy[ c ] ) ) )
+          << names[ i ] << " cue " << c << " flags " << flags[ f ];
+      }
+    }
+  }
+}
+
+/**
+ * Nodes belong to the parser which made the cue, and leave the global
+ * allocator alone.
+ */
+TEST_F(LazyCuetext,NodesComeFromParser)
+{
+  const webvtt_uint flags[] = { 0, WEBVTT_PARSER_USE_ARENA };
+  for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[ 0 ] ); ++f ) {
+    webvtt_alloc_stats global_before, global_after, before, after;
+    releaseCues( lazy );
+    parse( Styled, flags[ f ] | WEBVTT_PARSER_LAZY_CUETEXT
+                   | WEBVTT_PARSER_ALLOC_STATS, lazy );
+    ASSERT_EQ( 2U, lazy.size() );
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_get_parser_alloc_stats( parser, &before ) );
+    EXPECT_EQ( 0U, before.kinds[ WEBVTT_ALLOC_NODE ].allocs );
+
+    webvtt_collect_alloc_stats( 1 );
+    webvtt_get_alloc_stats( &global_before );
+    EXPECT_TRUE( webvtt_cue_get_nodes( lazy[ 0 ] ) != 0 );
+    webvtt_get_alloc_stats( &global_after );
+    webvtt_collect_alloc_stats( 0 );
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_get_parser_alloc_stats( parser, &after ) );
+    EXPECT_LT( 0U, after.kinds[ WEBVTT_ALLOC_NODE ].allocs );
+    EXPECT_EQ( global_before.total.allocs, global_after.total.allocs );
+  }
+}
+
+/**
+ * Trees built after the parser is gone still outlive it.
+ */
+TEST_F(LazyCuetext,AfterParserIsDeleted)
+{
+  parse( Styled, WEBVTT_PARSER_LAZY_CUETEXT, lazy );
+  webvtt_delete_parser( parser );
+  parser = 0;
+  ASSERT_EQ( 2U, lazy.size() );
+  webvtt_node *head = webvtt_cue_get_nodes( lazy[ 1 ] );
+  ASSERT_TRUE( head != 0 );
+  ASSERT_EQ( 1U, head->data.internal_data->length );
+  EXPECT_EQ( WEBVTT_RUBY, head->data.internal_data->children[ 0 ]->kind );
+}
+
+TEST_F(LazyCuetext,ParallelWorkersLeaveNodesUnparsed)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 2000; ++i ) {
+    text += "00:00.000 --> 00:01.000\n<b>bold</b> and <i>italic</i> text\n\n";
+  }
+  webvtt_parser_options options = { 0 };
+  options.flags = WEBVTT_PARSER_LAZY_CUETEXT;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                &lazy, &options, &parser ) );
+  webvtt_parse_parallel( parser, text.data(),
+                         static_cast<webvtt_uint>( text.size() ), 4 );
+  ASSERT_EQ( 2000U, lazy.size() );
+  for( size_t i = 0; i < lazy.size(); ++i ) {
+    ASSERT_TRUE( lazy[ i ]->node_head == 0 ) << i;
+  }
+  ASSERT_TRUE( webvtt_cue_get_nodes( lazy.back() ) != 0 );
+  EXPECT_EQ( 4U, lazy.back()->node_head->data.internal_data->length );
+}
+
+TEST_F(LazyCuetext,InvalidParams)
+{
+  EXPECT_TRUE( webvtt_cue_get_nodes( 0 ) == 0 );
+}
+
+namespace {
+
+class CueCollector : public WebVTT::AbstractParser
+{
+public:
+  CueCollector() : WebVTT::AbstractParser( WEBVTT_PARSER_LAZY_CUETEXT ) {}
+
+  bool parse( const char *text ) {
+    return !WEBVTT_FAILED( parseBuffer( text,
+                             static_cast<webvtt_uint>( strlen( text ) ) ) );
+  }
+
+  std::vector<WebVTT::Cue> cues;
+
+protected:
+  virtual bool reportError( const WebVTT::Error & ) { return true; }
+  virtual void parsedCue( WebVTT::Cue &cue ) { cues.push_back( cue ); }
+};
+
+}
+
+TEST(LazyCuetextCxx,NodeHeadParsesOnDemand)
+{
+  CueCollector parser;
+  ASSERT_TRUE( parser.parse( Styled ) );
+  ASSERT_EQ( 2U, parser.cues.size() );
+  WebVTT::Node head = parser.cues[ 0 ].nodeHead();
+  EXPECT_EQ( WebVTT::Node::Head, head.kind() );
+  ASSERT_EQ( 7, head.childCount() );
+  EXPECT_EQ( WebVTT::Node::Bold, head[ 0 ].kind() );
+}
@@ -32,6 +32,31 @@ public:
     return self->tstate;
   }
 
+  std::string tokenText() const {
+    return std::string( self->token, self->token_pos );
+  }
+
+  webvtt_uint column() const {
+    return self->column;
+  }
+
+  webvtt_status lexWord( const std::string &str, webvtt_uint &pos,
+                         std::string &word ) {
+    webvtt_string result;
+    webvtt_status status = webvtt_lex_word( self, &result, str.c_str(), &pos,
+                                            str.size() );
+    if( !WEBVTT_FAILED( status ) ) {
+      word.assign( webvtt_string_text( &result ),
+                   webvtt_string_length( &result ) );
+      webvtt_release_string( &result );
+    }
+    return status;
+  }
+
+  void resetToken() {
+    self->token_pos = 0;
+  }
+
 private:
   static int WEBVTT_CALLBACK dummyerr( void *userdata, webvtt_uint
                                        line, webvtt_uint col,
@@ -171,3 +196,108 @@ TEST_F(Lexer,LexWEBVTT)
   EXPECT_EQ( L_START, lexerState() );
 }
 
+
+/**
+ * Test that a token split between buffers is carried over, text and all
+ */
+TEST_F(Lexer,LexWEBVTTSplit)
+{
+  webvtt_uint pos = 0;
+  EXPECT_EQ( UNFINISHED, lex( "WEB", pos, false ) );
+  EXPECT_EQ( 3, pos );
+  EXPECT_EQ( L_WEBVTT2, lexerState() );
+  pos = 0;
+  EXPECT_EQ( WEBVTT, lex( "VTT", pos ) );
+  EXPECT_EQ( 3, pos );
+  EXPECT_EQ( "WEBVTT", tokenText() );
+  EXPECT_EQ( 7, column() );
+}
+
+/**
+ * Test that a partial match ends before the byte which does not fit, and keeps
+ * the text matched so far
+ */
+TEST_F(Lexer,LexPartialWEBVTT)
+{
+  webvtt_uint pos = 0;
+  EXPECT_EQ( BADTOKEN, lex( "WEBsite", pos ) );
+  EXPECT_EQ( 3, pos );
+  EXPECT_EQ( "WEB", tokenText() );
+  EXPECT_EQ( 4, column() );
+  EXPECT_EQ( L_START, lexerState() );
+}
+
+/**
+ * Test that a lone CR is a newline, and the byte after it is left alone
+ */
+TEST_F(Lexer,LexCRNewline)
+{
+  webvtt_uint pos = 0;
+  EXPECT_EQ( NEWLINE, lex( "\rx", pos ) );
+  EXPECT_EQ( 1, pos );
+  EXPECT_EQ( 1, column() );
+}
+
+/**
+ * Test that whitespace is taken as one token, and that tokens never outgrow
+ * the token buffer
+ */
+TEST_F(Lexer,LexWhitespaceRun)
+{
+  webvtt_uint pos = 0;
+  EXPECT_EQ( WHITESPACE, lex( " \t  x", pos ) );
+  EXPECT_EQ( 4, pos );
+  EXPECT_EQ( " \t  ", tokenText() );
+
+  resetToken();
+  pos = 0;
+  std::string blanks( 300, ' ' );
+  EXPECT_EQ( WHITESPACE, lex( blanks, pos ) );
+  EXPECT_EQ( 255, pos );
+  EXPECT_EQ( L_START, lexerState() );
+}
+
+/**
+ * Test that a word runs up to the next blank or line ending, whatever it
+ * starts with
+ */
+TEST_F(Lexer,LexWord)
+{
+  webvtt_uint pos = 0;
+  std::string word;
+  ASSERT_EQ( WEBVTT_SUCCESS, lexWord( "WEBsite-->x next", pos, word ) );
+  EXPECT_EQ( "WEBsite-->x", word );
+  EXPECT_EQ( 11, pos );
+  EXPECT_EQ( 12, column() );
+
+  ASSERT_EQ( WEBVTT_SUCCESS, lexWord( "abc\r\n", pos = 0, word ) );
+  EXPECT_EQ( "abc", word );
+  EXPECT_EQ( 3, pos );
+
+  ASSERT_EQ( WEBVTT_SUCCESS, lexWord( " abc", pos = 0, word ) );
+  EXPECT_EQ( "", word );
+  EXPECT_EQ( 0, pos );
+  EXPECT_EQ( L_START, lexerState() );
+}
+
+/**
+ * A word no longer ends where the next token begins, only at a blank or a
+ * line ending.
+ */
+TEST_F(Lexer,LexWordRunsIntoToken)
+{
+  webvtt_uint pos = 0;
+  std::string word;
+  ASSERT_EQ( WEBVTT_SUCCESS, lexWord( "abc-->", pos, word ) );
+  EXPECT_EQ( "abc-->", word );
+  EXPECT_EQ( 6, pos );
+
+  ASSERT_EQ( WEBVTT_SUCCESS, lexWord( "cueWEBVTT\n", pos = 0, word ) );
+  EXPECT_EQ( "cueWEBVTT", word );
+  EXPECT_EQ( 9, pos );
+
+  ASSERT_EQ( WEBVTT_SUCCESS, lexWord( "x00:00.000 -->", pos = 0, word ) );
+  EXPECT_EQ( "x00:00.000", word );
+  EXPECT_EQ( 10, pos );
+  EXPECT_EQ( L_START, lexerState() );
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+extern "C" {
+#include "webvtt/node_internal.h"
+}
+
+class Node : public ::testing::Test
+{
+public:
+  virtual void SetUp() {
+    head = 0;
+    ASSERT_EQ( WEBVTT_SUCCESS, ::webvtt_create_head_node( &head ) );
+  }
+  virtual void TearDown() {
+    ::webvtt_release_node( &head );
+  }
+
+  webvtt_internal_node_data *headData() const {
+    return head->data.internal_data;
+  }
+
+  void attachText( webvtt_node *parent, const char *text ) {
+    webvtt_string str;
+    webvtt_node *node = 0;
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_string_with_text( &str, text, -1 ) );
+    ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_text_node( &node, parent, &str ) );
+    ASSERT_EQ( WEBVTT_SUCCESS, webvtt_attach_node( parent, node ) );
+    webvtt_release_node( &node );
+    webvtt_release_string( &str );
+  }
+
+protected:
+  webvtt_node *head;
+};
+
+/**
+ * The internal node data lives in the same record as the node.
+ */
+TEST_F(Node,InternalDataFollowsNode)
+{
+  EXPECT_EQ( reinterpret_cast<void *>( head + 1 ),
+             reinterpret_cast<void *>( headData() ) );
+  EXPECT_EQ( 0U, headData()->length );
+  EXPECT_EQ( static_cast<webvtt_uint>( WEBVTT_NODE_INLINE_CHILDREN ),
+             headData()->alloc );
+}
+
+TEST_F(Node,FewChildrenStayInline)
+{
+  for( int i = 0; i < WEBVTT_NODE_INLINE_CHILDREN; ++i ) {
+    attachText( head, "text" );
+  }
+  EXPECT_EQ( static_cast<webvtt_uint>( WEBVTT_NODE_INLINE_CHILDREN ),
+             headData()->length );
+  EXPECT_EQ( headData()->inline_children, headData()->children );
+}
+
+TEST_F(Node,ManyChildrenMoveToHeap)
+{
+  const char *texts[] = { "a", "b", "c", "d", "e", "f", "g", "h", "i", "j" };
+  for( int i = 0; i < 10; ++i ) {
+    attachText( head, texts[ i ] );
+  }
+  ASSERT_EQ( 10U, headData()->length );
+  EXPECT_NE( headData()->inline_children, headData()->children );
+  EXPECT_LE( 10U, headData()->alloc );
+  for( int i = 0; i < 10; ++i ) {
+    EXPECT_STREQ( texts[ i ],
+                  webvtt_string_text( &headData()->children[ i ]->data.text ) );
+    EXPECT_EQ( head, headData()->children[ i ]->parent );
+  }
+}
+
+/**
+ * Nodes share slabs; a node which outlives the tree it was created with must
+ * keep working.
+ */
+TEST_F(Node,NodeOutlivesSiblings)
+{
+  webvtt_node *kept = 0;
+  attachText( head, "first" );
+  attachText( head, "second" );
+  kept = headData()->children[ 1 ];
+  webvtt_ref_node( kept );
+  webvtt_release_node( &head );
+
+  EXPECT_STREQ( "second", webvtt_string_text( &kept->data.text ) );
+  webvtt_release_node( &kept );
+}
+
+TEST_F(Node,InternalNodeRejectsLeafKind)
+{
+  webvtt_node *node = 0;
+  webvtt_string empty;
+  webvtt_init_string( &empty );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_create_internal_node( &node, head, WEBVTT_TEXT, 0,
+                                          &empty ) );
+  EXPECT_TRUE( node == 0 );
+}
@@ -0,0 +1,540 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <webvttxx/cue>
+#include <webvttxx/file_parser>
+#include <webvttxx/parallel_file_parser>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cuecollector_testfixture"
+#include "record_testfixture"
+extern "C" {
+#include "webvtt/parser_internal.h"
+}
+#ifndef _WIN32
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace {
+
+/**
+ * Everything a parse reported, written out as text so that two runs can be
+ * compared line by line.
+ */
+struct Result
+{
+  std::vector<std::string> events;
+};
+
+void
+describe( std::ostream &out, const webvtt_node *node, int depth )
+{
+  out << std::string( depth * 2, ' ' ) << std::hex << node->kind << std::dec;
+  if( node->kind == WEBVTT_TEXT ) {
+    out << " \"" << textOf( &node->data.text ) << "\"\n";
+  } else if( node->kind == WEBVTT_TIME_STAMP ) {
+    out << " " << node->data.timestamp << "\n";
+  } else if( WEBVTT_IS_VALID_INTERNAL_NODE( node->kind ) ) {
+    const webvtt_internal_node_data *data = node->data.internal_data;
+    out << " [" << textOf( &data->annotation ) << "] ["
+        << textOf( &data->lang ) << "]";
+    if( data->css_classes ) {
+      for( webvtt_uint i = 0; i < data->css_classes->length; ++i ) {
+        out << " ." << textOf( &data->css_classes->items[ i ] );
+      }
+    }
+    out << "\n";
+    for( webvtt_uint i = 0; i < data->length; ++i ) {
+      describe( out, data->children[ i ], depth + 1 );
+    }
+  } else {
+    out << "\n";
+  }
+}
+
+void WEBVTT_CALLBACK
+onCue( void *userdata, webvtt_cue *cue )
+{
+  std::ostringstream out;
+  out << "cue [" << textOf( &cue->id ) << "] " << cue->from << " --> "
+      << cue->until << " vertical:" << cue->settings.vertical
+      << " line:" << cue->settings.line << " snap:" << cue->snap_to_lines
+      << " position:" << cue->settings.position
+      << " size:" << cue->settings.size
+      << " align:" << cue->settings.align << "\n"
+      << textOf( &cue->body ) << "\n";
+  if( cue->node_head ) {
+    describe( out, cue->node_head, 0 );
+  }
+  static_cast<Result *>( userdata )->events.push_back( out.str() );
+  webvtt_release_cue( &cue );
+}
+
+int WEBVTT_CALLBACK
+onError( void *userdata, webvtt_uint line, webvtt_uint col, webvtt_error error )
+{
+  std::ostringstream out;
+  out << "error " << line << ":" << col << " " << error;
+  static_cast<Result *>( userdata )->events.push_back( out.str() );
+  return 0;
+}
+
+webvtt_parser
+createParser( Result &result, webvtt_uint flags )
+{
+  webvtt_parser_options options = { 0 };
+  webvtt_parser parser = 0;
+  options.flags = flags;
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &onCue, &onError, &result,
+                                                &options, &parser ) );
+  return parser;
+}
+
+Result
+parseChunked( const std::string &text, size_t chunk, webvtt_uint flags = 0 )
+{
+  Result result;
+  webvtt_parser parser = createParser( result, flags );
+  for( size_t pos = 0; pos < text.size(); pos += chunk ) {
+    size_t n = std::min( chunk, text.size() - pos );
+    webvtt_parse_chunk( parser, text.data() + pos,
+                        static_cast<webvtt_uint>( n ) );
+  }
+  webvtt_finish_parsing( parser );
+  webvtt_delete_parser( parser );
+  return result;
+}
+
+Result
+parseBuffer( const std::string &text, webvtt_uint flags = 0 )
+{
+  Result result;
+  webvtt_parser parser = createParser( result, flags );
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  webvtt_delete_parser( parser );
+  return result;
+}
+
+Result
+parseParallel( const std::string &text, webvtt_uint threads,
+               webvtt_uint flags = 0 )
+{
+  Result result;
+  webvtt_parser parser = createParser( result, flags );
+  webvtt_parse_parallel( parser, text.data(),
+                         static_cast<webvtt_uint>( text.size() ), threads );
+  webvtt_delete_parser( parser );
+  return result;
+}
+
+Result
+parseFile( const std::string &path, webvtt_status *status = 0 )
+{
+  Result result;
+  webvtt_parser parser = createParser( result, 0 );
+  webvtt_status s = webvtt_parse_file( parser, path.c_str() );
+  if( status ) {
+    *status = s;
+  }
+  webvtt_delete_parser( parser );
+  return result;
+}
+
+}
+
+/**
+ * Every fixture gives exactly the same cues and errors whichever way it is
+ * handed to the parser.
+ */
+TEST(ParseBuffer,SameAsChunkedForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  ASSERT_LT( 100U, names.size() );
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string text = readFixture( names[ i ] );
+    Result chunked = parseChunked( text, text.size() + 1 );
+    Result buffer = parseBuffer( text );
+    EXPECT_EQ( chunked.events, buffer.events ) << names[ i ];
+  }
+}
+
+TEST(ParseBuffer,SameAsChunkedWithFlags)
+{
+  std::vector<std::string> names = fixtures();
+  const webvtt_uint flags[] = { WEBVTT_PARSER_BORROW_INPUT,
+                                WEBVTT_PARSER_USE_ARENA };
+  for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[ 0 ] ); ++f ) {
+    for( size_t i = 0; i < names.size(); ++i ) {
+      std::string text = readFixture( names[ i ] );
+      EXPECT_EQ( parseChunked( text, text.size() + 1, flags[ f ] ).events,
+                 parseBuffer( text, flags[ f ] ).events ) << names[ i ];
+    }
+  }
+}
+
+/**
+ * Whole blocks are read straight out of the buffer, and anything out of the
+ * ordinary is left to the state machine: these are the places where one hands
+ * over to the other.
+ */
+TEST(ParseBuffer,SameAsChunkedWhereBlocksAreHandedOver)
+{
+  const std::string header =
+    "WEBVTT\n\nfirst\n00:00.000 --> 00:01.000\nok\n\n";
+  const std::string cases[] = {
+    "id\n00:01.000 --> 00:02.000\n",
+    "id\n00:01.000 --> 00:02.000",
+    "id\nbad --> 00:02.000\n",
+    "00:01.000 x --> 00:02.000\ntext\n\n00:02.000 --> 00:03.000\nmore\n\n",
+    "00:01.000 x --> 00:02.000\n ",
+    "00:01.000 --> 00:02.000\none\n00:02.000 --> 00:03.000\ntwo\n\n",
+    "00:01.000 --> 00:02.000\nno empty line after this",
+    "00:01.000 --> 00:02.000\r\ncrlf\r\nlines\r\n\r\n"
+    "id\r00:02.000 --> 00:03.000\rcr\r",
+    std::string( "00:01.000 --> 00:02.000\nnul\0byte\n\n", 34 ),
+    "NOTE a comment\n\n00:01.000 --> 00:02.000\nskipped\n\n",
+    "id\n\n00:01.000 --> 00:02.000\ntext\n\n",
+    "00:01.000 --> 00:02.000\n" + std::string( 0x10000, 'x' ) + "\nshort\n\n",
+  };
+  const webvtt_uint flags[] = { 0, WEBVTT_PARSER_BORROW_INPUT,
+                                WEBVTT_PARSER_SKIP_IDS |
+                                WEBVTT_PARSER_LAZY_CUETEXT };
+  for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[ 0 ] ); ++f ) {
+    for( size_t i = 0; i < sizeof( cases ) / sizeof( cases[ 0 ] ); ++i ) {
+      std::string text = header + cases[ i ];
+      EXPECT_EQ( parseChunked( text, 1, flags[ f ] ).events,
+                 parseBuffer( text, flags[ f ] ).events ) << i;
+    }
+  }
+}
+
+/**
+ * Unless borrowing was asked for, cues do not point into the buffer, which
+ * may go away as soon as parsing is done.
+ */
+TEST(ParseBuffer,CuesOutliveBuffer)
+{
+  std::vector<webvtt_cue *> cues;
+  webvtt_parser parser;
+  std::string *text = new std::string(
+    "WEBVTT\n\n"
+    "an identifier which is too long to be stored inline\n"
+    "00:00.000 --> 00:01.000\n"
+    "<b>some cue text</b> which is long enough to need a buffer\n" );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &collectCue, &ignoreError, &cues,
+                                   &parser ) );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_buffer( parser, text->data(),
+                                  static_cast<webvtt_uint>( text->size() ) ) );
+  webvtt_delete_parser( parser );
+  delete text;
+
+  ASSERT_EQ( 1U, cues.size() );
+  EXPECT_FALSE( webvtt_string_is_borrowed( &cues[ 0 ]->id ) );
+  EXPECT_FALSE( webvtt_string_is_borrowed( &cues[ 0 ]->body ) );
+  EXPECT_STREQ( "an identifier which is too long to be stored inline",
+                webvtt_string_text( &cues[ 0 ]->id ) );
+  webvtt_node *bold =
+    cues[ 0 ]->node_head->data.internal_data->children[ 0 ];
+  webvtt_node *text_node = bold->data.internal_data->children[ 0 ];
+  EXPECT_FALSE( webvtt_string_is_borrowed( &text_node->data.text ) );
+  EXPECT_STREQ( "some cue text", webvtt_string_text( &text_node->data.text ) );
+  webvtt_release_cue( &cues[ 0 ] );
+}
+
+/**
+ * A cue whose borrowed text can not be copied out of the buffer is dropped,
+ * and the failure reported.
+ */
+TEST(ParseBuffer,CopyingCueTextFails)
+{
+  struct Limited {
+    int live;
+    bool armed;
+    static void *WEBVTT_CALLBACK alloc( void *userdata, webvtt_uint nb ) {
+      Limited *self = static_cast<Limited *>( userdata );
+      /* Once parsing, only the long identifier needs this much */
+      if( self->armed && nb > 1000 ) {
+        return 0;
+      }
+      ++self->live;
+      return malloc( nb );
+    }
+    static void WEBVTT_CALLBACK free( void *userdata, void *ptr ) {
+      --static_cast<Limited *>( userdata )->live;
+      ::free( ptr );
+    }
+  } limited = { 0, false };
+  std::string text = "WEBVTT\n\n" + std::string( 1200, 'x' ) + "\n"
+                     "00:00.000 --> 00:01.000\nfirst\n";
+  Result result;
+  webvtt_parser_options options = { 0 };
+  webvtt_parser parser;
+  options.alloc = &Limited::alloc;
+  options.free = &Limited::free;
+  options.alloc_data = &limited;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &onCue, &onError, &result,
+                                                &options, &parser ) );
+  limited.armed = true;
+  EXPECT_EQ( WEBVTT_OUT_OF_MEMORY,
+             webvtt_parse_buffer( parser, text.data(),
+                                  static_cast<webvtt_uint>( text.size() ) ) );
+  webvtt_delete_parser( parser );
+  ASSERT_EQ( 1U, result.events.size() );
+  EXPECT_EQ( 0U, result.events[ 0 ].find( "error " ) );
+  EXPECT_EQ( " " + std::to_string( WEBVTT_ALLOCATION_FAILED ),
+             result.events[ 0 ].substr( result.events[ 0 ].rfind( ' ' ) ) );
+  EXPECT_EQ( 0, limited.live );
+}
+
+TEST(ParseBuffer,InvalidParams)
+{
+  Result result;
+  webvtt_parser parser = createParser( result, 0 );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_parse_buffer( 0, "WEBVTT", 6 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_parse_buffer( parser, 0, 6 ) );
+  webvtt_delete_parser( parser );
+}
+
+TEST(ParseFile,SameAsChunkedForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string text = readFixture( names[ i ] );
+    EXPECT_EQ( parseChunked( text, text.size() + 1 ).events,
+               parseFile( TEST_FILE_DIR + std::string( "/" ) + names[ i ] )
+                 .events ) << names[ i ];
+  }
+}
+
+TEST(ParseFile,MissingFile)
+{
+  webvtt_status status;
+  parseFile( TEST_FILE_DIR + std::string( "/no-such-file.vtt" ), &status );
+  EXPECT_EQ( WEBVTT_UNSUCCESSFUL, status );
+}
+
+#ifndef _WIN32
+/**
+ * A pipe can't be mapped, so it is read in pieces; cues which straddle them
+ * come out the same.
+ */
+TEST(ParseFile,Pipe)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 3000; ++i ) {
+    text += "00:00.000 --> 00:01.000 align:start\n<b>Some bold</b> text\n\n";
+  }
+  std::string path = "parsefile_pipe_" + std::to_string( getpid() );
+  ASSERT_EQ( 0, mkfifo( path.c_str(), 0600 ) );
+  std::thread writer( [&]() {
+    FILE *fh = fopen( path.c_str(), "wb" );
+    fwrite( text.data(), 1, text.size(), fh );
+    fclose( fh );
+  } );
+  webvtt_status status;
+  Result piped = parseFile( path, &status );
+  writer.join();
+  unlink( path.c_str() );
+
+  EXPECT_EQ( WEBVTT_SUCCESS, status );
+  EXPECT_EQ( 3000U, piped.events.size() );
+  EXPECT_EQ( parseChunked( text, text.size() + 1 ).events, piped.events );
+}
+#endif
+
+/**
+ * With more threads than blank lines, small files are cut at nearly every
+ * block, and still come out exactly as they would on one thread.
+ */
+TEST(ParseParallel,SameAsChunkedForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  const webvtt_uint threads[] = { 2, 3, 8, 64 };
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string text = readFixture( names[ i ] );
+    Result chunked = parseChunked( text, text.size() + 1 );
+    for( size_t t = 0; t < sizeof( threads ) / sizeof( threads[ 0 ] ); ++t ) {
+      EXPECT_EQ( chunked.events, parseParallel( text, threads[ t ] ).events )
+        << names[ i ] << " on " << threads[ t ] << " threads";
+    }
+  }
+}
+
+TEST(ParseParallel,LargeDocument)
+{
+  std::string text( "WEBVTT\r\n\r\n" );
+  for( int i = 0; i < 5000; ++i ) {
+    std::ostringstream cue;
+    cue << "cue " << i << ( i % 2 ? "\r\n" : "\n" );
+    cue << "00:" << ( i % 60 < 10 ? "0" : "" ) << i % 60
+        << ".000 --> 01:00.000";
+    cue << ( i % 7 ? " align:start" : " line:bad" ) << "\n";
+    cue << "<c.x>Line " << i << "</c> &amp; more\n";
+    if( i % 11 == 0 ) {
+      cue << "\n\nNOTE a comment\n";
+    }
+    cue << ( i % 5 ? "\n" : "\n\n\n" );
+    text += cue.str();
+  }
+  Result sequential = parseBuffer( text );
+  EXPECT_LT( 5000U, sequential.events.size() );
+  EXPECT_EQ( sequential.events, parseParallel( text, 0 ).events );
+  EXPECT_EQ( sequential.events, parseParallel( text, 4 ).events );
+  EXPECT_EQ( sequential.events, parseParallel( text, 64 ).events );
+  EXPECT_EQ( parseBuffer( text, WEBVTT_PARSER_BORROW_INPUT ).events,
+             parseParallel( text, 5, WEBVTT_PARSER_BORROW_INPUT ).events );
+  EXPECT_EQ( sequential.events,
+             parseParallel( text, 5, WEBVTT_PARSER_USE_ARENA ).events );
+}
+
+/**
+ * Left to choose, webvtt_parse_parallel() goes one way for every 64 KiB, as
+ * far as there are processors.
+ */
+TEST(ParseParallel,AutomaticThreads)
+{
+  EXPECT_EQ( 1U, webvtt_parallel_threads( 0, 8 ) );
+  EXPECT_EQ( 1U, webvtt_parallel_threads( 0x1FFFF, 8 ) );
+  EXPECT_EQ( 2U, webvtt_parallel_threads( 0x20000, 8 ) );
+  EXPECT_EQ( 5U, webvtt_parallel_threads( 5 * 0x10000 + 100, 8 ) );
+  EXPECT_EQ( 8U, webvtt_parallel_threads( 0x1000000, 8 ) );
+  EXPECT_EQ( 1U, webvtt_parallel_threads( 0x1000000, 1 ) );
+}
+
+TEST(ParseParallel,Automatic)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; text.size() < 5 * 0x10000; ++i ) {
+    text += "00:00.000 --> 00:01.000" + std::string( i % 9 ? "" : " size:x" )
+            + "\n<b>Cue</b> " + std::to_string( i ) + "\n\n";
+  }
+  Result sequential = parseBuffer( text );
+  EXPECT_EQ( sequential.events, parseParallel( text, 0 ).events );
+  EXPECT_EQ( parseBuffer( text, WEBVTT_PARSER_LAZY_CUETEXT ).events,
+             parseParallel( text, 0, WEBVTT_PARSER_LAZY_CUETEXT ).events );
+}
+
+/**
+ * Segments are only cut at LF line endings, but may hold lines ending in a
+ * lone CR. Errors after the cut still get the line numbers they have in the
+ * whole text.
+ */
+TEST(ParseParallel,CrLineEndingsAfterCut)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 60; ++i ) {
+    text += "00:00.000 --> 00:01.000\nLF " + std::to_string( i ) + "\n\n";
+  }
+  for( int i = 0; i < 40; ++i ) {
+    text += "cue " + std::to_string( i ) + "\r00:00.000 --> 00:01.000"
+            + ( i % 3 ? "" : " line:bad" ) + "\rCR\r" + std::to_string( i )
+            + "\r\r";
+  }
+  Result sequential = parseBuffer( text );
+  size_t errors = 0;
+  for( size_t i = 0; i < sequential.events.size(); ++i ) {
+    errors += sequential.events[ i ].compare( 0, 6, "error " ) == 0;
+  }
+  EXPECT_EQ( 14U, errors );
+  EXPECT_EQ( sequential.events, parseParallel( text, 2 ).events );
+  EXPECT_EQ( sequential.events, parseParallel( text, 3 ).events );
+  EXPECT_EQ( sequential.events, parseParallel( text, 8 ).events );
+}
+
+namespace {
+
+/**
+ * Counts the cues it is given, and stops at the first error.
+ */
+struct Abort
+{
+  int cues;
+  int errors;
+
+  static void WEBVTT_CALLBACK onCue( void *userdata, webvtt_cue *cue ) {
+    ++static_cast<Abort *>( userdata )->cues;
+    webvtt_release_cue( &cue );
+  }
+
+  static int WEBVTT_CALLBACK onError( void *userdata, webvtt_uint,
+                                      webvtt_uint, webvtt_error ) {
+    ++static_cast<Abort *>( userdata )->errors;
+    return -1;
+  }
+};
+
+}
+
+TEST(ParseParallel,ErrorCallbackStopsDelivery)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 100; ++i ) {
+    text += i == 50 ? "00:00.000 --> 00:01.000 line:bad\nBad\n\n"
+                    : "00:00.000 --> 00:01.000\nGood\n\n";
+  }
+  Abort abort = { 0, 0 };
+  webvtt_parser parser;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &Abort::onCue, &Abort::onError, &abort,
+                                   &parser ) );
+  EXPECT_EQ( WEBVTT_PARSE_ERROR,
+             webvtt_parse_parallel( parser, text.data(),
+                                    static_cast<webvtt_uint>( text.size() ),
+                                    8 ) );
+  webvtt_delete_parser( parser );
+  EXPECT_EQ( 1, abort.errors );
+  EXPECT_GE( 51, abort.cues );
+}
+
+TEST(ParseParallel,BadHeaderStopsEverything)
+{
+  std::string text( "WEBVTX\n\n" );
+  for( int i = 0; i < 100; ++i ) {
+    text += "00:00.000 --> 00:01.000\nText\n\n";
+  }
+  EXPECT_EQ( parseBuffer( text ).events, parseParallel( text, 8 ).events );
+}
+
+namespace {
+
+class CollectingParser : public WebVTT::ParallelFileParser
+{
+public:
+  CollectingParser( const char *path, WebVTT::uint threads )
+    : WebVTT::ParallelFileParser( path, threads ) {}
+
+  virtual bool reportError( const WebVTT::Error &error ) {
+    errors.push_back( error.line() );
+    return true;
+  }
+
+  virtual void parsedCue( WebVTT::Cue &cue ) {
+    bodies.push_back( cue.body().utf8() );
+  }
+
+  std::vector<std::string> bodies;
+  std::vector<WebVTT::uint> errors;
+};
+
+}
+
+TEST(ParallelFileParser,ParsesFile)
+{
+  std::vector<std::string> names = fixtures();
+  for( size_t i = 0; i < names.size(); ++i ) {
+    std::string path = TEST_FILE_DIR + std::string( "/" ) + names[ i ];
+    CollectingParser one( path.c_str(), 1 ), many( path.c_str(), 4 );
+    EXPECT_EQ( one.parse(), many.parse() ) << names[ i ];
+    EXPECT_EQ( one.bodies, many.bodies ) << names[ i ];
+    EXPECT_EQ( one.errors, many.errors ) << names[ i ];
+  }
+}
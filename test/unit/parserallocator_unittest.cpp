@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "cuecollector_testfixture"
+
+namespace {
+
+struct CountingAllocator {
+  CountingAllocator() : allocs( 0 ), frees( 0 ) {}
+  size_t allocs;
+  size_t frees;
+};
+
+void *WEBVTT_CALLBACK
+countingAlloc( void *userdata, webvtt_uint nb )
+{
+  ++static_cast<CountingAllocator *>( userdata )->allocs;
+  return malloc( nb );
+}
+
+void WEBVTT_CALLBACK
+countingFree( void *userdata, void *ptr )
+{
+  ++static_cast<CountingAllocator *>( userdata )->frees;
+  free( ptr );
+}
+
+const char Simple[] =
+  "WEBVTT\n"
+  "\n"
+  "first\n"
+  "00:00.000 --> 00:01.000 align:start\n"
+  "<b>Hello</b> <i>World</i>\n"
+  "\n"
+  "00:01.000 --> 00:02.000\n"
+  "<v Bob>Bye</v>\n";
+
+webvtt_parser
+createParser( CountingAllocator &counter, std::vector<webvtt_cue *> &cues,
+              webvtt_uint flags = 0 )
+{
+  webvtt_parser_options options = { 0 };
+  webvtt_parser parser = 0;
+  options.flags = flags;
+  options.alloc = &countingAlloc;
+  options.free = &countingFree;
+  options.alloc_data = &counter;
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &collectCue, &ignoreError,
+                                                &cues, &options, &parser ) );
+  return parser;
+}
+
+void
+parseSimple( webvtt_parser parser )
+{
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, Simple, sizeof( Simple ) - 1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+}
+
+}
+
+TEST(ParserAllocator,UsesParserFunctions)
+{
+  CountingAllocator counter;
+  std::vector<webvtt_cue *> cues;
+  webvtt_parser parser = createParser( counter, cues );
+  ASSERT_TRUE( parser != 0 );
+  size_t created = counter.allocs;
+  EXPECT_LT( 0U, created );
+
+  parseSimple( parser );
+  ASSERT_EQ( 2U, cues.size() );
+  EXPECT_LT( created, counter.allocs );
+
+  releaseCues( cues );
+  webvtt_delete_parser( parser );
+  EXPECT_EQ( counter.allocs, counter.frees );
+}
+
+/**
+ * The parser's allocation context stays alive for as long as anything
+ * allocated from it does.
+ */
+TEST(ParserAllocator,CuesOutliveParser)
+{
+  CountingAllocator counter;
+  std::vector<webvtt_cue *> cues;
+  webvtt_parser parser = createParser( counter, cues );
+  ASSERT_TRUE( parser != 0 );
+  parseSimple( parser );
+  webvtt_delete_parser( parser );
+
+  ASSERT_EQ( 2U, cues.size() );
+  EXPECT_LT( counter.frees, counter.allocs );
+  EXPECT_STREQ( "first", webvtt_string_text( &cues[ 0 ]->id ) );
+  releaseCues( cues );
+  EXPECT_EQ( counter.allocs, counter.frees );
+}
+
+TEST(ParserAllocator,ArenaChunksComeFromParserFunctions)
+{
+  CountingAllocator counter;
+  std::vector<webvtt_cue *> cues;
+  webvtt_parser parser = createParser( counter, cues,
+                                       WEBVTT_PARSER_USE_ARENA );
+  ASSERT_TRUE( parser != 0 );
+  parseSimple( parser );
+  ASSERT_EQ( 2U, cues.size() );
+  releaseCues( cues );
+  webvtt_delete_parser( parser );
+  EXPECT_LT( 0U, counter.allocs );
+  EXPECT_EQ( counter.allocs, counter.frees );
+}
+
+/**
+ * Parsers on different threads share no allocator state, so the counters of
+ * each thread's allocator must balance exactly.
+ */
+TEST(ParserAllocator,ConcurrentParsers)
+{
+  const int threads = 4;
+  std::vector<CountingAllocator> counters( threads );
+  std::vector<std::thread> workers;
+  for( int t = 0; t < threads; ++t ) {
+    workers.push_back( std::thread( [&counters, t]() {
+      for( int i = 0; i < 200; ++i ) {
+        std::vector<webvtt_cue *> cues;
+        webvtt_parser parser = createParser( counters[ t ], cues,
+                                             ( i & 1 ) ? WEBVTT_PARSER_USE_ARENA
+                                                       : 0 );
+        parseSimple( parser );
+        EXPECT_EQ( 2U, cues.size() );
+        releaseCues( cues );
+        webvtt_delete_parser( parser );
+      }
+    } ) );
+  }
+  for( int t = 0; t < threads; ++t ) {
+    workers[ t ].join();
+    EXPECT_EQ( counters[ t ].allocs, counters[ t ].frees );
+  }
+}
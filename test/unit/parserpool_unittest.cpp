@@ -0,0 +1,307 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <webvttxx/abstract_parser>
+#include <webvttxx/cue>
+#include <webvttxx/parser_pool>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "record_testfixture"
+#include "webvtt/parser_internal.h"
+
+namespace {
+
+webvtt_parser
+create( Recording &result, webvtt_uint flags = 0 )
+{
+  webvtt_parser_options options = { 0 };
+  webvtt_parser parser = 0;
+  options.flags = flags;
+  EXPECT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &recordCue, &recordError,
+                                                &result, &options, &parser ) );
+  return parser;
+}
+
+Recording
+parseFresh( const std::string &text, webvtt_uint flags = 0 )
+{
+  Recording result;
+  webvtt_parser parser = create( result, flags );
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  webvtt_delete_parser( parser );
+  return result;
+}
+
+const char Document[] =
+  "WEBVTT\n"
+  "\n"
+  "first\n"
+  "00:00.000 --> 00:01.000 align:start\n"
+  "<b>Hello</b> world\n"
+  "\n"
+  "00:01.000 --> 00:02.000 align:nowhere\n"
+  "second\n";
+
+}
+
+/**
+ * Reusing one parser for every fixture gives what a new parser for each
+ * would have, however it allocates.
+ */
+TEST(ResetParser,SameAsFreshParserForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  const webvtt_uint flags[] = { 0, WEBVTT_PARSER_USE_ARENA,
+                                WEBVTT_PARSER_BORROW_INPUT };
+  for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[ 0 ] ); ++f ) {
+    Recording reused;
+    webvtt_parser parser = create( reused, flags[ f ] );
+    for( size_t i = 0; i < names.size(); ++i ) {
+      std::string text = readFixture( names[ i ] );
+      reused.cues.clear();
+      reused.errors.clear();
+      webvtt_reset_parser( parser );
+      webvtt_parse_buffer( parser, text.data(),
+                           static_cast<webvtt_uint>( text.size() ) );
+      expectSameRecording( parseFresh( text, flags[ f ] ), reused, names[ i ] );
+    }
+    webvtt_delete_parser( parser );
+  }
+}
+
+/**
+ * A document left half way through is forgotten, cue and all.
+ */
+TEST(ResetParser,MidDocument)
+{
+  const char partial[] = "\xEF\xBB\xBFWEBVTT\n\nid\n00:00.000 --> 00:0";
+  std::string text( Document );
+  Recording result;
+  webvtt_parser parser = create( result );
+  webvtt_parse_chunk( parser, partial, sizeof( partial ) - 1 );
+  webvtt_reset_parser( parser );
+  ASSERT_TRUE( result.cues.empty() );
+
+  /* In pieces, so that a line is left in the line buffer */
+  for( size_t i = 0; i < text.size(); i += 7 ) {
+    size_t n = text.size() - i < 7 ? text.size() - i : 7;
+    webvtt_parse_chunk( parser, text.data() + i,
+                        static_cast<webvtt_uint>( n ) );
+  }
+  webvtt_finish_parsing( parser );
+  expectSameRecording( parseFresh( text ), result, "after partial document" );
+
+  webvtt_delete_parser( parser );
+}
+
+TEST(ResetParser,MidCuetext)
+{
+  const char partial[] = "WEBVTT\n\n00:00.000 --> 00:01.000\n<b>unfinished";
+  std::string text( Document );
+  const webvtt_uint flags[] = { 0, WEBVTT_PARSER_USE_ARENA };
+  for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[ 0 ] ); ++f ) {
+    Recording result;
+    webvtt_parser parser = create( result, flags[ f ] );
+    webvtt_parse_chunk( parser, partial, sizeof( partial ) - 1 );
+    webvtt_reset_parser( parser );
+    webvtt_parse_buffer( parser, text.data(),
+                         static_cast<webvtt_uint>( text.size() ) );
+    expectSameRecording( parseFresh( text ), result, "after partial cue text" );
+    webvtt_delete_parser( parser );
+  }
+}
+
+/**
+ * A partial line is dropped, but the buffer it was read into is kept.
+ */
+TEST(ResetParser,KeepsLineBuffer)
+{
+  std::string partial( "WEBVTT\n\n00:00.000 --> 00:01.000\n" );
+  partial += std::string( 200, 'x' );
+  std::string text( Document );
+  Recording result;
+  webvtt_parser parser = create( result );
+  webvtt_parse_chunk( parser, partial.data(),
+                      static_cast<webvtt_uint>( partial.size() ) );
+  ASSERT_EQ( 200, webvtt_string_length( &parser->line_buffer ) );
+  const char *buffer = webvtt_string_text( &parser->line_buffer );
+
+  webvtt_reset_parser( parser );
+  EXPECT_EQ( 0, webvtt_string_length( &parser->line_buffer ) );
+  EXPECT_EQ( buffer, webvtt_string_text( &parser->line_buffer ) );
+
+  webvtt_parse_chunk( parser, text.data(),
+                      static_cast<webvtt_uint>( text.size() ) );
+  webvtt_finish_parsing( parser );
+  expectSameRecording( parseFresh( text ), result, "after partial line" );
+  webvtt_delete_parser( parser );
+}
+
+/**
+ * The parser itself is not allocated again, and the memory an arena handed
+ * out for the previous document is given back.
+ */
+TEST(ResetParser,Memory)
+{
+  std::string text( Document );
+  webvtt_alloc_stats before, after;
+  Recording result;
+  webvtt_parser parser = create( result, WEBVTT_PARSER_USE_ARENA
+                                         | WEBVTT_PARSER_ALLOC_STATS );
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_get_parser_alloc_stats( parser, &before ) );
+
+  webvtt_reset_parser( parser );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_get_parser_alloc_stats( parser, &after ) );
+  EXPECT_GT( before.total.live_bytes, after.total.live_bytes );
+
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_get_parser_alloc_stats( parser, &after ) );
+  EXPECT_EQ( before.kinds[ WEBVTT_ALLOC_PARSER_STACK ].allocs,
+             after.kinds[ WEBVTT_ALLOC_PARSER_STACK ].allocs );
+  EXPECT_EQ( 4U, result.cues.size() );
+  webvtt_delete_parser( parser );
+}
+
+TEST(ResetParser,SetCallbacks)
+{
+  std::string text( Document );
+  Recording first, second;
+  webvtt_parser parser = create( first );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_set_parser_callbacks( parser, &recordCue, &recordError,
+                                          &second ) );
+  webvtt_parse_buffer( parser, text.data(),
+                       static_cast<webvtt_uint>( text.size() ) );
+  EXPECT_TRUE( first.cues.empty() );
+  EXPECT_EQ( 2U, second.cues.size() );
+  webvtt_delete_parser( parser );
+}
+
+TEST(ResetParser,InvalidParams)
+{
+  Recording result;
+  webvtt_parser parser = create( result );
+  webvtt_reset_parser( 0 );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_set_parser_callbacks( 0, &recordCue, &recordError, 0 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_set_parser_callbacks( parser, 0, &recordError, 0 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM,
+             webvtt_set_parser_callbacks( parser, &recordCue, 0, 0 ) );
+  webvtt_delete_parser( parser );
+}
+
+namespace {
+
+class CueCounter : public WebVTT::AbstractParser
+{
+public:
+  CueCounter( WebVTT::ParserPool &pool )
+    : WebVTT::AbstractParser( pool ), cues( 0 ), errors( 0 ) {}
+
+  bool parse( const std::string &text ) {
+    return !WEBVTT_FAILED( parseBuffer( text.data(),
+                             static_cast<webvtt_uint>( text.size() ) ) );
+  }
+
+  int cues;
+  int errors;
+
+protected:
+  virtual bool reportError( const WebVTT::Error & ) {
+    ++errors;
+    return true;
+  }
+  virtual void parsedCue( WebVTT::Cue & ) { ++cues; }
+};
+
+}
+
+TEST(ParserPool,ReusesParsers)
+{
+  WebVTT::ParserPool pool;
+  Recording result;
+  webvtt_parser parser = pool.acquire( &recordCue, &recordError, &result );
+  ASSERT_TRUE( parser != 0 );
+  EXPECT_EQ( 0U, pool.idleCount() );
+  pool.release( parser );
+  EXPECT_EQ( 1U, pool.idleCount() );
+  EXPECT_EQ( parser, pool.acquire( &recordCue, &recordError, &result ) );
+  EXPECT_EQ( 0U, pool.idleCount() );
+  pool.release( parser );
+}
+
+/**
+ * An idle parser is not handed out with the previous owner's callbacks.
+ */
+TEST(ParserPool,MissingCallbacks)
+{
+  WebVTT::ParserPool pool;
+  Recording result;
+  pool.release( pool.acquire( &recordCue, &recordError, &result ) );
+  ASSERT_EQ( 1U, pool.idleCount() );
+  EXPECT_TRUE( pool.acquire( 0, &recordError, &result ) == 0 );
+  EXPECT_TRUE( pool.acquire( &recordCue, 0, &result ) == 0 );
+  EXPECT_EQ( 1U, pool.idleCount() );
+}
+
+TEST(ParserPool,KeepsAtMostMaxIdle)
+{
+  WebVTT::ParserPool pool( WEBVTT_PARSER_USE_ARENA, 2 );
+  EXPECT_EQ( ( webvtt_uint )WEBVTT_PARSER_USE_ARENA, pool.flags() );
+  Recording result;
+  webvtt_parser parsers[ 3 ];
+  for( int i = 0; i < 3; ++i ) {
+    parsers[ i ] = pool.acquire( &recordCue, &recordError, &result );
+  }
+  for( int i = 0; i < 3; ++i ) {
+    pool.release( parsers[ i ] );
+  }
+  EXPECT_EQ( 2U, pool.idleCount() );
+  pool.release( 0 );
+  EXPECT_EQ( 2U, pool.idleCount() );
+}
+
+TEST(ParserPool,AbstractParsersShareParsers)
+{
+  WebVTT::ParserPool pool;
+  std::string text( Document );
+  for( int i = 0; i < 3; ++i ) {
+    CueCounter parser( pool );
+    ASSERT_TRUE( parser.parse( text ) );
+    EXPECT_EQ( 2, parser.cues );
+    EXPECT_EQ( 1, parser.errors );
+  }
+  EXPECT_EQ( 1U, pool.idleCount() );
+}
+
+TEST(ParserPool,ManyThreads)
+{
+  WebVTT::ParserPool pool( 0, 4 );
+  std::string text( Document );
+  std::vector<std::thread> threads;
+  std::vector<int> totals( 8, 0 );
+  for( size_t t = 0; t < totals.size(); ++t ) {
+    threads.push_back( std::thread( [&pool, &text, &totals, t]() {
+      for( int i = 0; i < 200; ++i ) {
+        CueCounter parser( pool );
+        parser.parse( text );
+        totals[ t ] += parser.cues;
+      }
+    } ) );
+  }
+  for( size_t t = 0; t < threads.size(); ++t ) {
+    threads[ t ].join();
+  }
+  for( size_t t = 0; t < totals.size(); ++t ) {
+    EXPECT_EQ( 400, totals[ t ] );
+  }
+  EXPECT_GE( 4U, pool.idleCount() );
+  EXPECT_LT( 0U, pool.idleCount() );
+}
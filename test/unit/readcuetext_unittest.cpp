@@ -38,7 +38,7 @@ public:
   }
 
   std::string cuetext() const {
-    return std::string( reinterpret_cast<const char *>( cue->body.d->text ) );
+    return std::string( webvtt_string_text( &cue->body ) );
   }
 
   webvtt_state_value_type uptype() const {
@@ -46,8 +46,7 @@ public:
   }
 
   std::string uptext() const {
-    return std::string( reinterpret_cast<const char *>(
-      (self->top+1)->v.text.d->text ) );
+    return std::string( webvtt_string_text( &(self->top+1)->v.text ) );
   }
 
 private:
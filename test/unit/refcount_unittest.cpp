@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cuecollector_testfixture"
+
+#ifndef WEBVTT_NO_ATOMIC_REFCOUNT
+
+namespace {
+
+const char Cues[] =
+  "WEBVTT\n"
+  "\n"
+  "00:00.000 --> 00:01.000\n"
+  "<b>Hello</b> <i>World</i>\n"
+  "\n"
+  "00:01.000 --> 00:02.000\n"
+  "<v Bob>Bye</v>\n";
+
+/**
+ * Cues handed from the parsing thread to a consumer as they are parsed
+ */
+struct Handoff
+{
+  std::mutex lock;
+  std::condition_variable ready;
+  std::deque<webvtt_cue *> cues;
+  bool done;
+};
+
+void WEBVTT_CALLBACK
+onHandoff( void *userdata, webvtt_cue *cue )
+{
+  Handoff *handoff = static_cast<Handoff *>( userdata );
+  std::lock_guard<std::mutex> guard( handoff->lock );
+  handoff->cues.push_back( cue );
+  handoff->ready.notify_one();
+}
+
+const int Threads = 4;
+const int Iterations = 20000;
+
+}
+
+TEST(RefCount,StringSharedBetweenThreads)
+{
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &str, "shared between threads",
+                                             -1 ) );
+
+  std::vector<std::thread> workers;
+  for( int t = 0; t < Threads; ++t ) {
+    workers.push_back( std::thread( [&str]() {
+      for( int i = 0; i < Iterations; ++i ) {
+        webvtt_string copy;
+        webvtt_copy_string( &copy, &str );
+        webvtt_release_string( &copy );
+      }
+    } ) );
+  }
+  for( size_t t = 0; t < workers.size(); ++t ) {
+    workers[ t ].join();
+  }
+
+  EXPECT_STREQ( "shared between threads", webvtt_string_text( &str ) );
+  webvtt_release_string( &str );
+}
+
+/**
+ * Copies of a shared string being changed on several threads each get text
+ * of their own, and leave the original alone.
+ */
+TEST(RefCount,SharedStringsDetachOnWrite)
+{
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &str, "shared between threads",
+                                             -1 ) );
+
+  std::vector<std::thread> workers;
+  for( int t = 0; t < Threads; ++t ) {
+    workers.push_back( std::thread( [&str]() {
+      for( int i = 0; i < Iterations / 10; ++i ) {
+        webvtt_string copy;
+        webvtt_copy_string( &copy, &str );
+        EXPECT_EQ( WEBVTT_SUCCESS, webvtt_string_putc( &copy, '!' ) );
+        EXPECT_STREQ( "shared between threads!", webvtt_string_text( &copy ) );
+        webvtt_release_string( &copy );
+      }
+    } ) );
+  }
+  for( size_t t = 0; t < workers.size(); ++t ) {
+    workers[ t ].join();
+  }
+
+  EXPECT_STREQ( "shared between threads", webvtt_string_text( &str ) );
+  webvtt_release_string( &str );
+}
+
+/**
+ * Cues produced on one thread may be referenced and released on others.
+ */
+TEST(RefCount,CuesSharedBetweenThreads)
+{
+  std::vector<webvtt_cue *> cues;
+  webvtt_parser parser;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &collectCue, &ignoreError,
+                                   &cues, &parser ) );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, Cues, sizeof( Cues ) - 1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  webvtt_delete_parser( parser );
+  ASSERT_EQ( 2U, cues.size() );
+
+  std::vector<std::thread> workers;
+  for( int t = 0; t < Threads; ++t ) {
+    workers.push_back( std::thread( [&cues]() {
+      for( int i = 0; i < Iterations; ++i ) {
+        webvtt_cue *cue = cues[ i & 1 ];
+        webvtt_node *node = cue->node_head;
+        webvtt_ref_cue( cue );
+        webvtt_ref_node( node );
+        webvtt_release_node( &node );
+        webvtt_release_cue( &cue );
+      }
+    } ) );
+  }
+  for( size_t t = 0; t < workers.size(); ++t ) {
+    workers[ t ].join();
+  }
+
+  for( size_t i = 0; i < cues.size(); ++i ) {
+    EXPECT_EQ( 1, cues[ i ]->refs.value );
+    EXPECT_EQ( 1, cues[ i ]->node_head->refs.value );
+  }
+
+  /* The last reference may be dropped on another thread. */
+  std::thread( [&cues]() {
+    for( size_t i = 0; i < cues.size(); ++i ) {
+      webvtt_release_cue( &cues[ i ] );
+    }
+  } ).join();
+}
+
+/**
+ * Cues may be released on another thread while their parser is still
+ * parsing, and allocating from the same context.
+ */
+TEST(RefCount,CuesReleasedWhileParsing)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 2000; ++i ) {
+    text += "00:00.000 --> 00:01.000\n<b>cue</b> <i>" + std::to_string( i )
+            + "</i>\n\n";
+  }
+
+  Handoff handoff;
+  handoff.done = false;
+  webvtt_parser parser;
+  webvtt_parser_options options = { 0 };
+  options.flags = WEBVTT_PARSER_LAZY_CUETEXT | WEBVTT_PARSER_ALLOC_STATS;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser_with_options( &onHandoff, &ignoreError,
+                                                &handoff, &options,
+                                                &parser ) );
+
+  int consumed = 0;
+  std::thread consumer( [&handoff, &consumed]() {
+    std::unique_lock<std::mutex> guard( handoff.lock );
+    for( ;; ) {
+      handoff.ready.wait( guard, [&handoff]() {
+        return handoff.done || !handoff.cues.empty();
+      } );
+      if( handoff.cues.empty() ) {
+        break;
+      }
+      webvtt_cue *cue = handoff.cues.front();
+      handoff.cues.pop_front();
+      guard.unlock();
+      webvtt_string body;
+      webvtt_copy_string( &body, &cue->body );
+      EXPECT_TRUE( webvtt_cue_get_nodes( cue ) != 0 );
+      webvtt_release_string( &body );
+      webvtt_release_cue( &cue );
+      ++consumed;
+      guard.lock();
+    }
+  } );
+
+  for( size_t at = 0; at < text.size(); at += 61 ) {
+    size_t len = std::min<size_t>( 61, text.size() - at );
+    webvtt_parse_chunk( parser, text.data() + at,
+                        static_cast<webvtt_uint>( len ) );
+  }
+  webvtt_finish_parsing( parser );
+  {
+    std::lock_guard<std::mutex> guard( handoff.lock );
+    handoff.done = true;
+    handoff.ready.notify_one();
+  }
+  consumer.join();
+  EXPECT_EQ( 2000, consumed );
+
+  webvtt_alloc_stats stats;
+  webvtt_get_parser_alloc_stats( parser, &stats );
+  EXPECT_EQ( stats.kinds[ WEBVTT_ALLOC_CUE ].allocs,
+             stats.kinds[ WEBVTT_ALLOC_CUE ].frees );
+  EXPECT_EQ( 0U, stats.kinds[ WEBVTT_ALLOC_CUE ].live_bytes );
+  EXPECT_EQ( stats.kinds[ WEBVTT_ALLOC_NODE ].allocs,
+             stats.kinds[ WEBVTT_ALLOC_NODE ].frees );
+  EXPECT_EQ( 0U, stats.kinds[ WEBVTT_ALLOC_NODE ].live_bytes );
+  webvtt_delete_parser( parser );
+}
+
+#endif
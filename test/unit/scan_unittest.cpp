@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+extern "C" {
+#include "webvtt/scan_internal.h"
+}
+
+/**
+ * Runs every test once for each set of routines the processor supports.
+ */
+class Scan : public ::testing::TestWithParam<webvtt_scan_level>
+{
+public:
+  virtual void SetUp() {
+    saved = webvtt_get_scan_level();
+    if( webvtt_set_scan_level( GetParam() ) != GetParam() ) {
+      supported = false;
+    }
+  }
+
+  virtual void TearDown() {
+    webvtt_set_scan_level( saved );
+  }
+
+protected:
+  webvtt_scan_level saved;
+  bool supported = true;
+};
+
+TEST_P(Scan,FindsFirstMatchAtEveryOffset)
+{
+  if( !supported ) {
+    return;
+  }
+  std::string text( 100, 'x' );
+  for( size_t start = 0; start < 40; ++start ) {
+    for( size_t at = start; at < text.size(); ++at ) {
+      std::string s = text;
+      s[ at ] = '\n';
+      if( at + 5 < s.size() ) {
+        s[ at + 5 ] = '\r';
+      }
+      const char *begin = s.data() + start;
+      const char *end = s.data() + s.size();
+      EXPECT_EQ( s.data() + at, webvtt_scan_eol( begin, end ) );
+      EXPECT_EQ( s.data() + at, webvtt_scan3( begin, end, 'a', 'b', '\n' ) );
+    }
+  }
+}
+
+TEST_P(Scan,NoMatchReturnsEnd)
+{
+  if( !supported ) {
+    return;
+  }
+  std::string s( 77, 'x' );
+  /* Bytes past 'end' are not looked at */
+  s[ 70 ] = '\n';
+  for( size_t len = 0; len < 70; ++len ) {
+    EXPECT_EQ( s.data() + len, webvtt_scan_eol( s.data(), s.data() + len ) );
+  }
+}
+
+TEST_P(Scan,HighBytes)
+{
+  if( !supported ) {
+    return;
+  }
+  std::string s( 64, '\xC3' );
+  s[ 37 ] = '\xA9';
+  EXPECT_EQ( s.data() + 37,
+             webvtt_scan2( s.data(), s.data() + s.size(), '\xA9', '<' ) );
+}
+
+TEST_P(Scan,CStringStopsAtTerminator)
+{
+  if( !supported ) {
+    return;
+  }
+  std::vector<char> buffer( 256, 'x' );
+  for( size_t start = 0; start < 64; ++start ) {
+    for( size_t nul = start; nul < 128; ++nul ) {
+      buffer[ nul ] = '\0';
+      EXPECT_EQ( &buffer[ nul ],
+                 webvtt_scan_cstr2( &buffer[ start ], '&', '<' ) );
+      buffer[ nul ] = 'x';
+    }
+  }
+}
+
+TEST_P(Scan,CStringFindsDelimiters)
+{
+  if( !supported ) {
+    return;
+  }
+  std::string s( "some cue text which is longer than a vector &amp; <b>" );
+  const char *amp = s.c_str() + s.find( '&' );
+  const char *lt = s.c_str() + s.find( '<' );
+  for( const char *p = s.c_str(); p <= amp; ++p ) {
+    EXPECT_EQ( amp, webvtt_scan_cstr2( p, '&', '<' ) );
+  }
+  EXPECT_EQ( lt, webvtt_scan_cstr2( amp + 1, '&', '<' ) );
+}
+
+namespace {
+
+/**
+ * Straightforward decoder to check the validators against: the offset of the
+ * first ill-formed sequence, or the length of 's'.
+ */
+size_t
+firstInvalid( const std::string &s )
+{
+  size_t i = 0;
+  while( i < s.size() ) {
+    unsigned char c = s[ i ];
+    size_t n;
+    unsigned long cp;
+    if( c < 0x80 ) {
+      ++i;
+      continue;
+    } else if( ( c & 0xE0 ) == 0xC0 ) {
+      n = 2, cp = c & 0x1F;
+    } else if( ( c & 0xF0 ) == 0xE0 ) {
+      n = 3, cp = c & 0x0F;
+    } else if( ( c & 0xF8 ) == 0xF0 ) {
+      n = 4, cp = c & 0x07;
+    } else {
+      return i;
+    }
+    if( i + n > s.size() ) {
+      return i;
+    }
+    for( size_t k = 1; k < n; ++k ) {
+      unsigned char t = s[ i + k ];
+      if( ( t & 0xC0 ) != 0x80 ) {
+        return i;
+      }
+      cp = ( cp << 6 ) | ( t & 0x3F );
+    }
+    static const unsigned long minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if( cp < minimum[ n ] || cp > 0x10FFFF
+        || ( cp >= 0xD800 && cp <= 0xDFFF ) ) {
+      return i;
+    }
+    i += n;
+  }
+  return i;
+}
+
+}
+
+TEST_P(Scan,Utf8ValidatesLikeDecoder)
+{
+  if( !supported ) {
+    return;
+  }
+  /* Mostly well-formed text with the occasional stray byte */
+  const char *pieces[] = { "plain ascii text ", "\xC3\xA9", "\xE2\x82\xAC",
+                           "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF", "\n" };
+  const unsigned char strays[] = { 0x80, 0xBF, 0xC0, 0xC1, 0xE0, 0xED, 0xF0,
+                                   0xF4, 0xF5, 0xFF };
+  unsigned seed = 1;
+  for( int round = 0; round < 2000; ++round ) {
+    std::string s;
+    while( s.size() < 200 ) {
+      seed = seed * 1103515245 + 12345;
+      s += pieces[ ( seed >> 16 ) % 6 ];
+    }
+    if( round % 4 ) {
+      seed = seed * 1103515245 + 12345;
+      size_t at = ( seed >> 16 ) % s.size();
+      s[ at ] = strays[ ( seed >> 8 ) % sizeof( strays ) ];
+    }
+    /* Cut off at every length near the end, to catch open sequences */
+    size_t len = s.size() - round % 5;
+    std::string t = s.substr( 0, len );
+    const char *end = t.data() + t.size();
+    EXPECT_EQ( firstInvalid( t ),
+               ( size_t )( webvtt_scan_utf8_invalid( t.data(), end )
+                           - t.data() ) ) << "round " << round;
+  }
+}
+
+TEST_P(Scan,Utf8RejectsEveryBadSecondByte)
+{
+  if( !supported ) {
+    return;
+  }
+  /* Each two byte prefix, at each position in a block */
+  for( int lead = 0x80; lead < 0x100; ++lead ) {
+    for( int next = 0; next < 0x100; next += 0x10 ) {
+      std::string s( 40, 'x' );
+      s[ 33 ] = ( char )lead;
+      s[ 34 ] = ( char )next;
+      s[ 35 ] = ( char )0x80;
+      s[ 36 ] = ( char )0x80;
+      EXPECT_EQ( firstInvalid( s ),
+                 ( size_t )( webvtt_scan_utf8_invalid( s.data(),
+                                                        s.data() + s.size() )
+                             - s.data() ) ) << std::hex << lead << " " << next;
+    }
+  }
+}
+
+TEST_P(Scan,CountsLeadBytes)
+{
+  if( !supported ) {
+    return;
+  }
+  std::string s;
+  size_t expected = 0;
+  for( int i = 0; i < 3000; ++i ) {
+    s += "a\xC3\xA9\xE2\x82\xAC";
+    expected += 3;
+  }
+  for( size_t len = s.size() - 40; len <= s.size(); ++len ) {
+    size_t leads = 0;
+    for( size_t i = 0; i < len; ++i ) {
+      leads += ( s[ i ] & 0xC0 ) != 0x80;
+    }
+    EXPECT_EQ( leads, webvtt_count_utf8_leads( s.data(), s.data() + len ) );
+  }
+  EXPECT_EQ( expected,
+             webvtt_count_utf8_leads( s.data(), s.data() + s.size() ) );
+}
+
+TEST_P(Scan,WidensAscii)
+{
+  if( !supported ) {
+    return;
+  }
+  std::string s;
+  for( int i = 0; i < 100; ++i ) {
+    s += ( char )( 32 + i % 90 );
+  }
+  for( size_t stop = 0; stop <= 70; ++stop ) {
+    std::string t = s;
+    if( stop < 70 ) {
+      t[ stop ] = ( char )0xC3;
+    }
+    std::vector<webvtt_uint16> out( t.size(), 0 );
+    const char *end = t.data() + 70;
+    EXPECT_EQ( t.data() + stop, webvtt_widen_ascii( t.data(), end, &out[ 0 ] ) );
+    EXPECT_EQ( t.data() + stop, webvtt_widen_ascii( t.data(), end, 0 ) );
+    for( size_t i = 0; i < stop; ++i ) {
+      ASSERT_EQ( ( webvtt_uint16 )t[ i ], out[ i ] );
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Levels, Scan,
+                        ::testing::Values( WEBVTT_SCAN_SCALAR,
+                                           WEBVTT_SCAN_SSE2,
+                                           WEBVTT_SCAN_AVX2,
+                                           WEBVTT_SCAN_NEON ));
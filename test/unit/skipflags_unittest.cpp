@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <string>
+#include <vector>
+#include "record_testfixture"
+
+namespace {
+
+struct Result
+{
+  std::vector<webvtt_cue *> cues;
+  std::vector<RecordedError> errors;
+};
+
+void WEBVTT_CALLBACK
+onCue( void *userdata, webvtt_cue *cue )
+{
+  static_cast<Result *>( userdata )->cues.push_back( cue );
+}
+
+int WEBVTT_CALLBACK
+onError( void *userdata, webvtt_uint line, webvtt_uint column,
+         webvtt_error error )
+{
+  RecordedError e = { line, column, error };
+  static_cast<Result *>( userdata )->errors.push_back( e );
+  return 0;
+}
+
+const char Document[] =
+  "WEBVTT\n"
+  "\n"
+  "chapter-1\n"
+  "00:00.000 --> 00:01.000 align:start line:10% size:50%\n"
+  "<b>Hello</b> world\n"
+  "\n"
+  "chapter-2\n"
+  "00:01.000 --> 00:02.000 align:nowhere\n"
+  "{\"key\": \"<not a tag>\"}\n";
+
+}
+
+class SkipFlags : public ::testing::Test
+{
+public:
+  virtual void TearDown() {
+    release( result );
+  }
+
+  static void release( Result &r ) {
+    for( size_t i = 0; i < r.cues.size(); ++i ) {
+      webvtt_release_cue( &r.cues[ i ] );
+    }
+    r.cues.clear();
+    r.errors.clear();
+  }
+
+  static void parse( const std::string &text, webvtt_uint flags, Result &r,
+                     webvtt_uint threads = 1 ) {
+    webvtt_parser_options options = { 0 };
+    webvtt_parser parser;
+    options.flags = flags;
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_parser_with_options( &onCue, &onError, &r,
+                                                  &options, &parser ) );
+    webvtt_parse_parallel( parser, text.data(),
+                           static_cast<webvtt_uint>( text.size() ), threads );
+    webvtt_delete_parser( parser );
+  }
+
+protected:
+  Result result;
+};
+
+TEST_F(SkipFlags,Ids)
+{
+  parse( Document, WEBVTT_PARSER_SKIP_IDS, result );
+  ASSERT_EQ( 2U, result.cues.size() );
+  for( size_t i = 0; i < result.cues.size(); ++i ) {
+    EXPECT_EQ( 0U, webvtt_string_length( &result.cues[ i ]->id ) );
+    EXPECT_TRUE( result.cues[ i ]->node_head != 0 );
+  }
+  EXPECT_EQ( 1000U, result.cues[ 0 ]->until );
+  EXPECT_EQ( WEBVTT_ALIGN_START, result.cues[ 0 ]->settings.align );
+}
+
+TEST_F(SkipFlags,Settings)
+{
+  webvtt_cue *fresh;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_cue( &fresh ) );
+  parse( Document, WEBVTT_PARSER_SKIP_SETTINGS, result );
+  ASSERT_EQ( 2U, result.cues.size() );
+  for( size_t i = 0; i < result.cues.size(); ++i ) {
+    const webvtt_cue_settings &s = result.cues[ i ]->settings;
+    EXPECT_EQ( fresh->settings.align, s.align );
+    EXPECT_EQ( fresh->settings.line, s.line );
+    EXPECT_EQ( fresh->settings.size, s.size );
+    EXPECT_EQ( fresh->settings.position, s.position );
+    EXPECT_EQ( fresh->snap_to_lines, result.cues[ i ]->snap_to_lines );
+  }
+  EXPECT_EQ( "chapter-2", textOf( &result.cues[ 1 ]->id ) );
+  /* The bad 'align' goes unnoticed */
+  EXPECT_TRUE( result.errors.empty() );
+  webvtt_release_cue( &fresh );
+}
+
+TEST_F(SkipFlags,Cuetext)
+{
+  parse( Document, WEBVTT_PARSER_SKIP_CUETEXT, result );
+  ASSERT_EQ( 2U, result.cues.size() );
+  for( size_t i = 0; i < result.cues.size(); ++i ) {
+    EXPECT_TRUE( result.cues[ i ]->node_head == 0 );
+    EXPECT_TRUE( webvtt_cue_get_nodes( result.cues[ i ] ) == 0 );
+  }
+  EXPECT_EQ( "{\"key\": \"<not a tag>\"}", textOf( &result.cues[ 1 ]->body ) );
+  EXPECT_EQ( WEBVTT_ALIGN_START, result.cues[ 0 ]->settings.align );
+}
+
+TEST_F(SkipFlags,ErrorColumns)
+{
+  Result with;
+  parse( Document, 0, with );
+  parse( Document, WEBVTT_PARSER_SKIP_ERROR_COLUMNS, result );
+  ASSERT_EQ( 1U, with.errors.size() );
+  EXPECT_LT( 0U, with.errors[ 0 ].column );
+  ASSERT_EQ( with.errors.size(), result.errors.size() );
+  EXPECT_EQ( with.errors[ 0 ].line, result.errors[ 0 ].line );
+  EXPECT_EQ( with.errors[ 0 ].error, result.errors[ 0 ].error );
+  EXPECT_EQ( 0U, result.errors[ 0 ].column );
+  release( with );
+}
+
+/**
+ * Skipping work never changes which cues come out, or when they are shown.
+ */
+TEST_F(SkipFlags,SameCuesForEveryFixture)
+{
+  std::vector<std::string> names = fixtures();
+  const webvtt_uint all = WEBVTT_PARSER_SKIP_MASK;
+  for( size_t i = 0; i < names.size(); ++i ) {
+    Result full;
+    std::string text = readFixture( names[ i ] );
+    parse( text, 0, full );
+    parse( text, all, result );
+    ASSERT_EQ( full.cues.size(), result.cues.size() ) << names[ i ];
+    for( size_t c = 0; c < full.cues.size(); ++c ) {
+      EXPECT_EQ( full.cues[ c ]->from, result.cues[ c ]->from );
+      EXPECT_EQ( full.cues[ c ]->until, result.cues[ c ]->until );
+      EXPECT_EQ( textOf( &full.cues[ c ]->body ),
+                 textOf( &result.cues[ c ]->body ) ) << names[ i ];
+    }
+    release( full );
+    release( result );
+
+    /* Leaving out columns only changes the columns */
+    parse( text, 0, full );
+    parse( text, all & ~WEBVTT_PARSER_SKIP_SETTINGS, result );
+    ASSERT_EQ( full.errors.size(), result.errors.size() ) << names[ i ];
+    for( size_t e = 0; e < full.errors.size(); ++e ) {
+      EXPECT_EQ( full.errors[ e ].line, result.errors[ e ].line );
+      EXPECT_EQ( full.errors[ e ].error, result.errors[ e ].error );
+      EXPECT_EQ( 0U, result.errors[ e ].column );
+    }
+    release( full );
+    release( result );
+  }
+}
+
+TEST_F(SkipFlags,ParallelWorkersSkipToo)
+{
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 2000; ++i ) {
+    text += "id\n00:00.000 --> 00:01.000 align:start\n<b>text</b>\n\n";
+  }
+  parse( text, WEBVTT_PARSER_SKIP_MASK, result, 4 );
+  ASSERT_EQ( 2000U, result.cues.size() );
+  for( size_t i = 0; i < result.cues.size(); ++i ) {
+    ASSERT_EQ( 0U, webvtt_string_length( &result.cues[ i ]->id ) ) << i;
+    ASSERT_TRUE( result.cues[ i ]->node_head == 0 ) << i;
+    ASSERT_NE( WEBVTT_ALIGN_START, result.cues[ i ]->settings.align ) << i;
+  }
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include <webvttxx/string>
+#include <string>
+#include <cstring>
 
 using namespace WebVTT;
 
@@ -401,3 +403,323 @@ TEST(String,ReplaceAllStrlen)
   EXPECT_STREQ( expectedOutput, webvtt_string_text( &str ) );
   webvtt_release_string( &str );
 }
+
+TEST(String,Utf8Validate)
+{
+  webvtt_uint32 invalid = 99;
+  EXPECT_TRUE( webvtt_utf8_validate( UTF8AnNyungHaSeYo, 0, &invalid ) );
+  EXPECT_EQ( 15U, invalid );
+  /* Overlong */
+  EXPECT_FALSE( webvtt_utf8_validate( "ab\xC0\xAF", 0, &invalid ) );
+  EXPECT_EQ( 2U, invalid );
+  /* Surrogate */
+  EXPECT_FALSE( webvtt_utf8_validate( "\xED\xA0\x80", 0, &invalid ) );
+  EXPECT_EQ( 0U, invalid );
+  /* Cut off */
+  EXPECT_FALSE( webvtt_utf8_validate( "abc\xE2\x82", 0, &invalid ) );
+  EXPECT_EQ( 3U, invalid );
+  EXPECT_FALSE( webvtt_utf8_validate( 0, 0, &invalid ) );
+}
+
+TEST(String,Utf8ChcountInvalidTail)
+{
+  const char text[] = "\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9"
+                      "\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\x80\x80x";
+  EXPECT_EQ( 10, webvtt_utf8_chcount( text, text + sizeof( text ) - 1 ) );
+}
+
+TEST(String,Utf8ToUtf16Buffer)
+{
+  std::string text( 100, 'a' );
+  text += "\xEC\x95\x88" "b" "\xF0\x9F\x98\x80" "c";
+  webvtt_uint16 out[ 110 ];
+  ASSERT_EQ( 105U, webvtt_utf8_to_utf16_buffer( text.data(),
+                                                text.data() + text.size(),
+                                                out, 110 ) );
+  EXPECT_EQ( 'a', out[ 0 ] );
+  EXPECT_EQ( 'a', out[ 99 ] );
+  EXPECT_EQ( 0xC548, out[ 100 ] );
+  EXPECT_EQ( 'b', out[ 101 ] );
+  EXPECT_EQ( 0xD83D, out[ 102 ] );
+  EXPECT_EQ( 0xDE00, out[ 103 ] );
+  EXPECT_EQ( 'c', out[ 104 ] );
+
+  /* Measuring only */
+  EXPECT_EQ( 105U, webvtt_utf8_to_utf16_buffer( text.c_str(), 0, 0, 0 ) );
+}
+
+TEST(String,Utf8ToUtf16BufferTooSmall)
+{
+  const char text[] = "ab\xF0\x9F\x98\x80" "cd";
+  webvtt_uint16 out[ 4 ] = { 0, 0, 0, 0 };
+  /* The pair does not fit, so nothing after it is written either */
+  EXPECT_EQ( 6U, webvtt_utf8_to_utf16_buffer( text, 0, out, 3 ) );
+  EXPECT_EQ( 'a', out[ 0 ] );
+  EXPECT_EQ( 'b', out[ 1 ] );
+  EXPECT_EQ( 0, out[ 2 ] );
+  EXPECT_EQ( 0, out[ 3 ] );
+}
+
+TEST(String,Utf8DecodeIllFormed)
+{
+  const char text[] = "\xC0\xAF" "a" "\x80\x80" "\xE2\x82";
+  const char *p = text, *end = text + sizeof( text ) - 1;
+  EXPECT_EQ( 0xFFFDU, webvtt_utf8_decode( &p, end ) );
+  EXPECT_EQ( 'a', webvtt_utf8_decode( &p, end ) );
+  EXPECT_EQ( 0xFFFDU, webvtt_utf8_decode( &p, end ) );
+  EXPECT_EQ( 0xFFFDU, webvtt_utf8_decode( &p, end ) );
+  EXPECT_EQ( end, p );
+  EXPECT_EQ( 0U, webvtt_utf8_decode( &p, end ) );
+}
+
+TEST(String,CodePointIterator)
+{
+  String str( "a\xEC\x95\x88\xF0\x9F\x98\x80z" );
+  String::CodePointIterator it = str.codePoints();
+  ASSERT_FALSE( it.atEnd() );
+  EXPECT_EQ( 'a', *it );
+  EXPECT_EQ( 0xC548U, *++it );
+  EXPECT_EQ( str.utf8() + 1, it.pointer() );
+  EXPECT_EQ( 0x1F600U, *++it );
+  EXPECT_EQ( 'z', *++it );
+  EXPECT_TRUE( ( ++it ).atEnd() );
+}
+
+/**
+ * A line made of nothing but NUL bytes is handled in linear time
+ */
+TEST(String,ReplaceAllManyMatches)
+{
+  std::string text( 1 << 18, '\0' );
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string_with_text( &str, text.data(),
+                                                             text.size() ) );
+  EXPECT_EQ( WEBVTT_SUCCESS, webvtt_string_replace_all( &str, "\0", 1,
+                                                        UTF8ReplacementChar,
+                                                        3 ) );
+  ASSERT_EQ( 3 * text.size(), webvtt_string_length( &str ) );
+  EXPECT_EQ( 0, memcmp( UTF8ReplacementChar,
+                        webvtt_string_text( &str ) + 3 * 1000, 3 ) );
+  webvtt_release_string( &str );
+}
+
+TEST(String,ReplaceAllEmptySearch)
+{
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string_with_text( &str, "potato",
+                                                             -1 ) );
+  EXPECT_EQ( WEBVTT_INVALID_PARAM, webvtt_string_replace_all( &str, "", 0,
+                                                              "T", 1 ) );
+  webvtt_release_string( &str );
+}
+
+/**
+ * webvtt_string_getline replaces NUL bytes with U+FFFD as it copies
+ */
+TEST(String,GetLineReplacesNul)
+{
+  const char line[] = "a\0b\0\0c\nd";
+  const char expected[] = "a\xEF\xBF\xBD" "b\xEF\xBF\xBD\xEF\xBF\xBD" "c";
+  webvtt_uint pos = 0;
+  webvtt_string str;
+  webvtt_init_string( &str );
+  ASSERT_LT( 0, webvtt_string_getline( &str, line, &pos, sizeof( line ) - 1,
+                                       0, 0 ) );
+  EXPECT_EQ( 6U, pos );
+  EXPECT_STREQ( expected, webvtt_string_text( &str ) );
+  webvtt_release_string( &str );
+}
+
+/**
+ * Appending only asks for as much room as the appended text needs
+ */
+TEST(String,AppendGrowth)
+{
+  std::string text( 1000, 'x' );
+  webvtt_string str;
+  webvtt_init_string( &str );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &str, text.data(), 600 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &str, text.data(), 600 ) );
+  EXPECT_EQ( 1200U, webvtt_string_length( &str ) );
+  EXPECT_GT( 2048U, webvtt_string_capacity( &str ) );
+  webvtt_release_string( &str );
+}
+
+TEST(String,Reserve)
+{
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string_with_text( &str, "Hello",
+                                                             -1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_reserve( &str, 1000 ) );
+  EXPECT_EQ( 1000U, webvtt_string_capacity( &str ) );
+  EXPECT_STREQ( "Hello", webvtt_string_text( &str ) );
+
+  const char *text = webvtt_string_text( &str );
+  std::string more( 995, 'x' );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &str, more.data(),
+                                                   more.size() ) );
+  EXPECT_EQ( text, webvtt_string_text( &str ) );
+
+  /* Never shrinks */
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_reserve( &str, 10 ) );
+  EXPECT_EQ( 1000U, webvtt_string_capacity( &str ) );
+  webvtt_release_string( &str );
+}
+
+TEST(String,ReserveDetaches)
+{
+  webvtt_string str, copy;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &str, "Too long to be inline",
+                                             -1 ) );
+  webvtt_copy_string( &copy, &str );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_reserve( &copy, 10 ) );
+  EXPECT_NE( webvtt_string_text( &str ), webvtt_string_text( &copy ) );
+  EXPECT_STREQ( webvtt_string_text( &str ), webvtt_string_text( &copy ) );
+  webvtt_release_string( &copy );
+  webvtt_release_string( &str );
+}
+
+TEST(String,ShrinkToFit)
+{
+  std::string text( 100, 'x' );
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string( 4000, &str ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &str, text.data(),
+                                                   text.size() ) );
+  ASSERT_LT( 1000U, webvtt_string_capacity( &str ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_shrink_to_fit( &str ) );
+  EXPECT_EQ( 100U, webvtt_string_capacity( &str ) );
+  EXPECT_EQ( text, webvtt_string_text( &str ) );
+
+  webvtt_release_string( &str );
+
+  /* Short enough to move inline */
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string( 1000, &str ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &str, "xxxxx", 5 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_shrink_to_fit( &str ) );
+  EXPECT_EQ( WEBVTT_STRING_INLINE_SIZE - 1, webvtt_string_capacity( &str ) );
+  EXPECT_STREQ( "xxxxx", webvtt_string_text( &str ) );
+  webvtt_release_string( &str );
+}
+
+TEST(String,ShrinkToFitLeavesSharedStrings)
+{
+  webvtt_string str, copy;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string( 4000, &str ) );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_string_append( &str, "Too long to be inline", -1 ) );
+  webvtt_copy_string( &copy, &str );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_shrink_to_fit( &copy ) );
+  EXPECT_EQ( webvtt_string_text( &str ), webvtt_string_text( &copy ) );
+  webvtt_release_string( &copy );
+  webvtt_release_string( &str );
+}
+
+/**
+ * Strings shorter than WEBVTT_STRING_INLINE_SIZE are stored in the string
+ * object itself, and never touch the allocator.
+ */
+TEST(String,ShortStringsAreInline)
+{
+  webvtt_alloc_stats before, after;
+  webvtt_string str;
+  webvtt_collect_alloc_stats( 1 );
+  webvtt_get_alloc_stats( &before );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string_with_text( &str,
+                                                             "fifteen chars..",
+                                                             -1 ) );
+  EXPECT_EQ( 15, webvtt_string_length( &str ) );
+  EXPECT_EQ( WEBVTT_STRING_INLINE_SIZE - 1, webvtt_string_capacity( &str ) );
+  EXPECT_STREQ( "fifteen chars..", webvtt_string_text( &str ) );
+  webvtt_get_alloc_stats( &after );
+  webvtt_collect_alloc_stats( 0 );
+  EXPECT_EQ( before.kinds[ WEBVTT_ALLOC_STRING ].allocs,
+             after.kinds[ WEBVTT_ALLOC_STRING ].allocs );
+  webvtt_release_string( &str );
+}
+
+TEST(String,InlineGrowsToHeap)
+{
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string_with_text( &str,
+                                                             "fifteen chars..",
+                                                             -1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_putc( &str, '!' ) );
+  EXPECT_EQ( 16, webvtt_string_length( &str ) );
+  EXPECT_LE( 16, webvtt_string_capacity( &str ) );
+  EXPECT_STREQ( "fifteen chars..!", webvtt_string_text( &str ) );
+  webvtt_release_string( &str );
+}
+
+TEST(String,InlineCopiesAreIndependent)
+{
+  webvtt_string str, copy;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_string_with_text( &str, "abc",
+                                                             -1 ) );
+  webvtt_copy_string( &copy, &str );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &copy, "def", -1 ) );
+  EXPECT_STREQ( "abc", webvtt_string_text( &str ) );
+  EXPECT_STREQ( "abcdef", webvtt_string_text( &copy ) );
+  webvtt_release_string( &copy );
+  webvtt_release_string( &str );
+}
+
+TEST(String,BorrowedStringsShareText)
+{
+  const char text[] = "some text which is not terminated here|";
+  webvtt_string str, copy;
+  webvtt_string_view view;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_borrowed_string( &str, text, 38 ) );
+  EXPECT_TRUE( webvtt_string_is_borrowed( &str ) );
+  EXPECT_EQ( text, webvtt_string_text( &str ) );
+  EXPECT_EQ( 38, webvtt_string_length( &str ) );
+
+  webvtt_copy_string( &copy, &str );
+  webvtt_string_get_view( &copy, &view );
+  EXPECT_EQ( text, view.text );
+  EXPECT_EQ( 38U, view.length );
+  EXPECT_TRUE( webvtt_string_is_equal( &copy,
+                                       "some text which is not terminated here",
+                                       -1 ) );
+  webvtt_release_string( &copy );
+  webvtt_release_string( &str );
+}
+
+TEST(String,BorrowedStringsCopyOnWrite)
+{
+  const char text[] = "borrowed text, long enough for the heap";
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_borrowed_string( &str, text, 8 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_append( &str, " string", -1 ) );
+  EXPECT_FALSE( webvtt_string_is_borrowed( &str ) );
+  EXPECT_STREQ( "borrowed string", webvtt_string_text( &str ) );
+  EXPECT_STREQ( "borrowed text, long enough for the heap", text );
+  webvtt_release_string( &str );
+
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_create_borrowed_string( &str, text, -1 ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_string_detach( &str ) );
+  EXPECT_FALSE( webvtt_string_is_borrowed( &str ) );
+  EXPECT_NE( text, webvtt_string_text( &str ) );
+  EXPECT_STREQ( text, webvtt_string_text( &str ) );
+  webvtt_release_string( &str );
+}
+
+/**
+ * Appending a String uses its length, since borrowed text has no terminator
+ */
+TEST(String,AppendBorrowedString)
+{
+  const char text[] = "borrowed|not part of the string";
+  webvtt_string borrowed;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_borrowed_string( &borrowed, text, 8 ) );
+  WebVTT::String other( &borrowed );
+  WebVTT::String str( "some " );
+  str.append( other );
+  EXPECT_EQ( 13U, str.length() );
+  EXPECT_STREQ( "some borrowed", str.utf8() );
+  str.append( other, 3 );
+  EXPECT_STREQ( "some borrowedbor", str.utf8() );
+  webvtt_release_string( &borrowed );
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <webvtt/parser.h>
+#include <string>
+#include <thread>
+
+namespace {
+
+void WEBVTT_CALLBACK
+onCue( void *, webvtt_cue *cue )
+{
+  webvtt_release_cue( &cue );
+}
+
+int WEBVTT_CALLBACK
+onError( void *, webvtt_uint, webvtt_uint, webvtt_error )
+{
+  return 0;
+}
+
+void
+parse( const std::string &text )
+{
+  webvtt_parser parser;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_parser( &onCue, &onError, 0, &parser ) );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_parse_chunk( parser, text.data(),
+                                 static_cast<webvtt_uint>( text.size() ) ) );
+  ASSERT_EQ( WEBVTT_SUCCESS, webvtt_finish_parsing( parser ) );
+  webvtt_delete_parser( parser );
+}
+
+}
+
+class StringPool : public ::testing::Test
+{
+public:
+  virtual void SetUp() {
+    webvtt_trim_string_pool();
+    webvtt_get_string_pool_stats( &before );
+  }
+
+  virtual void TearDown() {
+    webvtt_trim_string_pool();
+  }
+
+protected:
+  webvtt_string_pool_stats before;
+};
+
+TEST_F(StringPool,ReusesReleasedBuffer)
+{
+  webvtt_string_pool_stats stats;
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &str, "Hello World, again", -1 ) );
+  const char *first = webvtt_string_text( &str );
+  webvtt_release_string( &str );
+
+  webvtt_get_string_pool_stats( &stats );
+  EXPECT_EQ( 1U, stats.cached_blocks );
+  EXPECT_EQ( before.misses + 1, stats.misses );
+
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &str, "Goodbye World, again",
+                                             -1 ) );
+  EXPECT_EQ( first, webvtt_string_text( &str ) );
+  webvtt_get_string_pool_stats( &stats );
+  EXPECT_EQ( before.hits + 1, stats.hits );
+  EXPECT_EQ( 0U, stats.cached_blocks );
+  EXPECT_STREQ( "Goodbye World, again", webvtt_string_text( &str ) );
+  webvtt_release_string( &str );
+}
+
+TEST_F(StringPool,SizeClassesAreSeparate)
+{
+  webvtt_string_pool_stats stats;
+  webvtt_string small, large;
+  std::string text( 1000, 'x' );
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &large, text.c_str(), -1 ) );
+  webvtt_release_string( &large );
+
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &small, "Hello World, again", -1 ) );
+  webvtt_get_string_pool_stats( &stats );
+  EXPECT_EQ( before.hits, stats.hits );
+  EXPECT_EQ( 1U, stats.cached_blocks );
+  EXPECT_LE( text.size(), stats.cached_bytes );
+  webvtt_release_string( &small );
+}
+
+TEST_F(StringPool,Trim)
+{
+  webvtt_string_pool_stats stats;
+  webvtt_string str;
+  ASSERT_EQ( WEBVTT_SUCCESS,
+             webvtt_create_string_with_text( &str, "Hello World, again", -1 ) );
+  webvtt_release_string( &str );
+  webvtt_trim_string_pool();
+  webvtt_get_string_pool_stats( &stats );
+  EXPECT_EQ( 0U, stats.cached_blocks );
+  EXPECT_EQ( 0U, stats.cached_bytes );
+}
+
+/**
+ * Once the pool has been warmed up, parsing the same document again should not
+ * need any new string buffers.
+ */
+TEST_F(StringPool,SteadyStateParse)
+{
+  webvtt_string_pool_stats warm, stats;
+  std::string text( "WEBVTT\n\n" );
+  for( int i = 0; i < 20; ++i ) {
+    text += "cue\n00:00.000 --> 00:01.000 align:start\n";
+    text += "<v.loud Bob>Hello <b>World</b></v>\n\n";
+  }
+
+  parse( text );
+  webvtt_get_string_pool_stats( &warm );
+  EXPECT_LT( before.misses, warm.misses );
+
+  parse( text );
+  webvtt_get_string_pool_stats( &stats );
+  EXPECT_EQ( warm.misses, stats.misses );
+  EXPECT_LT( warm.hits, stats.hits );
+}
+
+/**
+ * Buffers cached by a thread are freed when it exits, without it calling
+ * webvtt_trim_string_pool(). Leak checkers would report them otherwise.
+ */
+TEST_F(StringPool,EmptiedWhenThreadExits)
+{
+  webvtt_string_pool_stats stats = { 0 };
+  std::thread( [&stats]() {
+    webvtt_string str;
+    ASSERT_EQ( WEBVTT_SUCCESS,
+               webvtt_create_string_with_text( &str, "Hello World, again",
+                                               -1 ) );
+    webvtt_release_string( &str );
+    webvtt_get_string_pool_stats( &stats );
+  } ).join();
+  EXPECT_EQ( 1U, stats.cached_blocks );
+}